@@ -199,7 +199,7 @@ std::optional<json> MessageClient::logout_user() const
 
 std::optional<json> MessageClient::recv_command_response() const
 {
-    static const std::array<std::string, 3> ASYNC_COMMAND_TYPES = {"incoming_message", "incoming_message_response", "timeout"};
+    static const std::array<std::string, 4> ASYNC_COMMAND_TYPES = {"incoming_message", "incoming_message_response", "timeout", "ping"};
 
     while (true)
     {
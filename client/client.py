@@ -45,7 +45,7 @@ def _extract_command(response: JsonDict) -> Optional[str]:
 
 
 class ProtocolClient:
-    """Implements the length-prefixed JSON protocol over TCP."""
+    """Implements the length-prefixed JSON protocol over TCP or a Unix socket."""
 
     # define init method: timeout default is 5.0 seconds
     def __init__(self, timeout: float = 5.0) -> None:
@@ -54,7 +54,12 @@ class ProtocolClient:
 
     # public method 
     def connect(self, host: str, port: int) -> None:
-        self._sock = socket.create_connection((host, port), timeout=self._timeout)
+        if host.startswith("/"):  # path of the server's --unix-socket; port unused
+            self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._sock.settimeout(self._timeout)
+            self._sock.connect(host)
+        else:
+            self._sock = socket.create_connection((host, port), timeout=self._timeout)
         self._sock.settimeout(None)  # switch back to blocking I/O once connected
 
     # public method 
@@ -130,6 +135,7 @@ class MessageClient:
         "incoming_message",
         "incoming_message_response",
         "timeout",
+        "ping",
     }
 
     # public method, register user, retrieve answer
@@ -1517,7 +1523,7 @@ class CursesChatApp:
 
 def parse_args(argv: Optional[list[str]] = None) -> argparse.Namespace:
     parser = argparse.ArgumentParser(description="Minimal CLI client for HuxleyServer")
-    parser.add_argument("host", type=str, help="Server hostname or IP")
+    parser.add_argument("host", type=str, help="Server hostname or IP, or the path of its --unix-socket")
     parser.add_argument("port", type=int, help="Server port")
     parser.add_argument("--timeout", type=float, default=5.0, help="Connection timeout in seconds")
     parser.add_argument("--tui", action="store_true", help="Launch curses-based chat UI")
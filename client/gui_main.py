@@ -344,7 +344,7 @@ def main() -> int:
     import argparse
 
     parser = argparse.ArgumentParser(description="Huxley PyQt6 GUI")
-    parser.add_argument("host", type=str, help="Server hostname or IP")
+    parser.add_argument("host", type=str, help="Server hostname or IP, or the path of its --unix-socket")
     parser.add_argument("port", type=int, help="Server port")
     parser.add_argument("--timeout", type=float, default=5.0)
     parser.add_argument("--history-limit", type=int, default=50)
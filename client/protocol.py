@@ -20,14 +20,20 @@ def _extract_command(response: JsonDict) -> Optional[str]:
 
 
 class ProtocolClient:
-    """Implements the length-prefixed JSON protocol over TCP."""
+    """Implements the length-prefixed JSON protocol over TCP or a Unix socket."""
 
     def __init__(self, timeout: float = 5.0) -> None:
         self._timeout = timeout
         self._sock: Optional[socket.socket] = None
 
     def connect(self, host: str, port: int) -> None:
-        self._sock = socket.create_connection((host, port), timeout=self._timeout)
+        """Connects over TCP, or to the server's --unix-socket when host is a path."""
+        if host.startswith("/"):
+            self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._sock.settimeout(self._timeout)
+            self._sock.connect(host)
+        else:
+            self._sock = socket.create_connection((host, port), timeout=self._timeout)
         self._sock.settimeout(None)
 
     def close(self) -> None:
@@ -87,20 +93,41 @@ class MessageClient:
     protocol: ProtocolClient
     notification_handler: Optional[Callable[[JsonDict], None]] = None
     username: Optional[str] = None
+    resume_token: Optional[str] = None
 
-    _ASYNC_COMMANDS = {"incoming_message", "incoming_message_response", "timeout"}
+    _ASYNC_COMMANDS = {"incoming_message", "incoming_message_response", "timeout", "ping", "presence"}
 
     def register(self, username: str, password: str) -> Optional[JsonDict]:
         self.protocol.send_command({"type": "REGISTER", "username": username, "password": password})
         return self._recv_command_response()
 
-    def login(self, username: str, password: str) -> Optional[JsonDict]:
-        self.protocol.send_command({"type": "LOGIN", "username": username, "password": password})
+    def login(self, username: str, password: str, want_resume: bool = False) -> Optional[JsonDict]:
+        command: JsonDict = {"type": "LOGIN", "username": username, "password": password}
+        if want_resume:
+            command["resume"] = True
+        self.protocol.send_command(command)
         response = self._recv_command_response()
         if response and response.get("success"):
             self.username = username
+            self._keep_resume_token(response)
         return response
 
+    def resume(self, token: Optional[str] = None) -> Optional[JsonDict]:
+        """Restore the session from a LOGIN/RESUME token instead of the password."""
+        self.protocol.send_command({"type": "RESUME", "token": token or self.resume_token or ""})
+        response = self._recv_command_response()
+        if response and response.get("success"):
+            self.username = (response.get("payload") or {}).get("username", self.username)
+            self._keep_resume_token(response)
+        else:
+            self.resume_token = None
+        return response
+
+    def _keep_resume_token(self, response: JsonDict) -> None:
+        token = (response.get("payload") or {}).get("resume_token")
+        if token:
+            self.resume_token = token
+
     def logout(self) -> Optional[JsonDict]:
         self.protocol.send_command({"type": "LOGOUT"})
         response = self._recv_command_response()
@@ -115,6 +142,20 @@ class MessageClient:
         self.protocol.send_command(payload)
         return self._recv_command_response()
 
+    def group_command(self, command: str, group: str) -> Optional[JsonDict]:
+        """CREATE_GROUP, JOIN_GROUP or LEAVE_GROUP."""
+        if not group:
+            raise RuntimeError("Group name is required")
+        self.protocol.send_command({"type": command, "group": group})
+        return self._recv_command_response()
+
+    def send_group(self, group: str, content: str, timestamp: str) -> Optional[JsonDict]:
+        if not self.username:
+            raise RuntimeError("You must /login before sending messages")
+        payload = {"type": "SEND_GROUP", "group": group, "content": content, "timestamp": timestamp}
+        self.protocol.send_command(payload)
+        return self._recv_command_response()
+
     def list_users(self) -> Optional[JsonDict]:
         self.protocol.send_command({"type": "LIST_USERS"})
         return self._recv_command_response()
@@ -123,6 +164,15 @@ class MessageClient:
         self.protocol.send_command({"type": "LIST_ONLINE"})
         return self._recv_command_response()
 
+    def list_backlogged(self) -> Optional[JsonDict]:
+        self.protocol.send_command({"type": "LIST_BACKLOGGED"})
+        return self._recv_command_response()
+
+    def subscribe_presence(self) -> Optional[JsonDict]:
+        """Snapshot now; `presence` deltas go to the notification handler."""
+        self.protocol.send_command({"type": "SUBSCRIBE_PRESENCE"})
+        return self._recv_command_response()
+
     def get_history(self, peer: str, limit: int = 50, offset: int = 0) -> Optional[JsonDict]:
         if not peer:
             raise RuntimeError("Peer username is required")
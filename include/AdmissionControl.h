@@ -0,0 +1,92 @@
+// AdmissionControl.h
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "ServerConfig.h"
+
+class ProtocolHandler;
+
+// Decides, right after accept(), whether a connection may stay: a global
+// connection cap, a per-source-address cap, and token-bucket accept rates
+// (global and per source). Rejected sockets get a pre-serialized `busy`
+// frame and are closed before any worker sees them.
+// Shared by the accept thread and every reuseport worker.
+class AdmissionControl {
+public:
+    enum class Verdict { Admitted, ServerFull, SourceFull, RateLimited };
+
+    struct Stats {
+        uint64_t admitted;
+        uint64_t shedServerFull;
+        uint64_t shedSourceFull;
+        uint64_t shedRateLimited;
+        std::size_t connections;
+    };
+
+    AdmissionControl(const ServerConfig& config, const ProtocolHandler& protocol);
+    ~AdmissionControl();
+
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    // Counts the connection if it is admitted. AF_UNIX peers only count
+    // against the global limits.
+    Verdict admit(int fd, const sockaddr_storage& peer);
+    // Counts a connection without enforcing anything (hot-restart adoptions).
+    void track(int fd);
+    // Sends the busy frame for `verdict` and closes the socket.
+    void reject(int fd, Verdict verdict);
+    // Forgets a counted connection; a no-op for fds that were never counted.
+    // Must run before the fd is closed.
+    void release(int fd);
+
+    Stats stats() const;
+
+private:
+    using SourceKey = std::array<uint8_t, 16>; // IPv4 as v4-mapped IPv6
+    struct SourceKeyHash {
+        std::size_t operator()(const SourceKey& key) const;
+    };
+    struct TokenBucket {
+        double tokens {0};
+        int64_t refilledNs {0};
+    };
+    struct Source {
+        std::size_t connections {0};
+        TokenBucket bucket;
+    };
+    struct Slot {
+        bool counted {false};
+        bool hasSource {false};
+        SourceKey source {};
+    };
+
+    static bool take(TokenBucket& bucket, unsigned rate, int64_t now);
+    void countLocked(int fd, const SourceKey* source);
+    void sweepIdleSourcesLocked(int64_t now);
+
+    const std::size_t maxConnections;
+    const std::size_t maxPerSource;
+    const unsigned acceptRate;
+    const unsigned acceptRatePerSource;
+    std::array<std::string, 4> busyFrames; // indexed by Verdict
+
+    mutable pthread_mutex_t mutex;
+    std::size_t connections {0};
+    TokenBucket globalBucket;
+    std::unordered_map<SourceKey, Source, SourceKeyHash> sources;
+    std::size_t sweepAt {1024};
+    std::vector<Slot> slots; // indexed by fd
+
+    std::atomic<uint64_t> admitted {0};
+    std::atomic<uint64_t> shed[4] {};
+};
@@ -1,18 +1,96 @@
 // AuthManager.h
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <string>
+#include <vector>
+#include <pthread.h>
 
 class Database;
+class UserDirectory;
 
 // Handles registration, authentication, and session validation.
+//
+// Argon2 costs ~50 ms a call, so servers start a small pool and use the
+// *Async variants: the hash runs on a pool thread and `done` is called
+// there with the result. Without a running pool they run on the caller.
+//
+// The Argon2 cost defaults to libsodium's INTERACTIVE limits; servers load
+// (or calibrate) it with loadHashCost. Logins rehash passwords stored under
+// other parameters.
 class AuthManager {
 public:
-    explicit AuthManager(Database& db);
+    using Completion = std::function<void(bool ok)>;
+
+    struct HashCost {
+        uint64_t iterations;
+        std::size_t memoryBytes;
+    };
+
+    // Users it registers are added to `directory`, if given.
+    explicit AuthManager(Database& db, UserDirectory* directory = nullptr);
+    ~AuthManager();
+
+    AuthManager(const AuthManager&) = delete;
+    AuthManager& operator=(const AuthManager&) = delete;
+
     bool registerUser(const std::string& username, const std::string& password);
     bool loginUser(const std::string& username, const std::string& password);
 
+    // The cost stored in the config table, or, on first run or with
+    // recalibrate, the largest that hashes within targetMillis on this
+    // machine using at most memoryPerHash, which is then stored. Call
+    // before startPool.
+    HashCost loadHashCost(unsigned targetMillis, std::size_t memoryPerHash, bool recalibrate);
+    // Hashes wait while this much Argon2 memory is in use (0 = no limit);
+    // one always runs, whatever its size.
+    void setMemoryBudget(std::size_t bytes);
+
+    // At most queueLimit requests wait for a thread; stopPool() fails the
+    // ones that have not started (their `done` gets false).
+    bool startPool(std::size_t threads, std::size_t queueLimit);
+    void stopPool();
+    // False, without calling `done`, when the queue is full.
+    bool registerUserAsync(const std::string& username, const std::string& password, Completion done);
+    bool loginUserAsync(const std::string& username, const std::string& password, Completion done);
+
 private:
-    std::string hashPassword(const std::string& password) const;
+    // Holds `bytes` of the memory budget for one Argon2 call.
+    class MemoryReservation {
+    public:
+        MemoryReservation(AuthManager& auth, std::size_t bytes);
+        ~MemoryReservation();
+        MemoryReservation(const MemoryReservation&) = delete;
+        MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+    private:
+        AuthManager& auth;
+        std::size_t bytes;
+    };
+
+    static HashCost calibrate(unsigned targetMillis, std::size_t memoryPerHash);
+    std::string hashPassword(const std::string& password);
+    // Called with true when the pool stops before the job has started.
+    using PoolJob = std::function<void(bool cancelled)>;
+    bool submit(PoolJob job);
+    static void* poolThreadEntry(void* arg);
+    void poolLoop();
 
     Database& database;
-};
\ No newline at end of file
+    UserDirectory* userDirectory;
+    HashCost hashCost;
+
+    pthread_mutex_t memoryMutex;
+    pthread_cond_t memoryCond;
+    std::size_t memoryBudget {0};
+    std::size_t memoryInUse {0};
+
+    pthread_mutex_t poolMutex;
+    pthread_cond_t poolCond;
+    std::deque<PoolJob> jobs; // guarded by poolMutex
+    std::vector<pthread_t> poolThreads;
+    std::size_t maxQueued {0};
+    bool poolRunning {false};
+};
@@ -0,0 +1,55 @@
+// ClientHandle.h
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <pthread.h>
+
+#include "ClientNotifier.h"
+
+// The part of a connection other threads may use. The router keeps these
+// instead of ClientState pointers: a handle names the connection by (owner,
+// socket, generation), so whatever is posted to it after the connection has
+// closed is dropped by the owner, and it is shared, so it stays valid after
+// the ClientState is gone. The backlog flag and the senders waiting on it
+// live here because the sending side needs them.
+class ClientHandle {
+public:
+    struct BlockedSender {
+        ClientNotifier* owner;
+        int socketFd;
+        uint32_t generation;
+    };
+
+    ClientHandle(ClientNotifier* owner, int socketFd, uint32_t generation);
+    ~ClientHandle();
+
+    ClientHandle(const ClientHandle&) = delete;
+    ClientHandle& operator=(const ClientHandle&) = delete;
+
+    ClientNotifier* owner() const { return owner_; }
+    int socket() const { return socketFd; }
+    uint32_t generation() const { return generation_; }
+    BlockedSender asBlockedSender() const { return BlockedSender{owner_, socketFd, generation_}; }
+
+    // Safe from any thread.
+    void postMessage(IncomingMessage message) const;
+
+    // Set and cleared by the owner between the send watermarks; read anywhere.
+    bool isBacklogged() const { return backlogged.load(std::memory_order_acquire); }
+    void setBacklogged(bool value);
+    // Records a peer connection that stopped reading because of our backlog.
+    // Returns false if the backlog has already cleared (nothing to wait for).
+    bool addBlockedSender(const BlockedSender& sender);
+    // Clears the list; the caller resumes every returned connection.
+    std::vector<BlockedSender> takeBlockedSenders();
+
+private:
+    ClientNotifier* const owner_;
+    const int socketFd;
+    const uint32_t generation_;
+    std::atomic<bool> backlogged {false};
+    std::vector<BlockedSender> blockedSenders; // guarded by backlogMutex
+    pthread_mutex_t backlogMutex;
+};
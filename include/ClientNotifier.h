@@ -1,9 +1,36 @@
 #pragma once
 
-// Lightweight interface that lets ClientState signal its owner worker
-// when new outbound data is available.
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "FrameBuffer.h"
+
+// A stored chat message on its way to an online recipient.
+struct IncomingMessage {
+    std::string sender;
+    std::string recipient; // username, or the group's name
+    int recipientId;
+    std::string content;
+    std::string timestamp;
+    int id;                // messages.id, or group_messages.id with groupId
+    int groupId {0};
+    // Group messages arrive encoded, one buffer for every member.
+    std::shared_ptr<const std::string> frame;
+};
+
+// Lightweight interface that lets ClientState hand outbound frames to its
+// owner worker. May be called from any thread; the owner appends the frame
+// to the client's send queue itself, provided the connection identified by
+// (clientFd, generation) is still open.
 class ClientNotifier {
 public:
     virtual ~ClientNotifier() = default;
-    virtual void notifyEvent(int clientFd) = 0;
+    virtual void postFrame(int clientFd, uint32_t generation, FrameBuffer frame) = 0;
+    // Lets a connection whose reads were paused by a backlogged peer carry on.
+    virtual void resumeReading(int clientFd, uint32_t generation) = 0;
+    // Delivers a routed message into the owner's mailbox; the owner frames
+    // it for the connection, or drops it if the connection is gone (it stays
+    // in the store as undelivered).
+    virtual void postMessage(int clientFd, uint32_t generation, IncomingMessage message) = 0;
 };
@@ -1,52 +1,145 @@
 // ClientState.h
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <string>
-#include <time.h>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include <pthread.h>
 
+#include "ClientHandle.h"
 #include "ClientNotifier.h"
+#include "FrameBuffer.h"
 #include "ProtocolHandler.h"
+#include "RecvBuffer.h"
+
+class ShmTransport;
 
 // Represents per-connection state owned by a specific worker thread.
 class ClientState {
 public:
-    ClientState(ClientNotifier* owner, int socketFd, ProtocolHandler& protocol);
+    ClientState(ClientNotifier* owner, int socketFd, uint32_t generation, ProtocolHandler& protocol);
     ~ClientState();
 
     int socket() const { return socketFd; }
+    uint32_t generation() const { return generation_; }
     ClientNotifier* ownerThread() const { return owner; }
+    // What the router and other threads hold instead of this object.
+    const std::shared_ptr<ClientHandle>& handle() const { return handle_; }
 
     bool isAuthenticated() const { return authenticated; }
     void setAuthenticated(bool value);
     const std::string& username() const { return username_; }
     void setUsername(std::string name);
+    // users.id of the logged-in user, resolved once at login (0 = none).
+    int userId() const { return userId_; }
+    void setUserId(int id);
+
+    // Highest ids read by the last catch-up from the store (owner thread
+    // only). A routed message at or below them reached this connection
+    // through that catch-up, or before it, and is dropped from the mailbox.
+    void noteCaughtUp(int messageId);
+    void noteGroupCaughtUp(int groupId, int messageId);
+    bool alreadyQueued(const IncomingMessage& message) const;
+    int caughtUp() const { return caughtUpTo; }
+    const std::unordered_map<int, int>& groupsCaughtUp() const { return groupCaughtUpTo; }
 
-    time_t lastActivity() const { return lastActivityTs; }
-    void updateActivity(time_t now);
+    // Timestamps in the owner's timer ticks (monotonic seconds). Activity is
+    // any command but a heartbeat; "heard" is any byte received.
+    uint64_t lastActivity() const { return lastActivityTs; }
+    void updateActivity(uint64_t now);
+    uint64_t lastHeard() const { return lastHeardTs; }
+    void markHeard(uint64_t now) { lastHeardTs = now; }
+    // Session expired: waiting for the final frames to drain before closing.
+    bool closing() const { return closingAfterFlush; }
+    void setClosing(bool value) { closingAfterFlush = value; }
 
-    std::string& mutableRecvBuffer() { return recvBuffer; }
+    RecvBuffer& mutableRecvBuffer() { return recvBuffer; }
     void clearRecvBuffer();
 
-    void queueResponse(const std::string& message);
+    // Safe from any thread: the frame travels through the owner's outbox.
+    void queueResponse(std::string message);
     void queueProtocolResponse(const Response& response);
     void queueIncomingMessage(const std::string& sender,
                               const std::string& content,
                               const std::string& timestamp = {},
-                              std::optional<int> messageId = std::nullopt);
-    void pushFrontResponse(const std::string& message);
+                              std::optional<int> messageId = std::nullopt,
+                              const std::string& group = {});
+    // An already encoded frame, shared with other recipients (group fan-out).
+    void queueFrame(std::shared_ptr<const std::string> frame);
+    // Length prefix plus payload, as queued by the calls above.
+    static std::string encodeFrame(const std::string& payload);
+
+    // The send queue itself belongs to the owner thread.
+    void appendQueuedFrame(FrameBuffer frame);
     bool popQueuedResponse(std::string& outMessage);
+    std::size_t queuedBytes() const { return sendQueueBytes; }
+
+    // Zero-copy access for the flush paths. The first view starts at the
+    // unsent part of the head frame. Views stay valid until the owner consumes
+    // them: producers only ever append to the queue.
+    std::size_t peekQueuedResponses(std::vector<std::string_view>& out, std::size_t maxFrames);
+    // Marks `bytes` as sent, popping every frame that is now fully written.
+    void consumeQueuedBytes(std::size_t bytes);
+
+    // io_uring operations outstanding on this socket (owner thread only).
+    bool receiveArmed() const { return recvArmed; }
+    void setReceiveArmed(bool armed) { recvArmed = armed; }
+    unsigned sendsInFlight() const { return inFlightSends; }
+    void setSendsInFlight(unsigned count) { inFlightSends = count; }
+    // Slow-consumer state, kept on the handle (see ClientHandle.h).
+    using BlockedSender = ClientHandle::BlockedSender;
+    bool isBacklogged() const { return handle_->isBacklogged(); }
+    void setBacklogged(bool value) { handle_->setBacklogged(value); }
+    std::vector<BlockedSender> takeBlockedSenders() { return handle_->takeBlockedSenders(); }
+    // Our own reads are paused behind a backlogged peer (owner thread only).
+    bool readPaused() const { return readsPaused; }
+    void setReadPaused(bool paused) { readsPaused = paused; }
+    // A register/login is on the auth pool; reads stay paused until it is
+    // answered, whatever else resumes them (owner thread only).
+    bool authPending() const { return authInFlight; }
+    void setAuthPending(bool pending) { authInFlight = pending; }
+
+    // Set once a local client switches to the shared-memory rings (owner
+    // thread only). The socket then only signals hangup.
+    ShmTransport* sharedMemory() const { return shm.get(); }
+    void attachSharedMemory(std::unique_ptr<ShmTransport> transport);
+
+    // Listed for the owner's next flush pass (owner thread only).
+    bool flushScheduled() const { return flushPending; }
+    void setFlushScheduled(bool scheduled) { flushPending = scheduled; }
+    // Stopped at the per-wakeup read cap; listed for another read pass.
+    bool readScheduled() const { return readPending; }
+    void setReadScheduled(bool scheduled) { readPending = scheduled; }
 
 private:
     ClientNotifier* owner;
     int socketFd;
+    uint32_t generation_;
+    bool recvArmed {false};
+    unsigned inFlightSends {0};
+    bool flushPending {false};
+    bool readPending {false};
+    bool readsPaused {false};
+    bool authInFlight {false};
+    std::shared_ptr<ClientHandle> handle_;
     std::string username_;
+    int userId_ {0};
+    int caughtUpTo {0};
+    std::unordered_map<int, int> groupCaughtUpTo;
     bool authenticated;
-    time_t lastActivityTs;
-    std::string recvBuffer;
-    std::deque<std::string> sendQueue;
-    pthread_mutex_t sendMutex;
+    uint64_t lastActivityTs;
+    uint64_t lastHeardTs {0};
+    bool closingAfterFlush {false};
+    RecvBuffer recvBuffer;
+    std::deque<FrameBuffer> sendQueue;
+    std::size_t sendQueueBytes {0};
+    std::size_t sendHeadOffset {0}; // bytes of sendQueue.front() already sent
+    std::unique_ptr<ShmTransport> shm;
 
     ProtocolHandler& protocolHandler;
 };
@@ -0,0 +1,17 @@
+// CpuAffinity.h
+#pragma once
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+
+// Helpers for the worker CPU profile (--worker-cpus and friends).
+namespace affinity {
+
+// Parses "0,2-3" into {0, 2, 3}. Rejects empty lists and CPUs past CPU_SETSIZE.
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+// Formats a set back as a compact list, e.g. "0,2-3".
+std::string formatCpuSet(const cpu_set_t& set);
+
+} // namespace affinity
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <sodium.h>
 
@@ -19,9 +20,17 @@ public:
     CipherMessage encryptMessage(const std::string& plaintext);
     bool decryptMessage(const CipherMessage& cipher, std::string& outPlaintext);
 
+    // Session tokens for RESUME: username, the user's token epoch and expiry
+    // (unix seconds), MAC'd with a key derived from the master key so they
+    // survive restarts. Revocation is the caller's epoch check.
+    std::string issueResumeToken(const std::string& username, uint32_t epoch, uint64_t expiresAt);
+    // True if `token` is one of ours and unexpired at `now`.
+    bool verifyResumeToken(const std::string& token, uint64_t now, std::string& outUsername, uint32_t& outEpoch);
+
 private:
     std::array<unsigned char, crypto_secretbox_KEYBYTES> secretKey;
     std::array<unsigned char, crypto_secretbox_KEYBYTES> masterKey;
+    std::array<unsigned char, crypto_auth_KEYBYTES> resumeKey;
     bool keyLoaded;
     bool masterLoaded;
 
@@ -1,15 +1,26 @@
 // DatabaseEngine.h
 #pragma once
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
+#include <pthread.h>
 
 struct sqlite3;
 struct sqlite3_stmt;
 
 // Database Wrapper around the SQLite persistence layer.
+//
+// The instance main() creates owns the one read-write connection; every
+// write goes through it, serialized by its mutex. Threads that query a lot
+// (the workers) call openThreadReader() to get a private read-only WAL
+// connection with its own statement cache: from then on their lookups run
+// on it, in parallel with other readers and with the writer. Threads
+// without a reader fall back to the writer connection.
 class Database {
 public:
+    enum class Mode { ReadWrite, ReadOnly };
+
     struct StoredMessage {
         int id;
         int senderId;
@@ -19,15 +30,49 @@ public:
         std::string timestamp;
     };
 
+    struct StoredGroupMessage {
+        int id;
+        int groupId;
+        std::string group;
+        int senderId;
+        std::string ciphertext;
+        std::string nonce;
+        std::string timestamp;
+    };
+
     struct UserSummary {
         int id;
         std::string username;
     };
 
-    explicit Database(const std::string& filename);
+    explicit Database(const std::string& filename, Mode mode = Mode::ReadWrite);
     ~Database();
 
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
+
+    // One BEGIN IMMEDIATE ... COMMIT on the writer connection, for batching
+    // writes (see DatabaseWriter). Other threads' calls wait until it ends;
+    // the owning thread keeps using the usual methods. Rolls back unless
+    // committed.
+    class Transaction {
+    public:
+        explicit Transaction(Database& db);
+        ~Transaction();
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        bool commit();
+
+    private:
+        Database& database;
+        bool open;
+    };
+
     bool isOpen() const noexcept;
+    // Per-thread read connections (see above). Close before the thread exits.
+    bool openThreadReader();
+    void closeThreadReader();
     template <typename Input, typename Output>
     bool singleColumnQuery(sqlite3_stmt*& cachedStmt,
                            const char* sql,
@@ -38,6 +83,19 @@ public:
     bool findUser(const std::string& username, std::string& outHash) const;
     bool findUserId(const std::string& username, int& outId) const;
     bool findUsername(int userId, std::string& outUsername) const;
+    // Also revokes the user's resume tokens.
+    bool updatePasswordHash(const std::string& username, const std::string& passwordHash);
+
+    // Resume tokens are valid only while they carry at least the user's
+    // current epoch. revokeTokens() bumps it; raiseTokenEpoch() moves it up
+    // to a newly issued token's, retiring the ones before.
+    bool tokenEpoch(int userId, int& outEpoch) const;
+    bool raiseTokenEpoch(int userId, int epoch);
+    bool revokeTokens(int userId);
+
+    // Argon2 cost in the config table (row 1): iterations and memory bytes.
+    bool loadHashParams(uint64_t& outIterations, uint64_t& outMemoryBytes) const;
+    bool storeHashParams(uint64_t iterations, uint64_t memoryBytes);
 
     bool insertMessage(int senderId,
                        int recipientId,
@@ -52,6 +110,22 @@ public:
                                                int offset) const;
     bool markDelivered(int messageId);
 
+    // Groups: one stored row per message, and a delivery cursor per member.
+    bool createGroup(const std::string& name, int creatorId, int& outGroupId);
+    bool findGroupId(const std::string& name, int& outGroupId) const;
+    bool isGroupMember(int groupId, int userId) const;
+    bool joinGroup(int groupId, int userId);
+    bool leaveGroup(int groupId, int userId);
+    std::vector<int> groupMemberIds(int groupId) const;
+    bool insertGroupMessage(int groupId,
+                            int senderId,
+                            const std::string& ciphertext,
+                            const std::string& nonce,
+                            int& outMessageId);
+    std::vector<StoredGroupMessage> getQueuedGroupMessages(int userId) const;
+    bool advanceGroupCursor(int groupId, int userId, int messageId);
+    bool setGroupCursor(int groupId, int userId, int messageId);
+
     bool logActivity(const std::string& level, const std::string& message);
 
 private:
@@ -72,6 +146,20 @@ private:
         sqlite3_stmt* statement;
     };
 
+    // Holds the connection mutex (recursive, for Transaction) for one call;
+    // uncontended on a reader.
+    class ConnectionLock {
+    public:
+        explicit ConnectionLock(const Database& db) noexcept;
+        ~ConnectionLock();
+        ConnectionLock(const ConnectionLock&) = delete;
+        ConnectionLock& operator=(const ConnectionLock&) = delete;
+
+    private:
+        const Database& database;
+    };
+
+    const Database* threadReader() const noexcept;
     bool configurePragmas();
     bool ensureSchema();
     sqlite3_stmt* getStatement(sqlite3_stmt*& stmt, const char* sql) const;
@@ -82,6 +170,11 @@ private:
 
     sqlite3* dbHandle;
     std::string dbPath;
+    Mode mode;
+    mutable pthread_mutex_t connectionMutex;
+
+    pthread_mutex_t readersMutex;
+    std::vector<std::unique_ptr<Database>> readers; // one per thread that asked, guarded by readersMutex
 
     mutable sqlite3_stmt* insertUserStmt {nullptr};
     mutable sqlite3_stmt* findUserStmt {nullptr};
@@ -93,4 +186,20 @@ private:
     mutable sqlite3_stmt* conversationStmt {nullptr};
     mutable sqlite3_stmt* markDeliveredStmt {nullptr};
     mutable sqlite3_stmt* logActivityStmt {nullptr};
+    mutable sqlite3_stmt* updatePasswordStmt {nullptr};
+    mutable sqlite3_stmt* loadHashParamsStmt {nullptr};
+    mutable sqlite3_stmt* storeHashParamsStmt {nullptr};
+    mutable sqlite3_stmt* createGroupStmt {nullptr};
+    mutable sqlite3_stmt* findGroupIdStmt {nullptr};
+    mutable sqlite3_stmt* groupMemberStmt {nullptr};
+    mutable sqlite3_stmt* joinGroupStmt {nullptr};
+    mutable sqlite3_stmt* leaveGroupStmt {nullptr};
+    mutable sqlite3_stmt* groupMembersStmt {nullptr};
+    mutable sqlite3_stmt* insertGroupMessageStmt {nullptr};
+    mutable sqlite3_stmt* queuedGroupMessagesStmt {nullptr};
+    mutable sqlite3_stmt* advanceGroupCursorStmt {nullptr};
+    mutable sqlite3_stmt* setGroupCursorStmt {nullptr};
+    mutable sqlite3_stmt* tokenEpochStmt {nullptr};
+    mutable sqlite3_stmt* raiseTokenEpochStmt {nullptr};
+    mutable sqlite3_stmt* revokeTokensStmt {nullptr};
 };
@@ -0,0 +1,74 @@
+// DatabaseWriter.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <vector>
+#include <pthread.h>
+
+class Database;
+
+// Single thread that performs the message writes, so commit latency (an SD
+// card fsync, a WAL checkpoint) never lands on an event loop. Callers queue
+// jobs and carry on; the thread runs everything that has queued up in one
+// transaction as soon as maxBatch jobs are waiting or the oldest has waited
+// maxDelayMicros, and then calls each job's completion.
+class DatabaseWriter {
+public:
+    // Runs on the writer thread inside the batch transaction.
+    using Job = std::function<bool(Database&)>;
+    // Runs on the writer thread once the batch is over: true if the job
+    // succeeded and the batch committed. Post results back to the thread
+    // that cares instead of doing real work here.
+    using Completion = std::function<void(bool committed)>;
+
+    struct Stats {
+        uint64_t jobs;
+        uint64_t batches;
+        uint64_t failed;
+    };
+
+    explicit DatabaseWriter(Database& database, std::size_t maxBatch = 64, unsigned maxDelayMicros = 2000);
+    ~DatabaseWriter();
+
+    DatabaseWriter(const DatabaseWriter&) = delete;
+    DatabaseWriter& operator=(const DatabaseWriter&) = delete;
+
+    bool start();
+    // Commits whatever is still queued, then joins the thread.
+    void stop();
+
+    // Safe from any thread, including a completion. While the writer is not
+    // running the job runs and commits on the caller, as a batch of one.
+    void submit(Job job, Completion done = {});
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        Job job;
+        Completion done;
+    };
+
+    static void* threadEntry(void* arg);
+    void writerLoop();
+    void runBatch(std::vector<Entry>& batch);
+
+    Database& database;
+    const std::size_t maxBatch;
+    const unsigned maxDelayMicros;
+
+    pthread_t threadHandle {0};
+    pthread_mutex_t queueMutex;
+    pthread_cond_t queueCond; // CLOCK_MONOTONIC
+    std::vector<Entry> queue; // guarded by queueMutex
+    timespec oldestQueuedAt {}; // when queue last went non-empty
+    bool running {false};
+
+    std::atomic<uint64_t> jobCount {0};
+    std::atomic<uint64_t> batchCount {0};
+    std::atomic<uint64_t> failedCount {0};
+};
@@ -0,0 +1,32 @@
+// FrameBuffer.h
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// One encoded frame in a send queue. Usually the queue owns it; a group
+// message's frame is encoded once and the same immutable buffer is shared by
+// every recipient's queue.
+class FrameBuffer {
+public:
+    FrameBuffer(std::string frame)
+        : owned(std::move(frame))
+    {
+    }
+    FrameBuffer(std::shared_ptr<const std::string> frame)
+        : shared(std::move(frame))
+    {
+    }
+
+    std::string_view view() const { return shared ? std::string_view(*shared) : std::string_view(owned); }
+    std::size_t size() const { return shared ? shared->size() : owned.size(); }
+    // The bytes as an owned string; copies a shared frame.
+    std::string release() { return shared ? std::string(*shared) : std::move(owned); }
+
+private:
+    std::string owned;
+    std::shared_ptr<const std::string> shared;
+};
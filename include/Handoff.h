@@ -0,0 +1,47 @@
+// Handoff.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hot-restart channel between a running server and its successor, over a
+// Unix SOCK_SEQPACKET socket. File descriptors travel as SCM_RIGHTS; every
+// message starts with a one-byte type so the two sides stay in lockstep:
+//
+//   old -> new   Listeners (fds)
+//   new -> old   Ready               successor's workers are up and accepting
+//   old -> new   Session (fd) + Data chunks, once per migrated connection
+//   old -> new   Done
+//
+// The old process stops accepting after Ready and exits after Done.
+
+// A connection migrated between processes: the socket plus what its
+// ClientState needs to pick up exactly where the old process left off.
+struct SessionHandoff {
+    int fd {-1};
+    bool authenticated {false};
+    std::string username;
+    std::string recvPending; // bytes received but not yet parsed
+    std::string sendPending; // queued output not yet written, frames back to back
+};
+
+namespace handoff {
+
+// Old side: the socket a successor connects to. Replaces a stale socket file.
+int listen(const std::string& path);
+// New side: connects to a running server's handoff socket.
+int connect(const std::string& path);
+
+bool sendListeners(int channel, const std::vector<int>& fds);
+bool recvListeners(int channel, std::vector<int>& fds);
+bool sendReady(int channel);
+bool recvReady(int channel);
+// The session's fd is only duplicated into the successor; the caller still
+// owns (and must close) its own copy.
+bool sendSession(int channel, const SessionHandoff& session);
+bool sendDone(int channel);
+// Returns false on error or once Done arrives (`done` tells them apart).
+bool recvSession(int channel, SessionHandoff& session, bool& done);
+
+} // namespace handoff
@@ -8,6 +8,9 @@
 #include <vector>
 #include <pthread.h>
 
+#include "AdmissionControl.h"
+#include "ServerConfig.h"
+
 // Forward declarations
 class WorkerThread;
 class AuthManager;
@@ -16,30 +19,59 @@ class StatusManager;
 class CryptoEngine;
 class ProtocolHandler;
 class Database;
+class DatabaseWriter;
+class UserDirectory;
 
 // Main orchestrator responsible for standing up shared services and
 // dispatching accepted sockets to the worker thread pool.
 class HuxleyServer {
 public:
     HuxleyServer();
+    explicit HuxleyServer(const ServerConfig& config);
     ~HuxleyServer();
 
     bool start(int port);
     void stop();
+    // True once a successor took over (see ServerConfig::upgradeSocketPath);
+    // the caller should then stop() and exit.
+    bool handedOff() const { return handoffComplete.load(); }
+    // Connections admitted and shed so far (zeroes while stopped).
+    AdmissionControl::Stats admissionStats() const;
 
 private:
     void acceptLoop();
     static void* acceptThreadEntry(void* arg);
+    void stopAccepting();
+    int receiveListeners();
+    void completeTakeover();
+    static void* upgradeThreadEntry(void* arg);
+    void upgradeLoop();
+    bool handOffTo(int channel);
     void dispatchPendingClients();
+    WorkerThread* pickWorker();
     bool initializeServices(int port);
-    void startWorkerPool(std::size_t threadCount); // changed here
+    int takeInheritedListener(bool unixDomain);
+    bool startWorkerPool(std::size_t threadCount, int port); // changed here
+    void isolateServiceThreads();
     void stopWorkerPool();
     void shutdownServices();
 
-    int listenFd {-1};
+    ServerConfig config;
+    int listenFd {-1};       // shared-queue TCP listener
+    int unixListenFd {-1};   // config.unixSocketPath, always served by the accept thread
+    int acceptWakeFd {-1}; // eventfd that stops the accept thread without touching listenFd
     std::atomic<bool> running {false}; // changed here
     pthread_t acceptThread {0};
 
+    // Hot restart: listeners received from the previous process (consumed as
+    // the pool starts), the channel it is still waiting on, and our own
+    // socket for the next successor.
+    std::vector<int> inheritedListeners;
+    int takeoverChannel {-1};
+    int upgradeFd {-1};
+    pthread_t upgradeThread {0};
+    std::atomic<bool> handoffComplete {false};
+
     pthread_mutex_t queueMutex;
     pthread_cond_t queueCond;
     std::queue<int> socketQueue;
@@ -51,8 +83,11 @@ private:
     std::unique_ptr<StatusManager> statusManager;
     std::unique_ptr<CryptoEngine> cryptoEngine;
     std::unique_ptr<ProtocolHandler> protocolHandler;
+    std::unique_ptr<AdmissionControl> admissionControl;
     std::unique_ptr<Database> database;
+    std::unique_ptr<DatabaseWriter> databaseWriter;
+    std::unique_ptr<UserDirectory> userDirectory;
 
     std::string databasePath;
-    std::size_t nextWorkerIndex {0};
+    uint64_t placementRng {0};
 };
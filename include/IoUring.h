@@ -0,0 +1,91 @@
+// IoUring.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+// Thin wrapper over the raw io_uring syscalls used by WorkerThread's
+// io_uring backend. It owns the submission/completion rings and one
+// provided-buffer ring for multishot receives. Not thread-safe: the ring is
+// created, fed and reaped by a single worker thread.
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Creates the ring. Must run on the thread that will submit to it.
+    bool init(unsigned entries);
+    // Registers `count` buffers of `bufferSize` bytes under `groupId`.
+    bool setupBufferRing(uint16_t groupId, unsigned count, unsigned bufferSize);
+    // Verifies multishot recv with provided buffers actually works here.
+    bool probeMultishotRecv();
+
+    // Returns a zeroed SQE, flushing the queue to the kernel if it is full.
+    io_uring_sqe* nextSqe();
+    // Makes room for up to `wanted` SQEs; returns how many are guaranteed.
+    unsigned reserveSqes(unsigned wanted);
+    // Submits queued SQEs and waits for at least `waitFor` completions.
+    int submit(unsigned waitFor);
+
+    template <typename Fn>
+    unsigned drainCompletions(Fn&& fn);
+
+    char* providedBuffer(uint16_t bufferId) const;
+    void recycleBuffer(uint16_t bufferId);
+    uint16_t bufferGroup() const { return bufGroup; }
+    unsigned bufferSize() const { return bufSize; }
+
+private:
+    void teardown();
+
+    int ringFd;
+
+    void* sqRingPtr;
+    std::size_t sqRingSize;
+    void* cqRingPtr;
+    std::size_t cqRingSize;
+    io_uring_sqe* sqes;
+    std::size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+    void* bufRingPtr;
+    std::size_t bufRingSize;
+    uint16_t* bufRingTail;
+    unsigned bufRingMask;
+    char* bufPool;
+    unsigned bufCount;
+    unsigned bufSize;
+    uint16_t bufGroup;
+    bool bufRegistered;
+};
+
+template <typename Fn>
+unsigned IoUring::drainCompletions(Fn&& fn)
+{
+    unsigned head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    unsigned seen = 0;
+    while (head != tail) {
+        const io_uring_cqe cqe = cqes[head & cqMask];
+        ++head;
+        // Release the slot before the callback so it may submit freely.
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        fn(cqe);
+        ++seen;
+    }
+    return seen;
+}
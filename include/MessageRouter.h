@@ -1,32 +1,117 @@
 #pragma once
-#include <map>
+#include <array>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <pthread.h>
 #include "CryptoEngine.h"
 #include "DatabaseEngine.h"
+#include "DatabaseWriter.h"
+#include "ClientHandle.h"
 #include "ClientState.h"
+#include "PresenceLog.h"
+#include "ProtocolHandler.h"
+#include "ServerConfig.h"
+#include "UserDirectory.h"
 
 // Routes encrypted messages to online clients or persists them for later delivery.
+// Every message is stored through the DatabaseWriter first; an online
+// recipient gets it once the insert has committed, posted to its worker's
+// mailbox through the ClientHandle. The router never touches a ClientState.
+//
+// Online users live in a registry keyed by user id (names are resolved through
+// the UserDirectory) and split into shards, each under its own
+// reader-writer lock. Lookups only wait for a login or logout in the
+// same shard, and listing takes the shards one at a time.
 class MessageRouter {
 public:
     MessageRouter(Database& db,
-                  CryptoEngine& crypto);
+                  DatabaseWriter& writer,
+                  UserDirectory& directory,
+                  CryptoEngine& crypto,
+                  ServerConfig::SlowConsumerPolicy policy = ServerConfig::SlowConsumerPolicy::SpillOffline);
     ~MessageRouter();
 
-    bool isRegistered(const std::string& username);
+    UserDirectory& directory() { return users; }
+    DatabaseWriter& writer() { return databaseWriter; }
+    // Every registerClient/unregisterClient that changes the registry, in order.
+    PresenceLog& presence() { return presenceLog; }
 
-    void registerClient(const std::string& username, ClientState* state);
-    void unregisterClient(const std::string& username);
+    bool isRegistered(int userId);
+
+    // False, and nothing changes, if the user is already online.
+    bool registerClient(int userId, const std::string& username, std::shared_ptr<ClientHandle> client);
+    void unregisterClient(int userId);
     std::vector<std::string> listActiveUsers();
 
-    bool routeMessage(const std::string& sender,
+    // Returns false if the recipient is unknown; otherwise the message is on
+    // its way to the store and `onStored` (if any) reports, from the writer
+    // thread, whether it made it.
+    bool routeMessage(int senderId,
+                      const std::string& sender,
                       const std::string& recipient,
-                      const std::string& plaintext);
+                      const std::string& plaintext,
+                      DatabaseWriter::Completion onStored = {});
+
+    // Stores a group message once, then hands every online member but the
+    // sender the same encoded frame. The caller has checked membership.
+    void routeGroupMessage(int senderId,
+                           const std::string& sender,
+                           int groupId,
+                           const std::string& group,
+                           const std::string& plaintext,
+                           DatabaseWriter::Completion onStored = {});
+
+    // Membership changes go through the writer like any other write; `done`
+    // runs on the writer thread. createGroup's completion gets the new id.
+    void createGroup(int creatorId, const std::string& name, std::function<void(bool created, int groupId)> done);
+    void joinGroup(int userId, int groupId, DatabaseWriter::Completion done);
+    void leaveGroup(int userId, int groupId, DatabaseWriter::Completion done);
+
+    // Recipient's worker, once a routed message is in the send queue.
+    void confirmDelivered(const IncomingMessage& message);
+
+    // Registers `senderState` as waiting on a backlogged recipient. Returns
+    // true if the sender should stop reading until it is resumed.
+    bool blockOnBackloggedRecipient(const std::string& recipient, ClientState& senderState);
+    // Online users whose send queue is above the high watermark.
+    std::vector<std::string> listBackloggedUsers();
 
 private:
+    static constexpr std::size_t kRegistryShards = 32;
+
+    struct OnlineUser {
+        std::string username;
+        std::shared_ptr<ClientHandle> client;
+    };
+
+    struct alignas(64) RegistryShard {
+        pthread_rwlock_t lock;
+        std::unordered_map<int, OnlineUser> clients;
+    };
+
+    RegistryShard& shardFor(int userId);
+    std::shared_ptr<ClientHandle> findClient(int userId);
+    void deliverStored(const std::string& sender,
+                       const std::string& recipient,
+                       int recipientId,
+                       const std::string& plaintext,
+                       int messageId);
+    void fanOutGroupMessage(int senderId,
+                            const std::string& sender,
+                            const std::string& group,
+                            int groupId,
+                            const std::string& plaintext,
+                            int messageId,
+                            const std::vector<int>& members);
+
     Database& database;
+    DatabaseWriter& databaseWriter;
     CryptoEngine& cryptoEngine;
-    pthread_mutex_t clientsMutex;
-    std::map<std::string, ClientState*> activeClients;
+    ServerConfig::SlowConsumerPolicy slowConsumerPolicy;
+    UserDirectory& users;
+    ProtocolHandler protocolHandler;
+    PresenceLog presenceLog;
+    std::array<RegistryShard, kRegistryShards> registry;
 };
@@ -0,0 +1,71 @@
+// MpscQueue.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Unbounded lock-free multi-producer/single-consumer queue. Producers push
+// onto an intrusive stack with a single CAS; the consumer detaches the whole
+// stack with one exchange and reverses it, so items from any one producer
+// come out in the order that producer pushed them.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() = default;
+    ~MpscQueue() { clear(); }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Safe from any thread. Returns true if the queue was empty, i.e. the
+    // caller is the one that has to wake the consumer.
+    bool push(T value)
+    {
+        Node* node = new Node{std::move(value), nullptr};
+        Node* expected = head.load(std::memory_order_relaxed);
+        do {
+            node->next = expected;
+        } while (!head.compare_exchange_weak(expected, node,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+        // The consumer may own `node` already, so only look at our copy.
+        return expected == nullptr;
+    }
+
+    // Consumer thread only. Hands every queued item to `fn` in push order
+    // and returns how many there were.
+    template <typename Fn>
+    std::size_t drain(Fn&& fn)
+    {
+        Node* node = head.exchange(nullptr, std::memory_order_acquire);
+        Node* ordered = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+
+        std::size_t count = 0;
+        while (ordered) {
+            Node* next = ordered->next;
+            fn(ordered->value);
+            delete ordered;
+            ordered = next;
+            ++count;
+        }
+        return count;
+    }
+
+    void clear() { drain([](T&) {}); }
+    bool empty() const { return head.load(std::memory_order_acquire) == nullptr; }
+
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> head {nullptr};
+};
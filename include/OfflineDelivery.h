@@ -1,14 +1,54 @@
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 
 class Database;
+class DatabaseWriter;
 class CryptoEngine;
 class ClientState;
+class UserDirectory;
+
+// A user's queued messages, decrypted and ready to send.
+struct OfflineBatch {
+    struct Message {
+        int id;
+        std::string sender;
+        std::string plaintext;
+        std::string timestamp;
+        std::string group; // set for group messages, whose ids are group_messages ids
+    };
+    std::vector<Message> messages;
+    int lastId {0}; // highest id read, including ones that failed to decrypt
+    std::map<int, int> groupCursors; // group id -> highest group message id read
+};
+
+// Reads and decrypts the messages queued for `username` with an id above
+// afterId, then those past the user's cursor in each of their groups (past
+// `after`'s cursors, if given), naming senders through `users`. Touches no
+// client, so it may run on any thread (login prefetches on the auth pool);
+// nothing is marked delivered yet.
+bool fetchOfflineMessages(Database& database,
+                          CryptoEngine& crypto,
+                          UserDirectory& users,
+                          const std::string& username,
+                          OfflineBatch& out,
+                          int afterId = 0,
+                          const OfflineBatch* after = nullptr);
+
+// Queues a fetched batch on `state` (owner thread) and submits one writer job
+// that marks it delivered and moves the group cursors.
+void queueOfflineMessages(DatabaseWriter& writer,
+                          const std::string& username,
+                          const OfflineBatch& batch,
+                          ClientState& state);
 
 // Helper invoked by worker threads to flush any queued offline messages for
-// a specific user once authentication succeeds.
+// a specific user once authentication succeeds. False if the user is unknown.
 bool deliverOfflineMessages(Database& database,
+                             DatabaseWriter& writer,
                              CryptoEngine& crypto,
+                             UserDirectory& users,
                              const std::string& username,
                              ClientState& state);
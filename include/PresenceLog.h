@@ -0,0 +1,46 @@
+// PresenceLog.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+// Versioned record of users going online and offline. The router appends an
+// entry whenever a user registers or unregisters; each worker reads what is
+// new once per tick and pushes a single delta to the subscribers it owns.
+// Entries carry the user's state, not a toggle, so a delta may be applied on
+// top of a snapshot that already reflects part of it.
+//
+// Only the last `capacity` changes are kept; a reader that falls further
+// behind than that starts over from a snapshot.
+class PresenceLog {
+public:
+    struct Change {
+        std::string username;
+        bool online;
+    };
+
+    explicit PresenceLog(std::size_t capacity = 4096);
+    ~PresenceLog();
+
+    PresenceLog(const PresenceLog&) = delete;
+    PresenceLog& operator=(const PresenceLog&) = delete;
+
+    void record(const std::string& username, bool online);
+    uint64_t version() const { return current.load(std::memory_order_acquire); }
+
+    // The changes after version `since`, one per user (the latest), oldest
+    // first; `upTo` is the version they bring the reader to. False if some
+    // of them have been dropped already.
+    bool changesSince(uint64_t since, uint64_t& upTo, std::vector<Change>& out) const;
+
+private:
+    const std::size_t capacity;
+    mutable pthread_mutex_t mutex;
+    std::deque<Change> entries; // versions current - size() + 1 .. current, guarded by mutex
+    std::atomic<uint64_t> current {0};
+};
@@ -2,6 +2,7 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
 #include <nlohmann/json.hpp>
 
 struct Command {
@@ -12,7 +13,17 @@ struct Command {
         Logout,
         ListUsers,
         ListOnline,
+        ListBacklogged,
         GetHistory,
+        Ping,
+        Pong,
+        ShmAttach,
+        Resume,
+        CreateGroup,
+        JoinGroup,
+        LeaveGroup,
+        SendGroup,
+        SubscribePresence,
         Unknown
     };
 
@@ -24,6 +35,10 @@ struct Command {
     std::string targetUser;
     int limit {50};
     int offset {0};
+    std::optional<bool> ackOnCommit; // send_message "ack": "commit" | "enqueue"
+    bool wantResumeToken {false};    // login "resume": true
+    std::string token;               // resume
+    std::string group;               // group commands
 };
 
 struct Response {
@@ -36,11 +51,12 @@ struct Response {
     std::optional<std::string> recipient;
     std::optional<std::string> content;
     std::optional<std::string> timestamp;
+    std::optional<std::string> group;
 };
 
 // Responsible for translating protocol client and server side commands.
 class ProtocolHandler {
 public:
-    Command parseCommand(const std::string& json) const;
+    Command parseCommand(std::string_view json) const;
     std::string serializeResponse(const Response& response) const;
 };
@@ -0,0 +1,42 @@
+// RecvBuffer.h
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+// Per-connection receive buffer. Bytes are read straight into the free tail
+// and consumed from the head by moving an offset, so pulling N pipelined
+// frames out of one read is linear. Unread bytes are only moved (to the
+// front) when the tail is too short for the next read, which keeps every
+// buffered frame contiguous and lets the parser work on views into it.
+class RecvBuffer {
+public:
+    static constexpr std::size_t kDefaultCapacity = 4096;
+
+    RecvBuffer() = default;
+
+    RecvBuffer(const RecvBuffer&) = delete;
+    RecvBuffer& operator=(const RecvBuffer&) = delete;
+
+    // Guarantees at least `minBytes` of free space after the unread data and
+    // returns where the next read should land. Invalidates earlier views.
+    char* prepare(std::size_t minBytes);
+    std::size_t writable() const { return capacity - writePos; }
+    // Marks `bytes` written at prepare() as readable.
+    void commit(std::size_t bytes) { writePos += bytes; }
+    void append(const char* data, std::size_t bytes);
+
+    // Unread bytes; the view is valid until the next prepare()/append().
+    std::string_view readable() const { return {storage.get() + readPos, writePos - readPos}; }
+    std::size_t size() const { return writePos - readPos; }
+    bool empty() const { return readPos == writePos; }
+    void consume(std::size_t bytes);
+    void clear();
+
+private:
+    std::unique_ptr<char[]> storage;
+    std::size_t capacity {0};
+    std::size_t readPos {0};
+    std::size_t writePos {0};
+};
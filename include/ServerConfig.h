@@ -0,0 +1,81 @@
+// ServerConfig.h
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Runtime options collected by main() and handed to HuxleyServer.
+struct ServerConfig {
+    enum class AcceptMode {
+        SharedQueue, // single accept thread; each connection goes to the lower loadScore() of two random workers
+        ReusePort    // every worker owns an SO_REUSEPORT listener in its epoll set
+    };
+
+    enum class IoBackend {
+        Epoll,  // epoll_wait + recv/send per event
+        IoUring // multishot recv into provided buffers, linked sends; falls back to epoll
+    };
+
+    // What happens to a client whose send queue reaches the high watermark.
+    // It counts as backlogged until the queue drains to the low watermark.
+    enum class SlowConsumerPolicy {
+        PauseSenders, // stop reading from peers that message it until it drains
+        SpillOffline, // leave new messages in the offline store, deliver them once drained
+        Disconnect    // drop the connection; unread messages stay in the offline store
+    };
+
+    // When a send_message is answered (a command may override it with "ack").
+    enum class WriteAck {
+        Enqueued, // as soon as the DB writer has the message
+        Committed // once its batch has committed
+    };
+
+    AcceptMode acceptMode {AcceptMode::SharedQueue};
+    bool dualStack {false};      // TCP listeners bind [::] and take IPv4 too (falls back to IPv4 only)
+    std::string unixSocketPath;  // extra AF_UNIX stream listener for local clients, served by the accept thread
+    // Admission control, applied right after accept (see AdmissionControl.h).
+    std::size_t maxConnections {0};          // 0 = the fd limit minus a reserve
+    std::size_t maxConnectionsPerSource {0}; // per client IP address, 0 = unlimited
+    unsigned acceptRate {0};                 // new connections per second overall, 0 = unlimited
+    unsigned acceptRatePerSource {0};        // new connections per second per IP, 0 = unlimited
+    std::size_t shmRingBytes {0}; // per-direction ring for SHM_ATTACH over the Unix socket; 0 = refuse
+    IoBackend ioBackend {IoBackend::Epoll};
+    SlowConsumerPolicy slowConsumerPolicy {SlowConsumerPolicy::SpillOffline};
+    std::size_t sendHighWatermark {1024 * 1024}; // queued outbound bytes per client
+    std::size_t sendLowWatermark {256 * 1024};
+    unsigned idleTimeoutSeconds {30 * 60}; // no commands for this long: `timeout`, then close (0 = never)
+    unsigned heartbeatSeconds {60};        // ping a silent peer this often (0 = never)
+    // Message writes go through one DB writer thread (see DatabaseWriter.h),
+    // committed in batches of up to dbBatchOps jobs or dbBatchMicros of waiting.
+    std::size_t dbBatchOps {64};
+    unsigned dbBatchMicros {2000};
+    WriteAck sendMessageAck {WriteAck::Enqueued};
+    // Argon2 for register/login runs on this many threads (0 = on the workers);
+    // requests beyond authQueueLimit waiting are answered "Server busy".
+    std::size_t authThreads {2};
+    std::size_t authQueueLimit {64};
+    // Argon2id cost, calibrated once to take about hashTargetMillis with up to
+    // hashMemoryBytes and kept in the database. Hashes in flight together may
+    // use at most authMemoryBudget (0 = unlimited); older hashes are upgraded
+    // on the next successful login.
+    unsigned hashTargetMillis {50};
+    std::size_t hashMemoryBytes {64 * 1024 * 1024};
+    std::size_t authMemoryBudget {256 * 1024 * 1024};
+    bool recalibrateHash {false};
+    unsigned resumeTokenSeconds {24 * 60 * 60}; // lifetime of LOGIN's resume token; 0 = no RESUME
+
+    // Hot restart (see Handoff.h): a successor connecting to upgradeSocketPath
+    // receives the listening sockets and, with migrateClients, the live
+    // connections; this process then drains and exits.
+    std::string upgradeSocketPath;
+    bool takeover {false};        // start by taking over the server on upgradeSocketPath
+    bool migrateClients {true};
+
+    // Worker pool and CPU profile for a dedicated box.
+    std::size_t workerCount {0};  // 0 = one per listed CPU, else one per online core
+    std::vector<int> workerCpus;  // worker i runs only on workerCpus[i % size]; empty = unpinned.
+                                  // Accept and housekeeping threads move to the CPUs not listed.
+    int realtimePriority {0};     // SCHED_FIFO priority (1-99) for workers; 0 = normal scheduling
+    bool lockMemory {false};      // mlockall, bounded and prefaulted worker stacks
+};
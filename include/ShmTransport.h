@@ -0,0 +1,72 @@
+// ShmTransport.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+
+// Shared-memory byte stream between the server and a client on the same
+// host: a memfd holding two SPSC rings (client->server, server->client)
+// that carry exactly the bytes the socket would, length-prefixed frames
+// included. Each side sleeps on its own eventfd; the other side writes it
+// only when a ring goes from empty to non-empty, or when the reader frees
+// space that a blocked writer is waiting for.
+//
+// Positions are free-running 64-bit counters. Each side keeps its own
+// position privately and only publishes it, so a misbehaving peer can at
+// worst corrupt the data it receives; out-of-range peer positions mark the
+// transport broken().
+class ShmTransport {
+public:
+    // Server side: creates the sealed segment and both eventfds. Ring size is
+    // rounded up to a power of two (at least one page).
+    static std::unique_ptr<ShmTransport> create(std::size_t ringBytes);
+    // Client side: maps a segment offered by the server, taking ownership of
+    // the three descriptors in the order offer() sent them.
+    static std::unique_ptr<ShmTransport> attach(int memFd, int waitFd, int kickFd);
+    ~ShmTransport();
+
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+
+    // Server side: sends `frame` over the Unix socket with the segment and
+    // the client's two eventfds attached (SCM_RIGHTS). All or nothing.
+    bool offer(int socketFd, const std::string& frame) const;
+
+    // Readable when the peer has written or made room; clear before draining.
+    int waitFd() const { return waitEventFd; }
+    void clearWakeup();
+    std::size_t ringBytes() const { return capacity; }
+    bool broken() const { return corrupt; }
+
+    // Copies as much of the buffers as fits; returns the bytes taken. A short
+    // count means the ring is full: the peer wakes us once it has drained.
+    std::size_t send(const iovec* iov, std::size_t count);
+    // Bytes waiting in the incoming ring, and copying them out.
+    std::size_t readable();
+    std::size_t receive(char* out, std::size_t maxBytes);
+
+private:
+    struct RingControl;
+    struct Segment;
+
+    ShmTransport() = default;
+    bool map(int fd, std::size_t length);
+    void kick();
+
+    int memFd {-1};
+    int waitEventFd {-1};
+    int kickEventFd {-1};
+    void* base {nullptr};
+    std::size_t mappedBytes {0};
+    std::size_t capacity {0};
+    RingControl* incoming {nullptr};
+    RingControl* outgoing {nullptr};
+    char* incomingData {nullptr};
+    char* outgoingData {nullptr};
+    uint64_t readPos {0};  // ours; published to incoming->head
+    uint64_t writePos {0}; // ours; published to outgoing->tail
+    bool corrupt {false};
+};
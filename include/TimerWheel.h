@@ -0,0 +1,77 @@
+// TimerWheel.h
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel holding at most one timer per client fd.
+// Scheduling, rescheduling and cancelling are O(1); advancing by one tick
+// fires the current level-0 slot and, every 256 ticks, cascades one slot
+// of the coarser levels down. Deadlines further out than the wheel spans
+// (about 12 days of 1 s ticks) are clamped to its horizon.
+// Not thread-safe: owned by a single worker loop.
+class TimerWheel {
+public:
+    explicit TimerWheel(uint64_t startTick = 0);
+
+    uint64_t now() const { return currentTick; }
+
+    // Arms (or re-arms) the timer for `fd`. Deadlines that are not in the
+    // future fire on the next tick.
+    void schedule(int fd, uint32_t generation, uint64_t dueTick);
+    void cancel(int fd);
+    bool armed(int fd) const;
+
+    // Moves the wheel forward to `tick`, calling onExpire(fd, generation)
+    // for every timer that comes due. Callbacks may schedule or cancel.
+    template <typename Fn>
+    void advance(uint64_t tick, Fn&& onExpire);
+
+private:
+    static constexpr unsigned kLevel0Bits = 8;
+    static constexpr unsigned kLevelNBits = 6;
+    static constexpr unsigned kLevels = 3;
+    static constexpr uint64_t kHorizon = (1ull << (kLevel0Bits + 2 * kLevelNBits)) - 1;
+
+    struct Node {
+        uint64_t due {0};
+        uint32_t generation {0};
+        int prev {-1};
+        int next {-1};
+        int16_t level {-1}; // -1 while not linked
+        uint16_t slot {0};
+    };
+
+    void link(int fd);
+    void unlink(int fd);
+    void cascade(unsigned level, unsigned slot);
+
+    uint64_t currentTick;
+    std::vector<Node> nodes; // indexed by fd
+    std::array<std::vector<int>, kLevels> slots; // list heads, -1 when empty
+};
+
+template <typename Fn>
+void TimerWheel::advance(uint64_t tick, Fn&& onExpire)
+{
+    while (currentTick < tick) {
+        ++currentTick;
+        const auto slot0 = static_cast<unsigned>(currentTick & ((1u << kLevel0Bits) - 1));
+        if (slot0 == 0) {
+            const uint64_t upper = currentTick >> kLevel0Bits;
+            const auto slot1 = static_cast<unsigned>(upper & ((1u << kLevelNBits) - 1));
+            if (slot1 == 0) {
+                cascade(2, static_cast<unsigned>((upper >> kLevelNBits) & ((1u << kLevelNBits) - 1)));
+            }
+            cascade(1, slot1);
+        }
+
+        // Unlink one at a time: a callback may re-arm the timer it handles.
+        while (slots[0][slot0] != -1) {
+            const int fd = slots[0][slot0];
+            unlink(fd);
+            onExpire(fd, nodes[static_cast<std::size_t>(fd)].generation);
+        }
+    }
+}
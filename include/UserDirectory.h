@@ -0,0 +1,59 @@
+// UserDirectory.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+
+class Database;
+
+// Process-wide table of users: name -> id, id -> name (a vector indexed by
+// id, which SQLite hands out densely), and a Bloom filter over the names.
+// load() reads the users table once at startup and AuthManager adds every
+// user it registers, so from then on a name the filter rejects is unknown
+// without even taking the lock; a name that passes the filter but misses
+// the map is looked up in SQLite. Users are never renamed or deleted, so
+// entries never go stale.
+//
+// Until an authoritative load() has run (tools, tests, or a successor whose
+// predecessor may still be registering users) the filter rejects nothing:
+// every miss is looked up in the database.
+class UserDirectory {
+public:
+    explicit UserDirectory(Database& db);
+    ~UserDirectory();
+
+    UserDirectory(const UserDirectory&) = delete;
+    UserDirectory& operator=(const UserDirectory&) = delete;
+
+    // Returns the user count. The first call must precede other threads'
+    // use; later calls only add users. Pass authoritative = false while
+    // another process may still add users.
+    std::size_t load(bool authoritative = true);
+
+    // Safe from any thread.
+    bool resolve(const std::string& username, int& outId);
+    bool nameOf(int userId, std::string& outUsername);
+    void remember(int userId, const std::string& username);
+
+private:
+    static constexpr std::size_t kFilterBits = std::size_t{1} << 20; // 128 KiB
+    static constexpr unsigned kFilterHashes = 4;
+    // Past this, ids are not worth a slot in the dense table.
+    static constexpr int kMaxDenseId = 1 << 24;
+
+    bool mayContain(const std::string& username) const;
+    void addToFilter(const std::string& username);
+
+    Database& database;
+    std::atomic<bool> complete {false};
+    std::unique_ptr<std::atomic<uint64_t>[]> filter;
+    pthread_rwlock_t lock;
+    std::unordered_map<std::string, int> ids;
+    std::vector<std::string> names; // empty where the id is unknown
+};
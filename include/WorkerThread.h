@@ -1,13 +1,24 @@
 #pragma once
 #include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <pthread.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <atomic>
 #include "ClientNotifier.h"
+#include "DatabaseWriter.h"
+#include "Handoff.h"
+#include "MpscQueue.h"
+#include "TimerWheel.h"
+#include "ServerConfig.h"
 
+class AdmissionControl;
 class AuthManager;
 class MessageRouter;
 class ProtocolHandler;
@@ -15,46 +26,180 @@ class StatusManager;
 class Database;
 class CryptoEngine;
 class ClientState;
+class IoUring;
 struct Command;
+struct OfflineBatch;
+struct Response;
+struct io_uring_cqe;
 
 // Event-driven worker responsible for servicing a shard of client sockets.
 class WorkerThread : public ClientNotifier {
 public:
     WorkerThread(int id,
+                 const ServerConfig& config,
                  AuthManager& auth,
                  MessageRouter& router,
                  ProtocolHandler& protocol,
                  StatusManager& status,
                  Database& database,
-                 CryptoEngine& crypto);
+                 CryptoEngine& crypto,
+                 AdmissionControl& admission);
     ~WorkerThread();
 
     void start();
     void stop();
     void assignClient(int clientFd);
-    void notifyEvent(int clientFd) override;
+    void adoptListener(int socketFd);
+    int listenerFd() const { return listenFd; }
+    // Hot restart. adoptSession queues a connection migrated from the previous
+    // process; detachForHandoff blocks until the loop has stopped accepting
+    // and (with includeClients) given up its connections, then returns them.
+    void adoptSession(SessionHandoff session);
+    std::vector<SessionHandoff> detachForHandoff(bool includeClients);
+    void postFrame(int clientFd, uint32_t generation, FrameBuffer frame) override;
+    void resumeReading(int clientFd, uint32_t generation) override;
+    void postMessage(int clientFd, uint32_t generation, IncomingMessage message) override;
+    // Runs `task` on the loop thread; safe from any thread. Dropped once the
+    // worker has stopped.
+    void postTask(std::function<void()> task);
 
     int id() const { return workerId; }
+    // CPU this worker is pinned to by config.workerCpus, or -1.
+    int assignedCpu() const;
     pthread_t nativeHandle() const { return threadHandle; }
 
+    // Live load figures, published by the loop for connection placement.
+    struct LoadStats {
+        std::size_t connections;
+        std::size_t queuedBytes;   // outbound bytes waiting in client send queues
+        unsigned busyPermille;     // share of recent wall time spent handling events
+        int cpu;                   // CPU the loop last ran on, -1 until the thread is up
+    };
+    LoadStats loadStats() const;
+    // Single comparable figure: one connection, 16 KiB of backlog and 1% busy
+    // time each weigh about the same.
+    std::size_t loadScore() const;
+
 private:
     static void* threadEntry(void* arg);
+    void applyCpuProfile();
     void eventLoop();
-    void handleReadEvent(int clientFd);
-    void handleWriteEvent(int clientFd);
+    void epollLoop();
+    void handleControlEvent(uint64_t tag);
+    void adoptPendingClients();
+    void acceptPendingClients();
+    bool addClient(int clientFd);
+    void restoreSession(SessionHandoff& session);
+    void performHandoff();
+    bool handleReadEvent(ClientState& state);
+    void serviceReadyReads();
+    bool handleShmRead(ClientState& state);
+    bool attachSharedMemory(ClientState& state, Response& response);
+    void handleWriteEvent(ClientState& state);
+    bool processFrames(ClientState& state);
     void processCommand(ClientState& state, const Command& command);
-    void closeClient(int clientFd);
+    bool submitAuth(ClientState& state, const Command& command);
+    void finishAuth(ClientState& state, const Command& command, bool ok, int userId, const OfflineBatch& prefetched);
+    bool establishSession(ClientState& state, int userId, const std::string& username, const OfflineBatch& prefetched);
+    void grantResumeToken(Response& response, int userId, const std::string& username, uint32_t presented);
+    void closeClient(ClientState& state);
+    void scheduleFlush(ClientState& state);
+    void drainOutbox();
+    void deliverMessage(ClientState& state, const IncomingMessage& message);
+    DatabaseWriter::Completion replyOnCommit(ClientState& state,
+                                             const std::string& command,
+                                             const std::string& group,
+                                             const std::string& okMessage,
+                                             const std::string& failMessage);
+    void logActivity(const char* level, std::string message);
+    void onFlushed(ClientState& state);
+    void updateBacklog(ClientState& state);
+    void releaseBlockedSenders(ClientState& state);
+    void pauseReading(ClientState& state);
+    void resumeClient(ClientState& state);
+    bool setupTimer();
+    void advanceTimers();
+    void scheduleIdleCheck(ClientState& state);
+    void handleIdleTimer(ClientState& state);
+    void fillPresenceSnapshot(Response& response);
+    void pushPresence();
+    void expireSession(ClientState& state);
     ClientState* getClient(int clientFd);
-    void removeClient(int clientFd);
+    ClientState* liveClient(ClientState* candidate);
+    std::unique_ptr<ClientState> removeClient(ClientState& state);
+    void markIdle();
+    void markBusy();
+
+    // io_uring backend (see WorkerThread.cpp for the completion protocol)
+    bool setupUring();
+    void uringLoop();
+    void armEpollPoll();
+    void drainControlEvents();
+    void armUringRecv(ClientState& state);
+    void submitUringSends(ClientState& state);
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleRetiredCompletion(int fd, uint32_t generation, const io_uring_cqe& cqe);
+    void flushPendingWrites();
+    void retireUringClient(std::unique_ptr<ClientState> state);
+    void drainUringOnExit();
 
     int workerId;
+    const ServerConfig& config;
     int epollFd;
     int wakeupFd;
+    int listenFd;
+    int timerFd;
     std::atomic<bool> running;
+    std::atomic<bool> uringActive;
     pthread_t threadHandle;
 
+    // Dense fd-indexed client table, owned by the loop thread. The slot
+    // generation is bumped on every reuse of the fd so stale epoll/io_uring
+    // references to an earlier connection can be recognised.
+    struct ClientSlot {
+        std::unique_ptr<ClientState> state;
+        uint32_t generation {0};
+    };
+    std::vector<ClientSlot> clientSlots;
+    // Closed during the current epoll batch; freed once the batch is done.
+    std::vector<std::unique_ptr<ClientState>> closedClients;
+
     pthread_mutex_t clientsMutex;
-    std::unordered_map<int, std::unique_ptr<ClientState>> clientStates;
+    std::vector<int> pendingClients; // handed over by assignClient, guarded by clientsMutex
+    std::vector<int> pendingWrites;  // fds with new output to flush, loop thread only
+    std::vector<int> pendingReads;   // fds cut off by the read cap with the edge still owed, loop thread only
+    std::vector<SessionHandoff> pendingSessions; // guarded by clientsMutex
+
+    // detachForHandoff() request/reply, guarded by clientsMutex
+    pthread_cond_t handoffCond;
+    bool handoffPending {false};
+    bool handoffIncludeClients {false};
+    std::vector<SessionHandoff> handoffSessions;
+
+    // Frames posted by other threads; the loop moves them into client send
+    // queues. Only the push that finds it empty kicks the eventfd.
+    struct OutboundFrame {
+        int fd;
+        uint32_t generation;
+        FrameBuffer frame;
+    };
+    MpscQueue<OutboundFrame> outbox;
+    // Connections to resume once the backlogged peer they waited on drains.
+    struct ClientRef {
+        int fd;
+        uint32_t generation;
+    };
+    MpscQueue<ClientRef> resumeRequests;
+    // Routed chat messages, framed here so only this thread touches the
+    // recipient's state.
+    struct MailboxItem {
+        int fd;
+        uint32_t generation;
+        IncomingMessage message;
+    };
+    MpscQueue<MailboxItem> mailbox;
+    // Work handed back by other threads, e.g. DB writer completions.
+    MpscQueue<std::function<void()>> tasks;
 
     AuthManager& authManager;
     MessageRouter& messageRouter;
@@ -62,6 +207,40 @@ private:
     StatusManager& statusManager;
     Database& database;
     CryptoEngine& cryptoEngine;
+    AdmissionControl& admissionControl;
 
     std::vector<epoll_event> eventBuffer;
+
+    // Connections that sent SUBSCRIBE_PRESENCE, all brought to presenceVersion
+    // by the last tick. A stale one missed a delta while backlogged and gets
+    // a fresh snapshot once it drains.
+    struct PresenceSubscriber {
+        int fd;
+        uint32_t generation;
+        bool stale;
+    };
+    std::vector<PresenceSubscriber> presenceSubscribers;
+    uint64_t presenceVersion {0};
+
+    // Idle-session and heartbeat deadlines, one per client, ticked once a
+    // second by timerFd (monotonic seconds).
+    TimerWheel idleTimers;
+
+    std::atomic<std::size_t> connectionCount {0};
+    std::atomic<int64_t> outboundBytes {0};
+    std::atomic<unsigned> busyPermille {0};
+    std::atomic<int> lastCpu {-1};
+    std::atomic<int64_t> idleSinceNs {0}; // non-zero while blocked waiting for events
+    int64_t busyWindowStartNs {0};
+    int64_t busyWindowNs {0};
+    int64_t busyStartNs {0};
+
+    std::unique_ptr<IoUring> ring;
+    bool epollPollArmed;
+    bool controlBacklog;
+    // Closed sockets whose io_uring operations have not all completed yet;
+    // the fd stays open (and therefore unique) until the last CQE arrives.
+    std::unordered_map<int, std::unique_ptr<ClientState>> retiringClients;
+    std::vector<std::string_view> sendViews;
+    std::vector<iovec> sendIovecs;
 };
@@ -13,6 +13,7 @@
 #include "ClientState.h"
 #include "MessageRouter.h"
 #include "ProtocolHandler.h"
+#include "UserDirectory.h"
 
 /**
  * @file mini_client.cpp
@@ -180,10 +181,13 @@ int main(int argc, char* argv[]) {
     CryptoEngine cryptoEngine;
     std::cout << "[INIT] CryptoEngine initialized\n";
 
-    AuthManager authManager(database);
+    UserDirectory userDirectory(database);
+    userDirectory.load();
+    AuthManager authManager(database, &userDirectory);
     std::cout << "[INIT] AuthManager initialized\n";
 
-    MessageRouter messageRouter(database, cryptoEngine);
+    DatabaseWriter databaseWriter(database); // never started: writes commit inline
+    MessageRouter messageRouter(database, databaseWriter, userDirectory, cryptoEngine);
     std::cout << "[INIT] MessageRouter initialized\n";
 
     // ========================= AuthManager Test Suite =========================
@@ -249,13 +253,15 @@ int main(int argc, char* argv[]) {
 
     // Test 1: Route message between authenticated users
     const std::string msg1 = "Integration test message from user1 to user2";
-    bool routed1 = messageRouter.routeMessage(user1, user2, msg1);
+    int senderId = 0;
+    messageRouter.directory().resolve(user1, senderId);
+    bool routed1 = messageRouter.routeMessage(senderId, user1, user2, msg1);
     runner.test("Route message to online user", routed1, "Message routing should succeed");
 
     // Test 2: Route to non-existent user
     const std::string fakeUser = "nonexistent_user_xyz";
     const std::string msg2 = "This should fail - user does not exist";
-    bool routedFake = messageRouter.routeMessage(user1, fakeUser, msg2);
+    bool routedFake = messageRouter.routeMessage(senderId, user1, fakeUser, msg2);
     runner.test("Reject message to unknown user", !routedFake, "Routing to nonexistent user must fail");
 
     // Test 3: Verify message persistence
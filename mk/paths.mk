@@ -9,6 +9,7 @@ TARGET_PI := huxley_pi
 PI_USER ?= root
 PI_HOST ?= raspberrypi
 PI_PATH ?= /etc
+UPGRADE_SOCKET ?= /tmp/huxley.upgrade
 
 CLI_ENTRY := client/client.py
 CLI_HOST ?= localhost
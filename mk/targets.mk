@@ -12,7 +12,7 @@ $(TARGET_HOST): $(OBJ_HOST)
 $(TARGET_PI): $(OBJ_PI)
 	$(PI_CXX) -o $@ $^ $(PI_LDFLAGS)
 
-.PHONY: host pi deploy run clean stop
+.PHONY: host pi deploy run upgrade clean stop
 host: $(TARGET_HOST)
 pi: $(TARGET_PI)
 
@@ -21,7 +21,13 @@ deploy: stop $(TARGET_PI)
 	ssh $(PI_USER)@$(PI_HOST) "mv /tmp/$(TARGET_PI).new $(PI_PATH)/$(TARGET_PI) && chmod +x $(PI_PATH)/$(TARGET_PI)"
 
 run: deploy
-	ssh $(PI_USER)@$(PI_HOST) "$(PI_PATH)/$(TARGET_PI) --no-block"
+	ssh $(PI_USER)@$(PI_HOST) "$(PI_PATH)/$(TARGET_PI) --no-block --upgrade-socket $(UPGRADE_SOCKET)"
+
+# Hot restart: the new binary takes the listeners and connections over from
+# the running one, which exits once the handoff is done.
+upgrade: $(TARGET_PI)
+	scp $(TARGET_PI) $(PI_USER)@$(PI_HOST):/tmp/$(TARGET_PI).new
+	ssh $(PI_USER)@$(PI_HOST) "mv /tmp/$(TARGET_PI).new $(PI_PATH)/$(TARGET_PI) && chmod +x $(PI_PATH)/$(TARGET_PI) && $(PI_PATH)/$(TARGET_PI) --no-block --upgrade-socket $(UPGRADE_SOCKET) --takeover"
 
 stop:
 	ssh $(PI_USER)@$(PI_HOST) 'pids=$$(pidof $(TARGET_PI) 2>/dev/null || true); if [ -n "$$pids" ]; then kill $$pids; fi'
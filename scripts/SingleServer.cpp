@@ -3,9 +3,11 @@
 #include "AuthManager.h"
 #include "CryptoEngine.h"
 #include "DatabaseEngine.h"
+#include "DatabaseWriter.h"
 #include "MessageRouter.h"
 #include "ProtocolHandler.h"
 #include "SingleWorker.h"
+#include "UserDirectory.h"
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -141,8 +143,11 @@ bool SingleServer::initializeServices(int port)
 
     cryptoEngine = std::make_unique<CryptoEngine>();
     protocolHandler = std::make_unique<ProtocolHandler>();
-    authManager = std::make_unique<AuthManager>(*database);
-    messageRouter = std::make_unique<MessageRouter>(*database, *cryptoEngine);
+    userDirectory = std::make_unique<UserDirectory>(*database);
+    userDirectory->load();
+    authManager = std::make_unique<AuthManager>(*database, userDirectory.get());
+    databaseWriter = std::make_unique<DatabaseWriter>(*database); // not started: writes commit inline
+    messageRouter = std::make_unique<MessageRouter>(*database, *databaseWriter, *userDirectory, *cryptoEngine);
 
     listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (listenFd == -1) {
@@ -178,7 +183,9 @@ void SingleServer::shutdownServices()
 {
     worker.reset();
     messageRouter.reset();
+    databaseWriter.reset();
     authManager.reset();
+    userDirectory.reset();
     cryptoEngine.reset();
     protocolHandler.reset();
 
@@ -11,6 +11,8 @@ class MessageRouter;
 class ProtocolHandler;
 class CryptoEngine;
 class Database;
+class DatabaseWriter;
+class UserDirectory;
 
 // Minimal single-worker server: one listener thread dispatching
 // all accepted sockets to a lone SingleWorker instance.
@@ -38,6 +40,8 @@ private:
     std::unique_ptr<ProtocolHandler> protocolHandler;
     std::unique_ptr<CryptoEngine> cryptoEngine;
     std::unique_ptr<Database> database;
+    std::unique_ptr<DatabaseWriter> databaseWriter;
+    std::unique_ptr<UserDirectory> userDirectory;
 
     std::string databasePath;
 };
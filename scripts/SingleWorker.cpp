@@ -14,6 +14,8 @@
 #include <cstring>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <fcntl.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
@@ -180,7 +182,7 @@ void SingleWorker::wakeWorker()
     ::write(wakeupFd, &value, sizeof(value));
 }
 
-void SingleWorker::notifyEvent(int clientFd)
+void SingleWorker::postFrame(int clientFd, uint32_t /*generation*/, FrameBuffer frame)
 {
     if (epollFd == -1) {
         return;
@@ -188,6 +190,7 @@ void SingleWorker::notifyEvent(int clientFd)
 
     const auto it = clientStates.find(clientFd);
     if (it != clientStates.end()) {
+        it->second->appendQueuedFrame(std::move(frame));
         epoll_event ev {};
         ev.events = eventMaskHasWrite(true);
         ev.data.fd = clientFd;
@@ -197,6 +200,23 @@ void SingleWorker::notifyEvent(int clientFd)
     wakeWorker();
 }
 
+void SingleWorker::postMessage(int clientFd, uint32_t /*generation*/, IncomingMessage message)
+{
+    if (epollFd == -1) {
+        return;
+    }
+
+    const auto it = clientStates.find(clientFd);
+    if (it != clientStates.end() && it->second->userId() == message.recipientId) {
+        if (message.frame) {
+            it->second->queueFrame(message.frame);
+        } else {
+            it->second->queueIncomingMessage(message.sender, message.content, message.timestamp, message.id);
+        }
+        messageRouter.confirmDelivered(message);
+    }
+}
+
 void SingleWorker::eventLoop()
 {
     while (running.load(std::memory_order_acquire)) {
@@ -240,7 +260,7 @@ void SingleWorker::eventLoop()
     for (auto& [fd, state] : clientStates) {
         if (state && state->isAuthenticated()) {
             const std::string username = state->username();
-            messageRouter.unregisterClient(username);
+            messageRouter.unregisterClient(state->userId());
             database.logActivity("INFO", "User disconnected: " + username);
         }
         if (epollFd != -1) {
@@ -291,7 +311,7 @@ void SingleWorker::drainPendingClients()
             continue;
         }
 
-        auto state = std::make_unique<ClientState>(this, fd, protocolHandler);
+        auto state = std::make_unique<ClientState>(this, fd, 0, protocolHandler);
         clientStates[fd] = std::move(state);
     }
 }
@@ -355,28 +375,26 @@ void SingleWorker::handleReadEvent(int clientFd)
         return;
     }
 
-    std::string& recvBuffer = state->mutableRecvBuffer();
-    while (true) {
-        if (recvBuffer.size() < kFrameHeaderSize) {
-            break;
-        }
-
+    RecvBuffer& recvBuffer = state->mutableRecvBuffer();
+    const std::string_view pending = recvBuffer.readable();
+    std::size_t offset = 0;
+    while (pending.size() - offset >= kFrameHeaderSize) {
         uint32_t netSize = 0;
-        std::memcpy(&netSize, recvBuffer.data(), kFrameHeaderSize);
+        std::memcpy(&netSize, pending.data() + offset, kFrameHeaderSize);
         const uint32_t payloadSize = ntohl(netSize);
         if (payloadSize > kMaxFrameSize) {
             closeClient(clientFd);
             return;
         }
-        if (recvBuffer.size() < kFrameHeaderSize + payloadSize) {
+        if (pending.size() - offset < kFrameHeaderSize + payloadSize) {
             break;
         }
 
-        std::string frame = recvBuffer.substr(kFrameHeaderSize, payloadSize);
-        recvBuffer.erase(0, kFrameHeaderSize + payloadSize);
-        const Command command = protocolHandler.parseCommand(frame);
+        const Command command = protocolHandler.parseCommand(pending.substr(offset + kFrameHeaderSize, payloadSize));
+        offset += kFrameHeaderSize + payloadSize;
         processCommand(*state, command);
     }
+    recvBuffer.consume(offset);
 }
 
 void SingleWorker::handleWriteEvent(int clientFd)
@@ -387,25 +405,23 @@ void SingleWorker::handleWriteEvent(int clientFd)
         return;
     }
 
-    std::string message;
-    while (state->popQueuedResponse(message)) {
-        std::size_t totalSent = 0;
-        while (totalSent < message.size()) {
-            const ssize_t sent = sendNonBlocking(clientFd, message.data() + totalSent, message.size() - totalSent);
-            if (sent > 0) {
-                totalSent += static_cast<std::size_t>(sent);
-                continue;
-            }
-            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                const std::string remainder = message.substr(totalSent);
-                if (!remainder.empty()) {
-                    state->pushFrontResponse(remainder);
-                }
-                return;
-            }
-            closeClient(clientFd);
+    // One frame at a time; a partial send stays at the head of the queue.
+    std::vector<std::string_view> head;
+    for (;;) {
+        head.clear();
+        if (state->peekQueuedResponses(head, 1) == 0) {
+            break;
+        }
+        const ssize_t sent = sendNonBlocking(clientFd, head.front().data(), head.front().size());
+        if (sent > 0) {
+            state->consumeQueuedBytes(static_cast<std::size_t>(sent));
+            continue;
+        }
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
             return;
         }
+        closeClient(clientFd);
+        return;
     }
 
     epoll_event ev {};
@@ -428,12 +444,15 @@ void SingleWorker::processCommand(ClientState& state, const Command& command)
     }
     case Command::Type::Login: {
         response.command = "login";
-        if (authManager.loginUser(command.username, command.password)) {
+        int userId = 0;
+        if (authManager.loginUser(command.username, command.password)
+            && messageRouter.directory().resolve(command.username, userId)) {
             state.setAuthenticated(true);
             state.setUsername(command.username);
-            messageRouter.registerClient(command.username, &state);
+            state.setUserId(userId);
+            messageRouter.registerClient(userId, command.username, state.handle());
             // Flush queued messages via OfflineDelivery helper once auth succeeds
-            deliverOfflineMessages(database, cryptoEngine, command.username, state);
+            deliverOfflineMessages(database, messageRouter.writer(), cryptoEngine, messageRouter.directory(), command.username, state);
             response.success = true;
             response.message = "Login successful";
         } else {
@@ -455,7 +474,7 @@ void SingleWorker::processCommand(ClientState& state, const Command& command)
             response.message = "Missing recipient";
             break;
         }
-        if (!messageRouter.routeMessage(sender, command.recipient, command.content)) {
+        if (!messageRouter.routeMessage(state.userId(), sender, command.recipient, command.content)) {
             response.success = false;
             response.message = "Delivery failed";
             break;
@@ -468,7 +487,7 @@ void SingleWorker::processCommand(ClientState& state, const Command& command)
         response.command = "logout";
         if (state.isAuthenticated()) {
             const std::string username = state.username();
-            messageRouter.unregisterClient(username);
+            messageRouter.unregisterClient(state.userId());
             database.logActivity("INFO", "User logout: " + username);
             state.setAuthenticated(false);
             state.setUsername({});
@@ -497,7 +516,7 @@ void SingleWorker::closeClient(int clientFd)
     if (state) {
         if (state->isAuthenticated()) {
             const std::string username = state->username();
-            messageRouter.unregisterClient(username);
+            messageRouter.unregisterClient(state->userId());
             database.logActivity("INFO", "User disconnected: " + username);
         }
     }
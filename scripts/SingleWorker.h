@@ -35,7 +35,9 @@ public:
         void start(); 
         void stop(); 
         void assignClient(int clientFd); 
-        void notifyEvent(int clientFd) override; 
+        void postFrame(int clientFd, uint32_t generation, FrameBuffer frame) override; 
+        void resumeReading(int /*clientFd*/, uint32_t /*generation*/) override {}
+        void postMessage(int clientFd, uint32_t generation, IncomingMessage message) override;
         void waitUntilReady();
         bool isReady() const noexcept { return ready.load(std::memory_order_acquire); }
         bool hasInitFailed() const noexcept { return initFailed.load(std::memory_order_acquire); }
@@ -0,0 +1,251 @@
+#include "AdmissionControl.h"
+
+#include "ProtocolHandler.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr std::size_t kReservedFds = 64;    // listeners, eventfds, SQLite, logs
+constexpr double kBurstSeconds = 2.0;       // a bucket holds this many seconds of its rate
+constexpr std::size_t kSweepThreshold = 1024; // idle source entries tolerated before a sweep
+
+int64_t monotonicNs()
+{
+    timespec ts {};
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// Without an explicit cap, stop short of the fd limit so the process can
+// still open what it needs while a connection storm is being shed.
+std::size_t defaultMaxConnections()
+{
+    rlimit limit {};
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur == RLIM_INFINITY) {
+        return 0;
+    }
+    const auto fds = static_cast<std::size_t>(limit.rlim_cur);
+    return fds > 2 * kReservedFds ? fds - kReservedFds : fds / 2;
+}
+
+double burstOf(unsigned rate)
+{
+    return std::max(1.0, rate * kBurstSeconds);
+}
+
+// IPv4 is stored v4-mapped, so a dual-stack listener and a plain IPv4 one
+// agree on the key. Returns false for peers without an IP address.
+bool toSourceKey(const sockaddr_storage& peer, std::array<uint8_t, 16>& key)
+{
+    key.fill(0);
+    if (peer.ss_family == AF_INET6) {
+        std::memcpy(key.data(), &reinterpret_cast<const sockaddr_in6&>(peer).sin6_addr, key.size());
+        return true;
+    }
+    if (peer.ss_family == AF_INET) {
+        key[10] = key[11] = 0xff;
+        std::memcpy(key.data() + 12, &reinterpret_cast<const sockaddr_in&>(peer).sin_addr, 4);
+        return true;
+    }
+    return false;
+}
+
+void refill(double& tokens, int64_t& refilledNs, unsigned rate, int64_t now)
+{
+    if (refilledNs == 0) {
+        tokens = burstOf(rate);
+    } else {
+        tokens = std::min(burstOf(rate), tokens + static_cast<double>(now - refilledNs) * rate / 1e9);
+    }
+    refilledNs = now;
+}
+} // namespace
+
+std::size_t AdmissionControl::SourceKeyHash::operator()(const SourceKey& key) const
+{
+    uint64_t high = 0;
+    uint64_t low = 0;
+    std::memcpy(&high, key.data(), sizeof(high));
+    std::memcpy(&low, key.data() + sizeof(high), sizeof(low));
+    return static_cast<std::size_t>((high * 0x9E3779B97F4A7C15ull) ^ low);
+}
+
+AdmissionControl::AdmissionControl(const ServerConfig& config, const ProtocolHandler& protocol)
+    : maxConnections(config.maxConnections ? config.maxConnections : defaultMaxConnections())
+    , maxPerSource(config.maxConnectionsPerSource)
+    , acceptRate(config.acceptRate)
+    , acceptRatePerSource(config.acceptRatePerSource)
+{
+    pthread_mutex_init(&mutex, nullptr);
+
+    const auto frameFor = [&protocol](const char* message) {
+        Response response;
+        response.command = "busy";
+        response.success = false;
+        response.message = message;
+        const std::string payload = protocol.serializeResponse(response);
+        std::string frame(sizeof(uint32_t), '\0');
+        const uint32_t netSize = htonl(static_cast<uint32_t>(payload.size()));
+        std::memcpy(frame.data(), &netSize, sizeof(netSize));
+        return frame + payload;
+    };
+    busyFrames[static_cast<std::size_t>(Verdict::ServerFull)] = frameFor("Server busy, try again later");
+    busyFrames[static_cast<std::size_t>(Verdict::SourceFull)] = frameFor("Too many connections from your address");
+    busyFrames[static_cast<std::size_t>(Verdict::RateLimited)] = frameFor("Connecting too fast, slow down");
+}
+
+AdmissionControl::~AdmissionControl()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+AdmissionControl::Verdict AdmissionControl::admit(int fd, const sockaddr_storage& peer)
+{
+    // Sources are only tracked when a per-source limit needs them; AF_UNIX
+    // peers have no address and only count globally.
+    SourceKey key {};
+    const bool keyed = toSourceKey(peer, key) && (maxPerSource > 0 || acceptRatePerSource > 0);
+
+    const int64_t now = monotonicNs();
+    Verdict verdict = Verdict::Admitted;
+    pthread_mutex_lock(&mutex);
+    Source* source = nullptr;
+    if (keyed) {
+        if (sources.size() >= sweepAt) {
+            sweepIdleSourcesLocked(now);
+        }
+        source = &sources[key];
+    }
+
+    if (maxConnections > 0 && connections >= maxConnections) {
+        verdict = Verdict::ServerFull;
+    } else if (source && maxPerSource > 0 && source->connections >= maxPerSource) {
+        verdict = Verdict::SourceFull;
+    } else {
+        // Check both buckets before taking from either.
+        if (acceptRate > 0) {
+            refill(globalBucket.tokens, globalBucket.refilledNs, acceptRate, now);
+        }
+        if (source && acceptRatePerSource > 0) {
+            refill(source->bucket.tokens, source->bucket.refilledNs, acceptRatePerSource, now);
+        }
+        if ((acceptRate > 0 && globalBucket.tokens < 1.0)
+            || (source && acceptRatePerSource > 0 && source->bucket.tokens < 1.0)) {
+            verdict = Verdict::RateLimited;
+        } else {
+            if (acceptRate > 0) {
+                globalBucket.tokens -= 1.0;
+            }
+            if (source && acceptRatePerSource > 0) {
+                source->bucket.tokens -= 1.0;
+            }
+            countLocked(fd, source ? &key : nullptr);
+            if (source) {
+                ++source->connections;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (verdict == Verdict::Admitted) {
+        admitted.fetch_add(1, std::memory_order_relaxed);
+    }
+    return verdict;
+}
+
+void AdmissionControl::track(int fd)
+{
+    sockaddr_storage peer {};
+    socklen_t length = sizeof(peer);
+    ::getpeername(fd, reinterpret_cast<sockaddr*>(&peer), &length);
+
+    SourceKey key {};
+    const bool keyed = toSourceKey(peer, key) && (maxPerSource > 0 || acceptRatePerSource > 0);
+
+    pthread_mutex_lock(&mutex);
+    countLocked(fd, keyed ? &key : nullptr);
+    if (keyed) {
+        ++sources[key].connections;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void AdmissionControl::reject(int fd, Verdict verdict)
+{
+    const std::string& frame = busyFrames[static_cast<std::size_t>(verdict)];
+    // Best effort: a fresh socket's send buffer is empty, so this won't block.
+    ::send(fd, frame.data(), frame.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    ::close(fd);
+    shed[static_cast<std::size_t>(verdict)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void AdmissionControl::release(int fd)
+{
+    const auto index = static_cast<std::size_t>(fd);
+    pthread_mutex_lock(&mutex);
+    if (fd >= 0 && index < slots.size() && slots[index].counted) {
+        Slot& slot = slots[index];
+        slot.counted = false;
+        --connections;
+        if (slot.hasSource) {
+            const auto it = sources.find(slot.source);
+            if (it != sources.end() && --it->second.connections == 0 && acceptRatePerSource == 0) {
+                sources.erase(it); // no bucket worth remembering
+            }
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+AdmissionControl::Stats AdmissionControl::stats() const
+{
+    Stats result {};
+    result.admitted = admitted.load(std::memory_order_relaxed);
+    result.shedServerFull = shed[static_cast<std::size_t>(Verdict::ServerFull)].load(std::memory_order_relaxed);
+    result.shedSourceFull = shed[static_cast<std::size_t>(Verdict::SourceFull)].load(std::memory_order_relaxed);
+    result.shedRateLimited = shed[static_cast<std::size_t>(Verdict::RateLimited)].load(std::memory_order_relaxed);
+    pthread_mutex_lock(&mutex);
+    result.connections = connections;
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+void AdmissionControl::countLocked(int fd, const SourceKey* source)
+{
+    const auto index = static_cast<std::size_t>(fd);
+    if (index >= slots.size()) {
+        slots.resize(std::max<std::size_t>(index + 1, slots.size() * 2));
+    }
+    Slot& slot = slots[index];
+    slot.counted = true;
+    slot.hasSource = source != nullptr;
+    if (source) {
+        slot.source = *source;
+    }
+    ++connections;
+}
+
+// Sources without connections whose bucket has refilled carry no state worth
+// keeping. Runs when the table doubles, so its cost is amortised.
+void AdmissionControl::sweepIdleSourcesLocked(int64_t now)
+{
+    for (auto it = sources.begin(); it != sources.end();) {
+        Source& source = it->second;
+        if (source.connections == 0) {
+            refill(source.bucket.tokens, source.bucket.refilledNs, acceptRatePerSource, now);
+        }
+        if (source.connections == 0 && source.bucket.tokens >= burstOf(acceptRatePerSource)) {
+            it = sources.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    sweepAt = std::max(kSweepThreshold, sources.size() * 2);
+}
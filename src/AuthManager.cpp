@@ -1,28 +1,150 @@
 // AuthManager.cpp
 #include "../include/AuthManager.h"
 #include "../include/DatabaseEngine.h"
+#include "../include/UserDirectory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
 #include <sodium.h> 
 
 /* TODOS 
-1. Compare moderate vs interactive OPS / MEMLIMITS
-2. Ensure sodium_init() is called once at program start (maybe in the main() function)
-3. Delete commented-out code if not needed: libsodium generates its own salt internally.
+1. Ensure sodium_init() is called once at program start (maybe in the main() function)
+2. Delete commented-out code if not needed: libsodium generates its own salt internally.
 There's also no need for the constantTimeEquals function since libsodium handles that securely.
 */
 
-AuthManager::AuthManager(Database& db)
+namespace {
+// Calibration never trades memory below this for speed.
+constexpr std::size_t kMinHashMemory = 16 * 1024 * 1024;
+
+// Memory an existing hash needs to verify: the m= field, in KiB.
+std::size_t hashMemoryBytes(const std::string& hash, std::size_t fallback)
+{
+    const std::size_t pos = hash.find("$m=");
+    if (pos == std::string::npos) {
+        return fallback;
+    }
+    const unsigned long long kib = std::strtoull(hash.c_str() + pos + 3, nullptr, 10);
+    return kib > 0 ? static_cast<std::size_t>(kib) * 1024 : fallback;
+}
+} // namespace
+
+AuthManager::AuthManager(Database& db, UserDirectory* directory)
     : database(db)
+    , userDirectory(directory)
+    , hashCost{crypto_pwhash_OPSLIMIT_INTERACTIVE, crypto_pwhash_MEMLIMIT_INTERACTIVE}
+{
+    pthread_mutex_init(&poolMutex, nullptr);
+    pthread_cond_init(&poolCond, nullptr);
+    pthread_mutex_init(&memoryMutex, nullptr);
+    pthread_cond_init(&memoryCond, nullptr);
+}
+
+AuthManager::~AuthManager()
+{
+    stopPool();
+    pthread_cond_destroy(&memoryCond);
+    pthread_mutex_destroy(&memoryMutex);
+    pthread_cond_destroy(&poolCond);
+    pthread_mutex_destroy(&poolMutex);
+}
+
+AuthManager::MemoryReservation::MemoryReservation(AuthManager& owner, std::size_t size)
+    : auth(owner)
+    , bytes(size)
+{
+    pthread_mutex_lock(&auth.memoryMutex);
+    while (auth.memoryBudget > 0 && auth.memoryInUse > 0 && auth.memoryInUse + bytes > auth.memoryBudget) {
+        pthread_cond_wait(&auth.memoryCond, &auth.memoryMutex);
+    }
+    auth.memoryInUse += bytes;
+    pthread_mutex_unlock(&auth.memoryMutex);
+}
+
+AuthManager::MemoryReservation::~MemoryReservation()
+{
+    pthread_mutex_lock(&auth.memoryMutex);
+    auth.memoryInUse -= bytes;
+    pthread_cond_broadcast(&auth.memoryCond);
+    pthread_mutex_unlock(&auth.memoryMutex);
+}
+
+void AuthManager::setMemoryBudget(std::size_t bytes)
 {
+    pthread_mutex_lock(&memoryMutex);
+    memoryBudget = bytes;
+    pthread_cond_broadcast(&memoryCond);
+    pthread_mutex_unlock(&memoryMutex);
 }
 
-std::string AuthManager::hashPassword(const std::string& password) const
+AuthManager::HashCost AuthManager::loadHashCost(unsigned targetMillis, std::size_t memoryPerHash, bool recalibrate)
 {
-    // Sodium.h hashing 
+    uint64_t iterations = 0;
+    uint64_t memoryBytes = 0;
+    if (!recalibrate && database.loadHashParams(iterations, memoryBytes)
+        && iterations >= crypto_pwhash_OPSLIMIT_MIN && iterations <= crypto_pwhash_OPSLIMIT_MAX
+        && memoryBytes >= crypto_pwhash_MEMLIMIT_MIN && memoryBytes <= crypto_pwhash_MEMLIMIT_MAX) {
+        hashCost = HashCost{iterations, static_cast<std::size_t>(memoryBytes)};
+        return hashCost;
+    }
+
+    hashCost = calibrate(targetMillis, memoryPerHash);
+    if (!database.storeHashParams(hashCost.iterations, hashCost.memoryBytes)) {
+        std::cerr << "[Auth] Could not store the calibrated hash cost" << std::endl;
+    }
+    database.logActivity("INFO", "Calibrated Argon2id: t=" + std::to_string(hashCost.iterations)
+                                     + ", m=" + std::to_string(hashCost.memoryBytes / 1024) + " KiB");
+    return hashCost;
+}
+
+// Argon2 time grows about linearly with both memory and passes. Start with
+// one pass over the whole memory allowance, halve the memory (down to
+// kMinHashMemory) while even that is too slow, then take as many passes as
+// still fit the target.
+AuthManager::HashCost AuthManager::calibrate(unsigned targetMillis, std::size_t memoryPerHash)
+{
+    static const char kPassword[] = "calibration";
+    unsigned char salt[crypto_pwhash_SALTBYTES] = {};
+    unsigned char digest[32];
+    auto timeHash = [&](uint64_t iterations, std::size_t memoryBytes) {
+        const auto start = std::chrono::steady_clock::now();
+        if (crypto_pwhash(digest, sizeof digest, kPassword, sizeof kPassword - 1, salt,
+                          iterations, memoryBytes, crypto_pwhash_ALG_ARGON2ID13) != 0) {
+            throw std::runtime_error("Argon2 calibration failed (out of memory?)");
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    const double target = std::max(1u, targetMillis);
+    const std::size_t floor = std::max<std::size_t>(kMinHashMemory, crypto_pwhash_MEMLIMIT_MIN);
+    std::size_t memoryBytes = std::clamp<std::size_t>(memoryPerHash, floor, crypto_pwhash_MEMLIMIT_MAX) & ~std::size_t{1023};
+    uint64_t iterations = std::max<uint64_t>(crypto_pwhash_OPSLIMIT_MIN, 1);
+
+    double millis = timeHash(iterations, memoryBytes);
+    while (millis > target && memoryBytes / 2 >= floor) {
+        memoryBytes /= 2;
+        millis = timeHash(iterations, memoryBytes);
+    }
+    if (millis < target) {
+        iterations = std::max<uint64_t>(iterations, static_cast<uint64_t>(target / millis));
+        millis = timeHash(iterations, memoryBytes);
+        if (millis > target) {
+            iterations = std::max<uint64_t>(crypto_pwhash_OPSLIMIT_MIN, static_cast<uint64_t>(iterations * target / millis));
+        }
+    }
+    return HashCost{iterations, memoryBytes};
+}
+
+std::string AuthManager::hashPassword(const std::string& password)
+{
+    MemoryReservation reservation(*this, hashCost.memoryBytes);
     char hash[crypto_pwhash_STRBYTES];
     if (crypto_pwhash_str(hash, password.c_str(), password.size(),
-                          crypto_pwhash_OPSLIMIT_INTERACTIVE,
-                          crypto_pwhash_MEMLIMIT_INTERACTIVE) != 0) {
+                          hashCost.iterations, hashCost.memoryBytes) != 0) {
         throw std::runtime_error("Password hashing failed");
     }
     return std::string(hash);
@@ -37,6 +159,10 @@ bool AuthManager::registerUser(const std::string& username, const std::string& p
     if (!database.insertUser(username, hash)) {
         return false;
     }
+    int userId = 0;
+    if (userDirectory && database.findUserId(username, userId)) {
+        userDirectory->remember(userId, username);
+    }
     database.logActivity("INFO", "Registered user: " + username);
     return true;
 }
@@ -49,10 +175,139 @@ bool AuthManager::loginUser(const std::string& username, const std::string& pass
     }
 
     // Match password with stored hash
-    if (crypto_pwhash_str_verify(storedHash.c_str(), password.c_str(), password.size()) != 0) {
-        return false;
+    {
+        MemoryReservation reservation(*this, hashMemoryBytes(storedHash, hashCost.memoryBytes));
+        if (crypto_pwhash_str_verify(storedHash.c_str(), password.c_str(), password.size()) != 0) {
+            return false;
+        }
+    }
+
+    // Stored under older parameters: the password is at hand, so upgrade it.
+    if (crypto_pwhash_str_needs_rehash(storedHash.c_str(), hashCost.iterations, hashCost.memoryBytes) != 0) {
+        try {
+            if (database.updatePasswordHash(username, hashPassword(password))) {
+                database.logActivity("INFO", "Rehashed password for " + username);
+            }
+        } catch (const std::exception& ex) {
+            std::cerr << "[Auth] Rehash for " << username << " failed: " << ex.what() << std::endl;
+        }
     }
 
     database.logActivity("INFO", "User login: " + username);
     return true;
-}
\ No newline at end of file
+}
+
+bool AuthManager::startPool(std::size_t threads, std::size_t queueLimit)
+{
+    pthread_mutex_lock(&poolMutex);
+    if (poolRunning || threads == 0) {
+        pthread_mutex_unlock(&poolMutex);
+        return poolRunning;
+    }
+    poolRunning = true;
+    maxQueued = queueLimit;
+    for (std::size_t i = 0; i < threads; ++i) {
+        pthread_t thread;
+        const int created = pthread_create(&thread, nullptr, &AuthManager::poolThreadEntry, this);
+        if (created != 0) {
+            std::cerr << "[Auth] pthread_create: " << std::strerror(created) << std::endl;
+            break;
+        }
+        poolThreads.push_back(thread);
+    }
+    const bool started = !poolThreads.empty();
+    poolRunning = started;
+    pthread_mutex_unlock(&poolMutex);
+    return started;
+}
+
+void AuthManager::stopPool()
+{
+    pthread_mutex_lock(&poolMutex);
+    poolRunning = false;
+    std::deque<PoolJob> dropped;
+    dropped.swap(jobs);
+    pthread_cond_broadcast(&poolCond);
+    std::vector<pthread_t> threads;
+    threads.swap(poolThreads);
+    pthread_mutex_unlock(&poolMutex);
+
+    for (pthread_t thread : threads) {
+        pthread_join(thread, nullptr);
+    }
+    // Callers keep the connection paused until `done` runs, so the jobs that
+    // never started still get an answer.
+    for (PoolJob& job : dropped) {
+        job(true);
+    }
+}
+
+bool AuthManager::registerUserAsync(const std::string& username, const std::string& password, Completion done)
+{
+    return submit([this, username, password, done = std::move(done)](bool cancelled) {
+        if (cancelled) {
+            done(false);
+            return;
+        }
+        bool ok = false;
+        try {
+            ok = registerUser(username, password);
+        } catch (const std::exception& ex) {
+            std::cerr << "[Auth] " << ex.what() << std::endl;
+        }
+        done(ok);
+    });
+}
+
+bool AuthManager::loginUserAsync(const std::string& username, const std::string& password, Completion done)
+{
+    return submit([this, username, password, done = std::move(done)](bool cancelled) {
+        done(!cancelled && loginUser(username, password));
+    });
+}
+
+bool AuthManager::submit(PoolJob job)
+{
+    pthread_mutex_lock(&poolMutex);
+    if (!poolRunning) {
+        pthread_mutex_unlock(&poolMutex);
+        job(false);
+        return true;
+    }
+    if (jobs.size() >= maxQueued) {
+        pthread_mutex_unlock(&poolMutex);
+        return false;
+    }
+    jobs.push_back(std::move(job));
+    pthread_cond_signal(&poolCond);
+    pthread_mutex_unlock(&poolMutex);
+    return true;
+}
+
+void* AuthManager::poolThreadEntry(void* arg)
+{
+    auto* auth = static_cast<AuthManager*>(arg);
+    auth->database.openThreadReader();
+    auth->poolLoop();
+    auth->database.closeThreadReader();
+    return nullptr;
+}
+
+void AuthManager::poolLoop()
+{
+    pthread_mutex_lock(&poolMutex);
+    for (;;) {
+        while (jobs.empty() && poolRunning) {
+            pthread_cond_wait(&poolCond, &poolMutex);
+        }
+        if (!poolRunning) {
+            break;
+        }
+        PoolJob job = std::move(jobs.front());
+        jobs.pop_front();
+        pthread_mutex_unlock(&poolMutex);
+        job(false);
+        pthread_mutex_lock(&poolMutex);
+    }
+    pthread_mutex_unlock(&poolMutex);
+}
@@ -0,0 +1,53 @@
+// ClientHandle.cpp
+#include "../include/ClientHandle.h"
+
+#include <utility>
+
+ClientHandle::ClientHandle(ClientNotifier* owner, int fd, uint32_t generation)
+    : owner_(owner)
+    , socketFd(fd)
+    , generation_(generation)
+{
+    pthread_mutex_init(&backlogMutex, nullptr);
+}
+
+ClientHandle::~ClientHandle()
+{
+    pthread_mutex_destroy(&backlogMutex);
+}
+
+void ClientHandle::postMessage(IncomingMessage message) const
+{
+    if (owner_) {
+        owner_->postMessage(socketFd, generation_, std::move(message));
+    }
+}
+
+// The flag flips under backlogMutex so a sender can never register itself
+// after the owner has already released the waiters for this backlog.
+void ClientHandle::setBacklogged(bool value)
+{
+    pthread_mutex_lock(&backlogMutex);
+    backlogged.store(value, std::memory_order_release);
+    pthread_mutex_unlock(&backlogMutex);
+}
+
+bool ClientHandle::addBlockedSender(const BlockedSender& sender)
+{
+    pthread_mutex_lock(&backlogMutex);
+    const bool waiting = backlogged.load(std::memory_order_relaxed);
+    if (waiting) {
+        blockedSenders.push_back(sender);
+    }
+    pthread_mutex_unlock(&backlogMutex);
+    return waiting;
+}
+
+std::vector<ClientHandle::BlockedSender> ClientHandle::takeBlockedSenders()
+{
+    std::vector<BlockedSender> released;
+    pthread_mutex_lock(&backlogMutex);
+    released.swap(blockedSenders);
+    pthread_mutex_unlock(&backlogMutex);
+    return released;
+}
@@ -1,6 +1,9 @@
 #include "ClientState.h"
 
+#include "ShmTransport.h"
+
 #include <arpa/inet.h>
+#include <algorithm>
 #include <ctime>
 #include <cstring>
 #include <unistd.h>
@@ -24,30 +27,64 @@ std::string framePayload(const std::string& payload)
 
 void queueFramedResponse(ClientState& state, const std::string& message)
 {
-    const std::string frame = framePayload(message);
+    std::string frame = framePayload(message);
     if (frame.empty()) {
         return;
     }
-    state.queueResponse(frame);
+    state.queueResponse(std::move(frame));
 }
 } // namespace
 
-ClientState::ClientState(ClientNotifier* ownerThread, int fd, ProtocolHandler& protocol)
+ClientState::ClientState(ClientNotifier* ownerThread, int fd, uint32_t generation, ProtocolHandler& protocol)
     : owner(ownerThread)
     , socketFd(fd)
-    , protocolHandler(protocol)
+    , generation_(generation)
+    , handle_(std::make_shared<ClientHandle>(ownerThread, fd, generation))
     , username_()
     , authenticated(false)
-    , lastActivityTs(::time(nullptr))
+    , lastActivityTs(0)
     , recvBuffer()
     , sendQueue()
+    , protocolHandler(protocol)
+{
+}
+
+ClientState::~ClientState() = default;
+
+void ClientState::setUserId(int id)
+{
+    if (id != userId_) {
+        caughtUpTo = 0;
+        groupCaughtUpTo.clear();
+    }
+    userId_ = id;
+}
+
+void ClientState::noteCaughtUp(int messageId)
+{
+    caughtUpTo = std::max(caughtUpTo, messageId);
+}
+
+void ClientState::noteGroupCaughtUp(int groupId, int messageId)
+{
+    int& mark = groupCaughtUpTo[groupId];
+    mark = std::max(mark, messageId);
+}
+
+// Ids are handed out in commit order by the single writer, so everything
+// up to a catch-up's highest id had committed when it read the store.
+bool ClientState::alreadyQueued(const IncomingMessage& message) const
 {
-    pthread_mutex_init(&sendMutex, nullptr);
+    if (message.groupId == 0) {
+        return message.id <= caughtUpTo;
+    }
+    const auto mark = groupCaughtUpTo.find(message.groupId);
+    return mark != groupCaughtUpTo.end() && message.id <= mark->second;
 }
 
-ClientState::~ClientState()
+void ClientState::attachSharedMemory(std::unique_ptr<ShmTransport> transport)
 {
-    pthread_mutex_destroy(&sendMutex);
+    shm = std::move(transport);
 }
 
 void ClientState::setAuthenticated(bool value)
@@ -60,7 +97,7 @@ void ClientState::setUsername(std::string name)
     username_ = std::move(name);
 }
 
-void ClientState::updateActivity(time_t now)
+void ClientState::updateActivity(uint64_t now)
 {
     lastActivityTs = now;
 }
@@ -70,14 +107,12 @@ void ClientState::clearRecvBuffer()
     recvBuffer.clear();
 }
 
-void ClientState::queueResponse(const std::string& message)
+void ClientState::queueResponse(std::string message)
 {
-    pthread_mutex_lock(&sendMutex);
-    sendQueue.push_back(message);
-    pthread_mutex_unlock(&sendMutex);
-
     if (owner) {
-        owner->notifyEvent(socketFd);
+        owner->postFrame(socketFd, generation_, std::move(message));
+    } else {
+        appendQueuedFrame(std::move(message));
     }
 }
 
@@ -86,10 +121,25 @@ void ClientState::queueProtocolResponse(const Response& response)
     queueFramedResponse(*this, protocolHandler.serializeResponse(response));
 }
 
+std::string ClientState::encodeFrame(const std::string& payload)
+{
+    return framePayload(payload);
+}
+
+void ClientState::queueFrame(std::shared_ptr<const std::string> frame)
+{
+    if (owner) {
+        owner->postFrame(socketFd, generation_, std::move(frame));
+    } else {
+        appendQueuedFrame(std::move(frame));
+    }
+}
+
 void ClientState::queueIncomingMessage(const std::string& sender,
                                        const std::string& content,
                                        const std::string& timestamp,
-                                       std::optional<int> messageId)
+                                       std::optional<int> messageId,
+                                       const std::string& group)
 {
     Response notification;
     notification.command = "incoming_message";
@@ -102,30 +152,57 @@ void ClientState::queueIncomingMessage(const std::string& sender,
     if (messageId.has_value()) {
         notification.id = messageId;
     }
+    if (!group.empty()) {
+        notification.group = group;
+    }
     queueFramedResponse(*this, protocolHandler.serializeResponse(notification));
 }
 
-void ClientState::pushFrontResponse(const std::string& message)
+void ClientState::appendQueuedFrame(FrameBuffer frame)
 {
-    pthread_mutex_lock(&sendMutex);
-    sendQueue.push_front(message);
-    pthread_mutex_unlock(&sendMutex);
-
-    if (owner) {
-        owner->notifyEvent(socketFd);
-    }
+    sendQueueBytes += frame.size();
+    sendQueue.push_back(std::move(frame));
 }
 
 bool ClientState::popQueuedResponse(std::string& outMessage)
 {
-    pthread_mutex_lock(&sendMutex);
     if (sendQueue.empty()) {
-        pthread_mutex_unlock(&sendMutex);
         return false;
     }
 
-    outMessage = std::move(sendQueue.front());
+    outMessage = sendQueue.front().release();
     sendQueue.pop_front();
-    pthread_mutex_unlock(&sendMutex);
+    sendQueueBytes -= outMessage.size() - sendHeadOffset;
+    outMessage.erase(0, sendHeadOffset);
+    sendHeadOffset = 0;
     return true;
 }
+
+std::size_t ClientState::peekQueuedResponses(std::vector<std::string_view>& out, std::size_t maxFrames)
+{
+    const std::size_t count = std::min(maxFrames, sendQueue.size());
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string_view frame = sendQueue[i].view();
+        if (i == 0) {
+            frame.remove_prefix(sendHeadOffset);
+        }
+        out.push_back(frame);
+    }
+    return count;
+}
+
+void ClientState::consumeQueuedBytes(std::size_t bytes)
+{
+    bytes = std::min(bytes, sendQueueBytes);
+    sendQueueBytes -= bytes;
+    while (bytes > 0 && !sendQueue.empty()) {
+        const std::size_t headRemaining = sendQueue.front().size() - sendHeadOffset;
+        if (bytes < headRemaining) {
+            sendHeadOffset += bytes;
+            break;
+        }
+        bytes -= headRemaining;
+        sendHeadOffset = 0;
+        sendQueue.pop_front();
+    }
+}
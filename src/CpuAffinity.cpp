@@ -0,0 +1,68 @@
+#include "CpuAffinity.h"
+
+#include <sstream>
+
+namespace {
+bool parseCpu(const std::string& text, int& cpu)
+{
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 4) {
+        return false;
+    }
+    cpu = std::stoi(text);
+    return cpu < CPU_SETSIZE;
+}
+} // namespace
+
+namespace affinity {
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus)
+{
+    std::vector<int> parsed;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const auto dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if (!parseCpu(item.substr(0, dash), first)) {
+            return false;
+        }
+        last = first;
+        if (dash != std::string::npos && (!parseCpu(item.substr(dash + 1), last) || last < first)) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            parsed.push_back(cpu);
+        }
+    }
+    if (parsed.empty()) {
+        return false;
+    }
+    cpus = std::move(parsed);
+    return true;
+}
+
+std::string formatCpuSet(const cpu_set_t& set)
+{
+    std::string out;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) {
+            ++last;
+        }
+        if (!out.empty()) {
+            out += ',';
+        }
+        out += std::to_string(cpu);
+        if (last > cpu) {
+            out += '-' + std::to_string(last);
+        }
+        cpu = last;
+    }
+    return out.empty() ? "none" : out;
+}
+
+} // namespace affinity
@@ -1,5 +1,6 @@
 #include "../include/CryptoEngine.h"
 
+#include <algorithm>
 #include <array>
 #include <stdexcept>
 #include <vector>
@@ -12,12 +13,17 @@ CryptoEngine::CryptoEngine()
 {
     loadMasterKey();
     loadSecretKey();
+    static_assert(crypto_kdf_KEYBYTES == crypto_secretbox_KEYBYTES, "master key doubles as the KDF key");
+    static_assert(crypto_auth_KEYBYTES >= crypto_kdf_BYTES_MIN && crypto_auth_KEYBYTES <= crypto_kdf_BYTES_MAX,
+                  "resume key length");
+    crypto_kdf_derive_from_key(resumeKey.data(), resumeKey.size(), 1, "HUXRESUM", masterKey.data());
 }
 
 CryptoEngine::~CryptoEngine()
 {
     // Zero out the secret key from memory
     sodium_memzero(secretKey.data(), secretKey.size());
+    sodium_memzero(resumeKey.data(), resumeKey.size());
 }
 
 void CryptoEngine::loadMasterKey()
@@ -144,3 +150,70 @@ bool CryptoEngine::decryptMessage(const CipherMessage &cipher, std::string &outP
     outPlaintext.assign(plaintext.begin(), plaintext.end());
     return true;
 }
+
+namespace
+{
+constexpr unsigned char kResumeTokenVersion = 2;
+constexpr std::size_t kResumeHeaderBytes = 1 + 8 + 4; // version, expiry, epoch
+}
+
+// base64url(version | expiry | epoch, big-endian | username | HMAC-SHA512-256 of the rest)
+std::string CryptoEngine::issueResumeToken(const std::string &username, uint32_t epoch, uint64_t expiresAt)
+{
+    std::vector<unsigned char> token(kResumeHeaderBytes + username.size() + crypto_auth_BYTES);
+    token[0] = kResumeTokenVersion;
+    for (int i = 0; i < 8; ++i)
+    {
+        token[1 + i] = static_cast<unsigned char>(expiresAt >> (56 - 8 * i));
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        token[9 + i] = static_cast<unsigned char>(epoch >> (24 - 8 * i));
+    }
+    std::copy(username.begin(), username.end(), token.begin() + kResumeHeaderBytes);
+
+    const std::size_t signedBytes = token.size() - crypto_auth_BYTES;
+    crypto_auth(token.data() + signedBytes, token.data(), signedBytes, resumeKey.data());
+
+    std::string encoded(sodium_base64_encoded_len(token.size(), sodium_base64_VARIANT_URLSAFE_NO_PADDING), '\0');
+    sodium_bin2base64(&encoded[0], encoded.size(), token.data(), token.size(), sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+    encoded.resize(encoded.size() - 1); // terminator
+    return encoded;
+}
+
+bool CryptoEngine::verifyResumeToken(const std::string &token, uint64_t now, std::string &outUsername, uint32_t &outEpoch)
+{
+    std::vector<unsigned char> raw(token.size());
+    std::size_t rawBytes = 0;
+    if (sodium_base642bin(raw.data(), raw.size(), token.data(), token.size(), nullptr, &rawBytes, nullptr,
+                          sodium_base64_VARIANT_URLSAFE_NO_PADDING) != 0
+        || rawBytes <= kResumeHeaderBytes + crypto_auth_BYTES
+        || raw[0] != kResumeTokenVersion)
+    {
+        return false;
+    }
+
+    const std::size_t signedBytes = rawBytes - crypto_auth_BYTES;
+    if (crypto_auth_verify(raw.data() + signedBytes, raw.data(), signedBytes, resumeKey.data()) != 0)
+    {
+        return false;
+    }
+
+    uint64_t expiresAt = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        expiresAt = (expiresAt << 8) | raw[1 + i];
+    }
+    if (expiresAt <= now)
+    {
+        return false;
+    }
+
+    outEpoch = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        outEpoch = (outEpoch << 8) | raw[9 + i];
+    }
+    outUsername.assign(reinterpret_cast<const char *>(raw.data()) + kResumeHeaderBytes, signedBytes - kResumeHeaderBytes);
+    return true;
+}
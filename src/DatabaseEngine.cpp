@@ -6,6 +6,15 @@
 #include <algorithm>
 
 namespace {
+constexpr int kBusyTimeoutMs = 2000;
+
+// The calling thread's read connection, and the writer it belongs to.
+struct ThreadReader {
+    const Database* owner {nullptr};
+    const Database* connection {nullptr};
+};
+thread_local ThreadReader threadReaderSlot;
+
 bool exec(sqlite3* db, const char* sql)
 {
     char* errMsg = nullptr;
@@ -20,6 +29,27 @@ bool exec(sqlite3* db, const char* sql)
     return true;
 }
 
+// Databases created before a column existed get it added in place.
+bool addColumnIfMissing(sqlite3* db, const char* table, const char* column, const char* definition)
+{
+    const std::string pragma = std::string("PRAGMA table_info(") + table + ");";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, pragma.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    bool found = false;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        found = name && std::string(name) == column;
+    }
+    sqlite3_finalize(stmt);
+    if (found) {
+        return true;
+    }
+    const std::string alter = std::string("ALTER TABLE ") + table + " ADD COLUMN " + column + " " + definition + ";";
+    return exec(db, alter.c_str());
+}
+
 // Create binding policies
 template<typename T> 
 void bindParam(sqlite3_stmt* stmt, int index, const T&) = delete; 
@@ -92,11 +122,23 @@ bool Database::singleColumnQuery(sqlite3_stmt*& cachedStmt,
     return true;
 }
 
-Database::Database(const std::string& filename)
+Database::Database(const std::string& filename, Mode openMode)
     : dbHandle(nullptr)
     , dbPath(filename)
+    , mode(openMode)
 {
-    if (sqlite3_open(dbPath.c_str(), &dbHandle) != SQLITE_OK) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&connectionMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&readersMutex, nullptr);
+
+    // A reader belongs to one thread, so SQLite's own mutex is dead weight.
+    const int flags = mode == Mode::ReadOnly
+        ? SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX
+        : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (sqlite3_open_v2(dbPath.c_str(), &dbHandle, flags, nullptr) != SQLITE_OK) {
         std::cerr << "Failed to open database: "
                   << (dbHandle ? sqlite3_errmsg(dbHandle) : "unknown error")
                   << std::endl;
@@ -107,7 +149,12 @@ Database::Database(const std::string& filename)
         return;
     }
 
-    if (!configurePragmas() || !ensureSchema()) {
+    sqlite3_busy_timeout(dbHandle, kBusyTimeoutMs);
+
+    const bool ready = mode == Mode::ReadOnly
+        ? exec(dbHandle, "PRAGMA mmap_size=268435456;")
+        : configurePragmas() && ensureSchema();
+    if (!ready) {
         std::cerr << "Failed to initialize database schema" << std::endl;
         teardown();
     }
@@ -115,7 +162,12 @@ Database::Database(const std::string& filename)
 
 Database::~Database()
 {
+    pthread_mutex_lock(&readersMutex);
+    readers.clear();
+    pthread_mutex_unlock(&readersMutex);
     teardown();
+    pthread_mutex_destroy(&readersMutex);
+    pthread_mutex_destroy(&connectionMutex);
 }
 
 bool Database::isOpen() const noexcept
@@ -123,8 +175,50 @@ bool Database::isOpen() const noexcept
     return dbHandle != nullptr;
 }
 
+bool Database::openThreadReader()
+{
+    if (mode == Mode::ReadOnly || !dbHandle) {
+        return false;
+    }
+    if (threadReaderSlot.owner == this) {
+        return true;
+    }
+
+    auto reader = std::make_unique<Database>(dbPath, Mode::ReadOnly);
+    if (!reader->isOpen()) {
+        return false;
+    }
+    threadReaderSlot.owner = this;
+    threadReaderSlot.connection = reader.get();
+    pthread_mutex_lock(&readersMutex);
+    readers.push_back(std::move(reader));
+    pthread_mutex_unlock(&readersMutex);
+    return true;
+}
+
+void Database::closeThreadReader()
+{
+    if (threadReaderSlot.owner != this) {
+        return;
+    }
+    const Database* connection = threadReaderSlot.connection;
+    threadReaderSlot = ThreadReader{};
+
+    pthread_mutex_lock(&readersMutex);
+    readers.erase(std::remove_if(readers.begin(), readers.end(), [connection](const std::unique_ptr<Database>& reader) {
+        return reader.get() == connection;
+    }), readers.end());
+    pthread_mutex_unlock(&readersMutex);
+}
+
+const Database* Database::threadReader() const noexcept
+{
+    return threadReaderSlot.owner == this ? threadReaderSlot.connection : nullptr;
+}
+
 bool Database::insertUser(const std::string& username, const std::string& passwordHash)
 {
+    ConnectionLock lock(*this);
     static constexpr const char* sql =
         "INSERT INTO users (username, password_hash) VALUES (?, ?);";
 
@@ -140,18 +234,30 @@ bool Database::insertUser(const std::string& username, const std::string& passwo
 }
 
 bool Database::findUser(const std::string& username, std::string& outHash) const {
+    if (const Database* reader = threadReader()) {
+        return reader->findUser(username, outHash);
+    }
+    ConnectionLock lock(*this);
     static constexpr const char* sql =
         "SELECT password_hash FROM users WHERE username = ?;";
     return singleColumnQuery(findUserStmt, sql, username, outHash);
 }
 
 bool Database::findUserId(const std::string& username, int& outId) const {
+    if (const Database* reader = threadReader()) {
+        return reader->findUserId(username, outId);
+    }
+    ConnectionLock lock(*this);
     static constexpr const char* sql =
         "SELECT id FROM users WHERE username = ?;";
     return singleColumnQuery(findUserIdStmt, sql, username, outId);
 }
 
 bool Database::findUsername(int userId, std::string& outUsername) const {
+    if (const Database* reader = threadReader()) {
+        return reader->findUsername(userId, outUsername);
+    }
+    ConnectionLock lock(*this);
     static constexpr const char* sql =
         "SELECT username FROM users WHERE id = ?;";
     return singleColumnQuery(findUsernameStmt, sql, userId, outUsername);
@@ -164,6 +270,7 @@ bool Database::insertMessage(int senderId,
                               const std::string& nonce,
                               int& outMessageId)
 {
+    ConnectionLock lock(*this);
     if (!dbHandle) {
         return false;
     }
@@ -200,6 +307,10 @@ bool Database::insertMessage(int senderId,
 
 std::vector<Database::StoredMessage> Database::getQueuedMessages(int recipientId) const
 {
+    if (const Database* reader = threadReader()) {
+        return reader->getQueuedMessages(recipientId);
+    }
+    ConnectionLock lock(*this);
     std::vector<StoredMessage> messages;
     if (!dbHandle) {
         return messages;
@@ -247,6 +358,10 @@ std::vector<Database::StoredMessage> Database::getQueuedMessages(int recipientId
 
 std::vector<Database::UserSummary> Database::listAllUsers() const
 {
+    if (const Database* reader = threadReader()) {
+        return reader->listAllUsers();
+    }
+    ConnectionLock lock(*this);
     std::vector<UserSummary> users;
     if (!dbHandle) {
         return users;
@@ -279,6 +394,10 @@ std::vector<Database::StoredMessage> Database::getConversation(int userA,
                                                                int limit,
                                                                int offset) const
 {
+    if (const Database* reader = threadReader()) {
+        return reader->getConversation(userA, userB, limit, offset);
+    }
+    ConnectionLock lock(*this);
     std::vector<StoredMessage> messages;
     if (!dbHandle) {
         return messages;
@@ -347,6 +466,7 @@ std::vector<Database::StoredMessage> Database::getConversation(int userA,
 
 bool Database::markDelivered(int messageId)
 {
+    ConnectionLock lock(*this);
     if (!dbHandle) {
         return false;
     }
@@ -373,6 +493,7 @@ bool Database::markDelivered(int messageId)
 
 bool Database::logActivity(const std::string& level, const std::string& message)
 {
+    ConnectionLock lock(*this);
     if (!dbHandle) {
         return false;
     }
@@ -391,6 +512,332 @@ bool Database::logActivity(const std::string& level, const std::string& message)
     return sqlite3_step(stmt) == SQLITE_DONE;
 }
 
+bool Database::updatePasswordHash(const std::string& username, const std::string& passwordHash)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "UPDATE users SET password_hash = ?, token_epoch = token_epoch + 1 WHERE username = ?;";
+
+    auto stmtGuard = makeStatementGuard(updatePasswordStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, passwordHash.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
+
+    return sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(dbHandle) == 1;
+}
+
+bool Database::tokenEpoch(int userId, int& outEpoch) const
+{
+    if (const Database* reader = threadReader()) {
+        return reader->tokenEpoch(userId, outEpoch);
+    }
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "SELECT token_epoch FROM users WHERE id = ?;";
+    return singleColumnQuery(tokenEpochStmt, sql, userId, outEpoch);
+}
+
+// Only ever raised, so a replayed or late job can't revive older tokens.
+bool Database::raiseTokenEpoch(int userId, int epoch)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "UPDATE users SET token_epoch = MAX(token_epoch, ?) WHERE id = ?;";
+
+    auto stmtGuard = makeStatementGuard(raiseTokenEpochStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, epoch);
+    sqlite3_bind_int(stmt, 2, userId);
+    return sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(dbHandle) == 1;
+}
+
+bool Database::revokeTokens(int userId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "UPDATE users SET token_epoch = token_epoch + 1 WHERE id = ?;";
+
+    auto stmtGuard = makeStatementGuard(revokeTokensStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, userId);
+    return sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(dbHandle) == 1;
+}
+
+bool Database::loadHashParams(uint64_t& outIterations, uint64_t& outMemoryBytes) const
+{
+    if (const Database* reader = threadReader()) {
+        return reader->loadHashParams(outIterations, outMemoryBytes);
+    }
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "SELECT iteration_param, memory_param FROM config "
+        "WHERE id = 1 AND iteration_param IS NOT NULL AND memory_param IS NOT NULL;";
+
+    auto stmtGuard = makeStatementGuard(loadHashParamsStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt || sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    outIterations = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+    outMemoryBytes = static_cast<uint64_t>(sqlite3_column_int64(stmt, 1));
+    return true;
+}
+
+bool Database::storeHashParams(uint64_t iterations, uint64_t memoryBytes)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "INSERT INTO config (id, iteration_param, memory_param) VALUES (1, ?, ?) "
+        "ON CONFLICT(id) DO UPDATE SET iteration_param = excluded.iteration_param, "
+        "memory_param = excluded.memory_param;";
+
+    auto stmtGuard = makeStatementGuard(storeHashParamsStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(iterations));
+    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(memoryBytes));
+
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// The creator is the first member; the two inserts share the caller's
+// transaction (see DatabaseWriter).
+bool Database::createGroup(const std::string& name, int creatorId, int& outGroupId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "INSERT INTO chat_groups (name, created_by) VALUES (?, ?);";
+
+    auto stmtGuard = makeStatementGuard(createGroupStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, creatorId);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        return false;
+    }
+    outGroupId = static_cast<int>(sqlite3_last_insert_rowid(dbHandle));
+    return joinGroup(outGroupId, creatorId);
+}
+
+bool Database::findGroupId(const std::string& name, int& outGroupId) const
+{
+    if (const Database* reader = threadReader()) {
+        return reader->findGroupId(name, outGroupId);
+    }
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "SELECT id FROM chat_groups WHERE name = ?;";
+    return singleColumnQuery(findGroupIdStmt, sql, name, outGroupId);
+}
+
+bool Database::isGroupMember(int groupId, int userId) const
+{
+    if (const Database* reader = threadReader()) {
+        return reader->isGroupMember(groupId, userId);
+    }
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "SELECT 1 FROM group_members WHERE group_id = ? AND user_id = ?;";
+
+    auto stmtGuard = makeStatementGuard(groupMemberStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, groupId);
+    sqlite3_bind_int(stmt, 2, userId);
+    return sqlite3_step(stmt) == SQLITE_ROW;
+}
+
+// A new member's cursor starts at the group's latest message: joining does
+// not replay the backlog. Joining twice is a no-op.
+bool Database::joinGroup(int groupId, int userId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "INSERT OR IGNORE INTO group_members (group_id, user_id, last_delivered) "
+        "SELECT ?1, ?2, COALESCE(MAX(id), 0) FROM group_messages WHERE group_id = ?1;";
+
+    auto stmtGuard = makeStatementGuard(joinGroupStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, groupId);
+    sqlite3_bind_int(stmt, 2, userId);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+bool Database::leaveGroup(int groupId, int userId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "DELETE FROM group_members WHERE group_id = ? AND user_id = ?;";
+
+    auto stmtGuard = makeStatementGuard(leaveGroupStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, groupId);
+    sqlite3_bind_int(stmt, 2, userId);
+    return sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(dbHandle) == 1;
+}
+
+std::vector<int> Database::groupMemberIds(int groupId) const
+{
+    if (const Database* reader = threadReader()) {
+        return reader->groupMemberIds(groupId);
+    }
+    ConnectionLock lock(*this);
+    std::vector<int> members;
+    static constexpr const char* sql =
+        "SELECT user_id FROM group_members WHERE group_id = ?;";
+
+    auto stmtGuard = makeStatementGuard(groupMembersStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return members;
+    }
+    sqlite3_bind_int(stmt, 1, groupId);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        members.push_back(sqlite3_column_int(stmt, 0));
+    }
+    return members;
+}
+
+// One row however many members the group has; each member's cursor says how
+// far it has been delivered.
+bool Database::insertGroupMessage(int groupId,
+                                  int senderId,
+                                  const std::string& ciphertext,
+                                  const std::string& nonce,
+                                  int& outMessageId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "INSERT INTO group_messages (group_id, sender_id, ciphertext, nonce) VALUES (?, ?, ?, ?);";
+
+    auto stmtGuard = makeStatementGuard(insertGroupMessageStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, groupId);
+    sqlite3_bind_int(stmt, 2, senderId);
+    sqlite3_bind_blob(stmt, 3, ciphertext.data(), static_cast<int>(ciphertext.size()), SQLITE_TRANSIENT);
+    sqlite3_bind_blob(stmt, 4, nonce.data(), static_cast<int>(nonce.size()), SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "Failed to insert group message: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    outMessageId = static_cast<int>(sqlite3_last_insert_rowid(dbHandle));
+    return true;
+}
+
+// Messages past the user's cursor in every group the user is in, oldest first,
+// leaving out the user's own.
+std::vector<Database::StoredGroupMessage> Database::getQueuedGroupMessages(int userId) const
+{
+    if (const Database* reader = threadReader()) {
+        return reader->getQueuedGroupMessages(userId);
+    }
+    ConnectionLock lock(*this);
+    std::vector<StoredGroupMessage> messages;
+    static constexpr const char* sql =
+        "SELECT gm.id, gm.group_id, g.name, gm.sender_id, gm.ciphertext, gm.nonce, gm.timestamp "
+        "FROM group_members m "
+        "JOIN group_messages gm ON gm.group_id = m.group_id AND gm.id > m.last_delivered "
+        "AND gm.sender_id <> m.user_id "
+        "JOIN chat_groups g ON g.id = m.group_id "
+        "WHERE m.user_id = ? ORDER BY gm.id ASC;";
+
+    auto stmtGuard = makeStatementGuard(queuedGroupMessagesStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return messages;
+    }
+    sqlite3_bind_int(stmt, 1, userId);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        StoredGroupMessage message{};
+        message.id = sqlite3_column_int(stmt, 0);
+        message.groupId = sqlite3_column_int(stmt, 1);
+        if (const auto* namePtr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2))) {
+            message.group.assign(namePtr);
+        }
+        message.senderId = sqlite3_column_int(stmt, 3);
+        if (const auto* cipherPtr = static_cast<const char*>(sqlite3_column_blob(stmt, 4))) {
+            message.ciphertext.assign(cipherPtr, sqlite3_column_bytes(stmt, 4));
+        }
+        if (const auto* noncePtr = static_cast<const char*>(sqlite3_column_blob(stmt, 5))) {
+            message.nonce.assign(noncePtr, sqlite3_column_bytes(stmt, 5));
+        }
+        if (const auto* tsPtr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6))) {
+            message.timestamp.assign(tsPtr);
+        }
+        messages.emplace_back(std::move(message));
+    }
+    return messages;
+}
+
+// Moves the cursor only over a contiguous run: if an earlier message never
+// reached the member (it was backlogged, or the connection went away with the
+// message in its mailbox), the cursor stays put and the next catch-up sends it
+// again along with whatever followed. Clients dedupe on (group, id).
+bool Database::advanceGroupCursor(int groupId, int userId, int messageId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "UPDATE group_members SET last_delivered = ?1 "
+        "WHERE group_id = ?2 AND user_id = ?3 AND last_delivered < ?1 "
+        "AND NOT EXISTS (SELECT 1 FROM group_messages gm WHERE gm.group_id = ?2 "
+        "AND gm.id > group_members.last_delivered AND gm.id < ?1 AND gm.sender_id <> ?3);";
+
+    auto stmtGuard = makeStatementGuard(advanceGroupCursorStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, messageId);
+    sqlite3_bind_int(stmt, 2, groupId);
+    sqlite3_bind_int(stmt, 3, userId);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// Catch-up has queued everything up to messageId, so no contiguity check.
+bool Database::setGroupCursor(int groupId, int userId, int messageId)
+{
+    ConnectionLock lock(*this);
+    static constexpr const char* sql =
+        "UPDATE group_members SET last_delivered = MAX(last_delivered, ?) "
+        "WHERE group_id = ? AND user_id = ?;";
+
+    auto stmtGuard = makeStatementGuard(setGroupCursorStmt, sql);
+    sqlite3_stmt* stmt = stmtGuard.get();
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, messageId);
+    sqlite3_bind_int(stmt, 2, groupId);
+    sqlite3_bind_int(stmt, 3, userId);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
 bool Database::configurePragmas()
 {
     if (!dbHandle) {
@@ -415,7 +862,8 @@ bool Database::ensureSchema()
         " id INTEGER PRIMARY KEY AUTOINCREMENT,"
         " username TEXT UNIQUE NOT NULL,"
         " password_hash TEXT NOT NULL,"
-        " created_at DATETIME DEFAULT CURRENT_TIMESTAMP"
+        " created_at DATETIME DEFAULT CURRENT_TIMESTAMP,"
+        " token_epoch INTEGER NOT NULL DEFAULT 0"
         ");";
 
     static constexpr const char* messagesSql =
@@ -447,20 +895,104 @@ bool Database::ensureSchema()
         " log_purge INTEGER"
         ");";
 
+    static constexpr const char* groupsSql =
+        "CREATE TABLE IF NOT EXISTS chat_groups ("
+        " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        " name TEXT UNIQUE NOT NULL,"
+        " created_by INTEGER NOT NULL,"
+        " created_at DATETIME DEFAULT CURRENT_TIMESTAMP,"
+        " FOREIGN KEY(created_by) REFERENCES users(id)"
+        ");";
+
+    // last_delivered: highest group_messages.id queued to this member
+    static constexpr const char* groupMembersSql =
+        "CREATE TABLE IF NOT EXISTS group_members ("
+        " group_id INTEGER NOT NULL,"
+        " user_id INTEGER NOT NULL,"
+        " last_delivered INTEGER NOT NULL DEFAULT 0,"
+        " PRIMARY KEY(group_id, user_id),"
+        " FOREIGN KEY(group_id) REFERENCES chat_groups(id),"
+        " FOREIGN KEY(user_id) REFERENCES users(id)"
+        ");";
+
+    static constexpr const char* groupMessagesSql =
+        "CREATE TABLE IF NOT EXISTS group_messages ("
+        " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        " group_id INTEGER NOT NULL,"
+        " sender_id INTEGER NOT NULL,"
+        " ciphertext BLOB NOT NULL,"
+        " nonce BLOB NOT NULL,"
+        " timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+        " FOREIGN KEY(group_id) REFERENCES chat_groups(id),"
+        " FOREIGN KEY(sender_id) REFERENCES users(id)"
+        ");";
+
     static constexpr const char* idxUsername =
         "CREATE INDEX IF NOT EXISTS idx_username ON users(username);";
     static constexpr const char* idxRecipientDelivered =
         "CREATE INDEX IF NOT EXISTS idx_recipient_delivered ON messages(recipient_id, delivered);";
     static constexpr const char* idxSenderTimestamp =
         "CREATE INDEX IF NOT EXISTS idx_sender_timestamp ON messages(sender_id, timestamp);";
+    static constexpr const char* idxMemberUser =
+        "CREATE INDEX IF NOT EXISTS idx_group_member_user ON group_members(user_id);";
+    static constexpr const char* idxGroupMessages =
+        "CREATE INDEX IF NOT EXISTS idx_group_messages_group ON group_messages(group_id, id);";
 
+    // token_epoch: resume tokens carrying a lower epoch are revoked
     return exec(dbHandle, usersSql)
+        && addColumnIfMissing(dbHandle, "users", "token_epoch", "INTEGER NOT NULL DEFAULT 0")
         && exec(dbHandle, messagesSql)
         && exec(dbHandle, logsSql)
         && exec(dbHandle, configSql)
+        && exec(dbHandle, groupsSql)
+        && exec(dbHandle, groupMembersSql)
+        && exec(dbHandle, groupMessagesSql)
         && exec(dbHandle, idxUsername)
         && exec(dbHandle, idxRecipientDelivered)
-        && exec(dbHandle, idxSenderTimestamp);
+        && exec(dbHandle, idxSenderTimestamp)
+        && exec(dbHandle, idxMemberUser)
+        && exec(dbHandle, idxGroupMessages);
+}
+
+Database::ConnectionLock::ConnectionLock(const Database& db) noexcept
+    : database(db)
+{
+    pthread_mutex_lock(&database.connectionMutex);
+}
+
+Database::ConnectionLock::~ConnectionLock()
+{
+    pthread_mutex_unlock(&database.connectionMutex);
+}
+
+Database::Transaction::Transaction(Database& db)
+    : database(db)
+    , open(false)
+{
+    pthread_mutex_lock(&database.connectionMutex);
+    open = database.dbHandle && exec(database.dbHandle, "BEGIN IMMEDIATE;");
+}
+
+Database::Transaction::~Transaction()
+{
+    if (open) {
+        exec(database.dbHandle, "ROLLBACK;");
+    }
+    pthread_mutex_unlock(&database.connectionMutex);
+}
+
+// Without a BEGIN every statement already committed on its own.
+bool Database::Transaction::commit()
+{
+    if (!open) {
+        return database.dbHandle != nullptr;
+    }
+    open = false;
+    if (exec(database.dbHandle, "COMMIT;")) {
+        return true;
+    }
+    exec(database.dbHandle, "ROLLBACK;");
+    return false;
 }
 
 Database::StatementGuard::StatementGuard(const Database& db, sqlite3_stmt* stmt) noexcept
@@ -542,6 +1074,22 @@ void Database::finalizeStatements()
     finalize(conversationStmt);
     finalize(markDeliveredStmt);
     finalize(logActivityStmt);
+    finalize(updatePasswordStmt);
+    finalize(loadHashParamsStmt);
+    finalize(storeHashParamsStmt);
+    finalize(createGroupStmt);
+    finalize(findGroupIdStmt);
+    finalize(groupMemberStmt);
+    finalize(joinGroupStmt);
+    finalize(leaveGroupStmt);
+    finalize(groupMembersStmt);
+    finalize(insertGroupMessageStmt);
+    finalize(queuedGroupMessagesStmt);
+    finalize(advanceGroupCursorStmt);
+    finalize(setGroupCursorStmt);
+    finalize(tokenEpochStmt);
+    finalize(raiseTokenEpochStmt);
+    finalize(revokeTokensStmt);
 }
 
 void Database::teardown()
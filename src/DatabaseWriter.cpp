@@ -0,0 +1,181 @@
+#include "DatabaseWriter.h"
+#include "DatabaseEngine.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace {
+timespec monotonicNow()
+{
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+timespec addMicros(timespec ts, unsigned micros)
+{
+    ts.tv_sec += micros / 1000000;
+    ts.tv_nsec += static_cast<long>(micros % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+} // namespace
+
+DatabaseWriter::DatabaseWriter(Database& db, std::size_t batchLimit, unsigned delayMicros)
+    : database(db)
+    , maxBatch(batchLimit > 0 ? batchLimit : 1)
+    , maxDelayMicros(delayMicros)
+{
+    pthread_mutex_init(&queueMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queueCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+    stop();
+    pthread_cond_destroy(&queueCond);
+    pthread_mutex_destroy(&queueMutex);
+}
+
+bool DatabaseWriter::start()
+{
+    pthread_mutex_lock(&queueMutex);
+    if (running) {
+        pthread_mutex_unlock(&queueMutex);
+        return true;
+    }
+    running = true;
+    const int created = pthread_create(&threadHandle, nullptr, &DatabaseWriter::threadEntry, this);
+    if (created != 0) {
+        running = false;
+        threadHandle = 0;
+    }
+    pthread_mutex_unlock(&queueMutex);
+
+    if (created != 0) {
+        std::cerr << "[DbWriter] pthread_create: " << std::strerror(created) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void DatabaseWriter::stop()
+{
+    pthread_mutex_lock(&queueMutex);
+    const bool wasRunning = running;
+    running = false;
+    pthread_cond_signal(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+
+    if (wasRunning) {
+        pthread_join(threadHandle, nullptr);
+        threadHandle = 0;
+    }
+}
+
+// Only the pushes that start a batch or fill one need to wake the thread;
+// in between it sleeps until the oldest job's deadline.
+void DatabaseWriter::submit(Job job, Completion done)
+{
+    pthread_mutex_lock(&queueMutex);
+    if (!running) {
+        pthread_mutex_unlock(&queueMutex);
+        std::vector<Entry> batch;
+        batch.push_back(Entry{std::move(job), std::move(done)});
+        runBatch(batch);
+        return;
+    }
+    if (queue.empty()) {
+        oldestQueuedAt = monotonicNow();
+    }
+    queue.push_back(Entry{std::move(job), std::move(done)});
+    if (queue.size() == 1 || queue.size() == maxBatch) {
+        pthread_cond_signal(&queueCond);
+    }
+    pthread_mutex_unlock(&queueMutex);
+}
+
+DatabaseWriter::Stats DatabaseWriter::stats() const
+{
+    return Stats{jobCount.load(std::memory_order_relaxed),
+                 batchCount.load(std::memory_order_relaxed),
+                 failedCount.load(std::memory_order_relaxed)};
+}
+
+void* DatabaseWriter::threadEntry(void* arg)
+{
+    auto* writer = static_cast<DatabaseWriter*>(arg);
+    writer->writerLoop();
+    return nullptr;
+}
+
+void DatabaseWriter::writerLoop()
+{
+    std::vector<Entry> batch;
+
+    pthread_mutex_lock(&queueMutex);
+    for (;;) {
+        while (queue.empty() && running) {
+            pthread_cond_wait(&queueCond, &queueMutex);
+        }
+        if (queue.empty()) {
+            break; // stopped and drained
+        }
+
+        const timespec deadline = addMicros(oldestQueuedAt, maxDelayMicros);
+        while (running && queue.size() < maxBatch) {
+            if (pthread_cond_timedwait(&queueCond, &queueMutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        batch.swap(queue);
+        pthread_mutex_unlock(&queueMutex);
+        runBatch(batch);
+        batch.clear();
+        pthread_mutex_lock(&queueMutex);
+    }
+    pthread_mutex_unlock(&queueMutex);
+}
+
+// Completions run after the transaction has ended, so one that submits a
+// follow-up job (which may run inline) never nests a BEGIN.
+void DatabaseWriter::runBatch(std::vector<Entry>& batch)
+{
+    std::vector<char> succeeded(batch.size(), 0);
+    bool committed = false;
+    {
+        Database::Transaction transaction(database);
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            succeeded[i] = batch[i].job(database) ? 1 : 0;
+        }
+        committed = transaction.commit();
+    }
+    if (!committed) {
+        std::cerr << "[DbWriter] Commit of " << batch.size() << " job(s) failed" << std::endl;
+    }
+
+    uint64_t failed = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        const bool ok = committed && succeeded[i];
+        if (!ok) {
+            ++failed;
+        }
+        if (batch[i].done) {
+            batch[i].done(ok);
+        }
+    }
+
+    jobCount.fetch_add(batch.size(), std::memory_order_relaxed);
+    batchCount.fetch_add(1, std::memory_order_relaxed);
+    failedCount.fetch_add(failed, std::memory_order_relaxed);
+}
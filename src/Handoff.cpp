@@ -0,0 +1,292 @@
+#include "Handoff.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+enum MessageType : char {
+    kListeners = 'L',
+    kReady = 'R',
+    kSession = 'S',
+    kChunk = 'C',
+    kDone = 'E',
+};
+
+constexpr std::size_t kMaxMessage = 64 * 1024;
+constexpr std::size_t kMaxChunk = 32 * 1024;
+constexpr std::size_t kMaxFds = 253; // SCM_MAX_FD
+constexpr std::size_t kSessionHeader = 1 + 1 + 3 * sizeof(uint32_t);
+
+bool fillAddress(const std::string& path, sockaddr_un& addr)
+{
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "handoff: bad socket path '%s'\n", path.c_str());
+        return false;
+    }
+    addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool sendMessage(int channel, const std::string& data, const int* fds, std::size_t fdCount)
+{
+    if (fdCount > kMaxFds) {
+        return false;
+    }
+
+    iovec iov{};
+    iov.iov_base = const_cast<char*>(data.data());
+    iov.iov_len = data.size();
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * std::max<std::size_t>(fdCount, 1)));
+    if (fdCount > 0) {
+        message.msg_control = control.data();
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+        std::memcpy(CMSG_DATA(header), fds, sizeof(int) * fdCount);
+    }
+
+    while (true) {
+        const ssize_t sent = ::sendmsg(channel, &message, MSG_NOSIGNAL);
+        if (sent == static_cast<ssize_t>(data.size())) {
+            return true;
+        }
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        std::perror("handoff sendmsg");
+        return false;
+    }
+}
+
+// Received fds are close-on-exec and owned by the caller, also on failure.
+bool recvMessage(int channel, std::string& data, std::vector<int>& fds)
+{
+    data.resize(kMaxMessage);
+    iovec iov{};
+    iov.iov_base = data.data();
+    iov.iov_len = data.size();
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    ssize_t received = -1;
+    do {
+        received = ::recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+    } while (received == -1 && errno == EINTR);
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            const std::size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const auto* incoming = reinterpret_cast<const int*>(CMSG_DATA(header));
+            fds.insert(fds.end(), incoming, incoming + count);
+        }
+    }
+
+    if (received <= 0 || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+        if (received == -1) {
+            std::perror("handoff recvmsg");
+        }
+        return false;
+    }
+    data.resize(static_cast<std::size_t>(received));
+    return true;
+}
+
+void closeAll(std::vector<int>& fds)
+{
+    for (const int fd : fds) {
+        ::close(fd);
+    }
+    fds.clear();
+}
+
+void putU32(std::string& out, uint32_t value)
+{
+    const uint32_t netOrder = htonl(value);
+    out.append(reinterpret_cast<const char*>(&netOrder), sizeof(netOrder));
+}
+
+uint32_t getU32(const std::string& in, std::size_t offset)
+{
+    uint32_t netOrder = 0;
+    std::memcpy(&netOrder, in.data() + offset, sizeof(netOrder));
+    return ntohl(netOrder);
+}
+
+bool expectSignal(int channel, MessageType type)
+{
+    std::string data;
+    std::vector<int> fds;
+    const bool ok = recvMessage(channel, data, fds) && data.size() == 1 && data[0] == type;
+    closeAll(fds);
+    return ok;
+}
+} // namespace
+
+namespace handoff {
+
+int listen(const std::string& path)
+{
+    sockaddr_un addr{};
+    if (!fillAddress(path, addr)) {
+        return -1;
+    }
+
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        std::perror("handoff socket");
+        return -1;
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1
+        || ::listen(fd, 1) == -1) {
+        std::perror("handoff bind");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connect(const std::string& path)
+{
+    sockaddr_un addr{};
+    if (!fillAddress(path, addr)) {
+        return -1;
+    }
+
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        std::perror("handoff socket");
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        std::perror("handoff connect");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendListeners(int channel, const std::vector<int>& fds)
+{
+    return !fds.empty() && sendMessage(channel, std::string(1, kListeners), fds.data(), fds.size());
+}
+
+bool recvListeners(int channel, std::vector<int>& fds)
+{
+    std::string data;
+    if (!recvMessage(channel, data, fds) || data.size() != 1 || data[0] != kListeners || fds.empty()) {
+        closeAll(fds);
+        return false;
+    }
+    return true;
+}
+
+bool sendReady(int channel)
+{
+    return sendMessage(channel, std::string(1, kReady), nullptr, 0);
+}
+
+bool recvReady(int channel)
+{
+    return expectSignal(channel, kReady);
+}
+
+bool sendSession(int channel, const SessionHandoff& session)
+{
+    std::string header(1, kSession);
+    header.push_back(session.authenticated ? 1 : 0);
+    putU32(header, static_cast<uint32_t>(session.username.size()));
+    putU32(header, static_cast<uint32_t>(session.recvPending.size()));
+    putU32(header, static_cast<uint32_t>(session.sendPending.size()));
+    header += session.username;
+    if (!sendMessage(channel, header, &session.fd, 1)) {
+        return false;
+    }
+
+    // Buffers follow as chunks: recvPending first, then sendPending.
+    for (const std::string* blob : {&session.recvPending, &session.sendPending}) {
+        for (std::size_t offset = 0; offset < blob->size(); offset += kMaxChunk) {
+            std::string chunk(1, kChunk);
+            chunk.append(*blob, offset, kMaxChunk);
+            if (!sendMessage(channel, chunk, nullptr, 0)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool sendDone(int channel)
+{
+    return sendMessage(channel, std::string(1, kDone), nullptr, 0);
+}
+
+bool recvSession(int channel, SessionHandoff& session, bool& done)
+{
+    done = false;
+    std::string data;
+    std::vector<int> fds;
+    if (!recvMessage(channel, data, fds)) {
+        closeAll(fds);
+        return false;
+    }
+    if (data.size() == 1 && data[0] == kDone) {
+        closeAll(fds);
+        done = true;
+        return false;
+    }
+    if (data.size() < kSessionHeader || data[0] != kSession || fds.size() != 1) {
+        closeAll(fds);
+        return false;
+    }
+
+    const uint32_t nameSize = getU32(data, 2);
+    const uint32_t recvSize = getU32(data, 2 + sizeof(uint32_t));
+    const uint32_t sendSize = getU32(data, 2 + 2 * sizeof(uint32_t));
+    if (data.size() != kSessionHeader + nameSize) {
+        closeAll(fds);
+        return false;
+    }
+
+    session = SessionHandoff{};
+    session.fd = fds.front();
+    session.authenticated = data[1] != 0;
+    session.username = data.substr(kSessionHeader);
+
+    std::string buffers;
+    buffers.reserve(static_cast<std::size_t>(recvSize) + sendSize);
+    while (buffers.size() < static_cast<std::size_t>(recvSize) + sendSize) {
+        std::vector<int> stray;
+        if (!recvMessage(channel, data, stray) || data.empty() || data[0] != kChunk || !stray.empty()) {
+            closeAll(stray);
+            ::close(session.fd);
+            session.fd = -1;
+            return false;
+        }
+        buffers.append(data, 1, std::string::npos);
+    }
+    session.recvPending = buffers.substr(0, recvSize);
+    session.sendPending = buffers.substr(recvSize);
+    return true;
+}
+
+} // namespace handoff
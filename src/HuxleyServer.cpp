@@ -3,20 +3,33 @@
 #include "AuthManager.h"
 #include "ClientState.h"
 #include "CryptoEngine.h"
+#include "CpuAffinity.h"
 #include "DatabaseEngine.h"
+#include "DatabaseWriter.h"
+#include "Handoff.h"
 #include "MessageRouter.h"
 #include "ProtocolHandler.h"
 #include "StatusManager.h"
+#include "UserDirectory.h"
 #include "WorkerThread.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstring>
 #include <errno.h>
 #include <iostream>
+#include <random>
 #include <thread>
 
 namespace {
@@ -27,10 +40,123 @@ bool setReusable(int fd)
     int opt = 1;
     return ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == 0;
 }
+
+bool setReusePort(int fd)
+{
+    int opt = 1;
+    return ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == 0;
+}
+
+// Creates a bound, listening TCP socket. With reusePort set, the socket
+// joins the kernel's SO_REUSEPORT group for the port and is non-blocking so a
+// worker can drain it from its epoll loop. A dual-stack socket binds [::]
+// with IPV6_V6ONLY off, so IPv4 clients arrive on it as v4-mapped addresses;
+// on a kernel without IPv6 it falls back to plain IPv4.
+int openListenSocket(int port, bool reusePort, bool dualStack)
+{
+    const int type = reusePort ? SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC : SOCK_STREAM | SOCK_CLOEXEC;
+    int family = dualStack ? AF_INET6 : AF_INET;
+    int fd = ::socket(family, type, 0);
+    if (fd == -1 && family == AF_INET6 && errno == EAFNOSUPPORT) {
+        std::cerr << "IPv6 unavailable, listening on IPv4 only" << std::endl;
+        family = AF_INET;
+        fd = ::socket(family, type, 0);
+    }
+    if (fd == -1) {
+        std::perror("socket");
+        return -1;
+    }
+
+    int v6Only = 0;
+    if (!setReusable(fd) || (reusePort && !setReusePort(fd))
+        || (family == AF_INET6 && ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6Only, sizeof(v6Only)) != 0)) {
+        std::perror("setsockopt");
+        ::close(fd);
+        return -1;
+    }
+
+    sockaddr_storage storage{};
+    socklen_t addrLen = 0;
+    if (family == AF_INET6) {
+        auto* addr = reinterpret_cast<sockaddr_in6*>(&storage);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_addr = in6addr_any;
+        addr->sin6_port = htons(static_cast<uint16_t>(port));
+        addrLen = sizeof(sockaddr_in6);
+    } else {
+        auto* addr = reinterpret_cast<sockaddr_in*>(&storage);
+        addr->sin_family = AF_INET;
+        addr->sin_addr.s_addr = htonl(INADDR_ANY);
+        addr->sin_port = htons(static_cast<uint16_t>(port));
+        addrLen = sizeof(sockaddr_in);
+    }
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&storage), addrLen) == -1) {
+        std::perror("bind");
+        ::close(fd);
+        return -1;
+    }
+
+    if (::listen(fd, SOMAXCONN) == -1) {
+        std::perror("listen");
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Local clients skip the TCP stack entirely; framing is the same byte stream.
+// The socket is world-connectable: clients still have to log in.
+int openUnixListenSocket(const std::string& path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Unix socket path too long: " << path << std::endl;
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        std::perror("socket");
+        return -1;
+    }
+    ::unlink(path.c_str()); // stale file from a previous run
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1
+        || ::chmod(path.c_str(), 0666) == -1
+        || ::listen(fd, SOMAXCONN) == -1) {
+        std::perror("unix listener");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int socketFamily(int fd)
+{
+    int family = AF_UNSPEC;
+    socklen_t len = sizeof(family);
+    ::getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &family, &len);
+    return family;
+}
+
+void setNonBlocking(int fd)
+{
+    const int flags = ::fcntl(fd, F_GETFL, 0);
+    ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
 } // namespace
 
 HuxleyServer::HuxleyServer()
-    : listenFd(-1)
+    : HuxleyServer(ServerConfig{})
+{
+}
+
+HuxleyServer::HuxleyServer(const ServerConfig& serverConfig)
+    : config(serverConfig)
+    , listenFd(-1)
     , running(false)
     , acceptThread(0)
     , queueMutex()
@@ -44,7 +170,7 @@ HuxleyServer::HuxleyServer()
     , protocolHandler()
     , database()
     , databasePath(kDefaultDatabasePath)
-    , nextWorkerIndex(0)
+    , placementRng(std::random_device{}() | 1u)
 {
     pthread_mutex_init(&queueMutex, nullptr);
     pthread_cond_init(&queueCond, nullptr);
@@ -63,22 +189,78 @@ bool HuxleyServer::start(int port)
         return true;
     }
 
+    if (config.takeover && receiveListeners() == -1) {
+        std::cerr << "[takeover] no running server on " << config.upgradeSocketPath << ", starting fresh" << std::endl;
+    }
+
+    const auto abortStart = [this]() {
+        for (const int fd : inheritedListeners) {
+            ::close(fd);
+        }
+        inheritedListeners.clear();
+        if (takeoverChannel != -1) {
+            ::close(takeoverChannel); // the old server sees no Ready and keeps serving
+            takeoverChannel = -1;
+        }
+    };
+
     if (!initializeServices(port)) {
+        abortStart();
         return false;
     }
 
-    const auto hardwareThreads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
-    startWorkerPool(hardwareThreads);
+    // Locked before the workers exist so their stacks are resident from the start.
+    if (config.lockMemory && ::mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        std::perror("mlockall");
+    }
 
-    running.store(true);
-    if (pthread_create(&acceptThread, nullptr, &HuxleyServer::acceptThreadEntry, this) != 0) {
-        std::perror("pthread_create");
-        running.store(false);
+    std::size_t workerCount = config.workerCount;
+    if (workerCount == 0) {
+        workerCount = config.workerCpus.empty()
+            ? std::max<std::size_t>(1, std::thread::hardware_concurrency())
+            : config.workerCpus.size();
+    }
+    if (!startWorkerPool(workerCount, port)) {
+        abortStart();
         stopWorkerPool();
         shutdownServices();
         return false;
     }
 
+    running.store(true);
+    isolateServiceThreads();
+    // Before the accept thread exists: pickWorker() is single-threaded.
+    if (takeoverChannel != -1) {
+        completeTakeover();
+    }
+
+    // In ReusePort mode workers accept TCP on their own listeners; the accept
+    // thread is then only needed for the Unix socket.
+    if (listenFd != -1 || unixListenFd != -1) {
+        acceptWakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (acceptWakeFd == -1 || pthread_create(&acceptThread, nullptr, &HuxleyServer::acceptThreadEntry, this) != 0) {
+            std::perror("accept thread");
+            acceptThread = 0;
+            running.store(false);
+            stopAccepting();
+            stopWorkerPool();
+            shutdownServices();
+            return false;
+        }
+    }
+
+    if (!config.upgradeSocketPath.empty()) {
+        upgradeFd = handoff::listen(config.upgradeSocketPath);
+        if (upgradeFd == -1 || pthread_create(&upgradeThread, nullptr, &HuxleyServer::upgradeThreadEntry, this) != 0) {
+            std::cerr << "Hot restart unavailable on " << config.upgradeSocketPath << std::endl;
+            upgradeThread = 0;
+            if (upgradeFd != -1) {
+                ::close(upgradeFd);
+                upgradeFd = -1;
+            }
+        }
+    }
+
     statusManager->setState(StatusManager::State::Operational);
     return true;
 }
@@ -89,15 +271,29 @@ void HuxleyServer::stop()
         return;
     }
 
+    if (upgradeThread) {
+        ::shutdown(upgradeFd, SHUT_RDWR); // wakes the blocked accept
+        pthread_join(upgradeThread, nullptr);
+        upgradeThread = 0;
+    }
+    if (upgradeFd != -1) {
+        ::close(upgradeFd);
+        upgradeFd = -1;
+    }
+
+    // Close without shutdown(): after a hot restart the successor is still
+    // accepting on the same socket.
+    stopAccepting();
     if (listenFd != -1) {
-        ::shutdown(listenFd, SHUT_RDWR);
         ::close(listenFd);
         listenFd = -1;
     }
-
-    if (acceptThread) {
-        pthread_join(acceptThread, nullptr);
-        acceptThread = 0;
+    if (unixListenFd != -1) {
+        ::close(unixListenFd);
+        unixListenFd = -1;
+        if (!handedOff()) {
+            ::unlink(config.unixSocketPath.c_str());
+        }
     }
 
     pthread_mutex_lock(&queueMutex);
@@ -107,6 +303,14 @@ void HuxleyServer::stop()
     }
     pthread_mutex_unlock(&queueMutex);
 
+    // Completions post to the workers, so stop the auth pool and drain the
+    // writer while they exist; anything submitted after this runs inline.
+    if (authManager) {
+        authManager->stopPool();
+    }
+    if (databaseWriter) {
+        databaseWriter->stop();
+    }
     stopWorkerPool();
     shutdownServices();
 }
@@ -120,63 +324,141 @@ bool HuxleyServer::initializeServices(int port)
         return false;
     }
 
+    databaseWriter = std::make_unique<DatabaseWriter>(*database, config.dbBatchOps, config.dbBatchMicros);
+    if (!databaseWriter->start()) {
+        std::cerr << "Database writer thread failed to start, writing inline" << std::endl;
+    }
+
+    userDirectory = std::make_unique<UserDirectory>(*database);
+    // A predecessor keeps registering users until it sees Ready.
+    std::cout << "User directory: " << userDirectory->load(takeoverChannel == -1) << " user(s)" << std::endl;
+
     cryptoEngine = std::make_unique<CryptoEngine>();
     protocolHandler = std::make_unique<ProtocolHandler>();
     statusManager = std::make_unique<StatusManager>();
-    authManager = std::make_unique<AuthManager>(*database);
-    messageRouter = std::make_unique<MessageRouter>(*database, *cryptoEngine);
-
-    listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (listenFd == -1) {
-        std::perror("socket");
-        return false;
+    authManager = std::make_unique<AuthManager>(*database, userDirectory.get());
+    try {
+        const AuthManager::HashCost cost =
+            authManager->loadHashCost(config.hashTargetMillis, config.hashMemoryBytes, config.recalibrateHash);
+        std::cout << "Argon2id cost: t=" << cost.iterations << ", m=" << cost.memoryBytes / (1024 * 1024) << " MiB"
+                  << std::endl;
+    } catch (const std::exception& ex) {
+        std::cerr << "Hash calibration failed, using the interactive cost: " << ex.what() << std::endl;
     }
-
-    int n = setReusable(listenFd);
-    if (n == 0) {
-        std::perror("setsockopt");
-        ::close(listenFd);
-        listenFd = -1;
-        return false;
+    authManager->setMemoryBudget(config.authMemoryBudget);
+    if (config.authThreads > 0 && !authManager->startPool(config.authThreads, config.authQueueLimit)) {
+        std::cerr << "Auth pool failed to start, hashing on the workers" << std::endl;
     }
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(static_cast<uint16_t>(port));
-
-    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
-        std::perror("bind");
-        ::close(listenFd);
-        listenFd = -1;
-        return false;
+    messageRouter = std::make_unique<MessageRouter>(*database, *databaseWriter, *userDirectory, *cryptoEngine, config.slowConsumerPolicy);
+    admissionControl = std::make_unique<AdmissionControl>(config, *protocolHandler);
+
+    // In ReusePort mode each worker opens its own listener in startWorkerPool.
+    if (config.acceptMode == ServerConfig::AcceptMode::SharedQueue) {
+        listenFd = takeInheritedListener(false);
+        if (listenFd == -1) {
+            listenFd = openListenSocket(port, false, config.dualStack);
+        }
+        if (listenFd == -1) {
+            return false;
+        }
+        setNonBlocking(listenFd); // the accept thread polls, and may share it with a predecessor
     }
 
-    if (::listen(listenFd, SOMAXCONN) == -1) {
-        std::perror("listen");
-        ::close(listenFd);
-        listenFd = -1;
-        return false;
+    if (!config.unixSocketPath.empty()) {
+        unixListenFd = takeInheritedListener(true);
+        if (unixListenFd == -1) {
+            unixListenFd = openUnixListenSocket(config.unixSocketPath);
+        }
+        if (unixListenFd == -1) {
+            return false;
+        }
+        setNonBlocking(unixListenFd);
     }
 
     statusManager->setState(StatusManager::State::Booting);
     return true;
 }
 
-void HuxleyServer::startWorkerPool(std::size_t threadCount)
+bool HuxleyServer::startWorkerPool(std::size_t threadCount, int port)
 {
+    const bool reusePort = config.acceptMode == ServerConfig::AcceptMode::ReusePort;
+
     workerThreads.reserve(threadCount);
     for (std::size_t i = 0; i < threadCount; ++i) {
         auto worker = std::make_unique<WorkerThread>(static_cast<int>(i),
+                                 config,
                                  *authManager,
                                  *messageRouter,
                                  *protocolHandler,
                                  *statusManager,
                                  *database,
-                                 *cryptoEngine);
+                                 *cryptoEngine,
+                                 *admissionControl);
+        if (reusePort) {
+            int workerListenFd = takeInheritedListener(false);
+            if (workerListenFd == -1) {
+                workerListenFd = openListenSocket(port, true, config.dualStack);
+            }
+            if (workerListenFd == -1) {
+                return false;
+            }
+            setNonBlocking(workerListenFd);
+            worker->adoptListener(workerListenFd);
+        }
         worker->start();
         workerThreads.emplace_back(std::move(worker));
     }
+
+    // More listeners than we have a use for (the predecessor ran more
+    // workers, or the other accept mode); connections queued on them are lost.
+    for (const int fd : inheritedListeners) {
+        ::close(fd);
+    }
+    inheritedListeners.clear();
+    return true;
+}
+
+// Moves this thread, and with it the accept and upgrade threads it creates
+// afterwards, off the CPUs reserved for workers.
+void HuxleyServer::isolateServiceThreads()
+{
+    if (config.workerCpus.empty()) {
+        return;
+    }
+
+    cpu_set_t rest;
+    CPU_ZERO(&rest);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(rest), &rest) != 0) {
+        return;
+    }
+    for (const int cpu : config.workerCpus) {
+        CPU_CLR(cpu, &rest);
+    }
+    if (CPU_COUNT(&rest) == 0) {
+        std::cout << "[server] every CPU runs a worker; accept and housekeeping threads share them" << std::endl;
+        return;
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(rest), &rest) == 0) {
+        std::cout << "[server] accept and housekeeping threads on CPUs " << affinity::formatCpuSet(rest) << std::endl;
+    }
+}
+
+int HuxleyServer::takeInheritedListener(bool unixDomain)
+{
+    const auto it = std::find_if(inheritedListeners.begin(), inheritedListeners.end(), [unixDomain](int fd) {
+        return (socketFamily(fd) == AF_UNIX) == unixDomain;
+    });
+    if (it == inheritedListeners.end()) {
+        return -1;
+    }
+    const int fd = *it;
+    inheritedListeners.erase(it);
+    return fd;
+}
+
+AdmissionControl::Stats HuxleyServer::admissionStats() const
+{
+    return admissionControl ? admissionControl->stats() : AdmissionControl::Stats{};
 }
 
 void HuxleyServer::stopWorkerPool()
@@ -187,13 +469,27 @@ void HuxleyServer::stopWorkerPool()
         }
     }
     workerThreads.clear();
-    nextWorkerIndex = 0;
 }
 
 void HuxleyServer::shutdownServices()
 {
+    if (admissionControl) {
+        const AdmissionControl::Stats stats = admissionControl->stats();
+        std::cout << "[admission] admitted " << stats.admitted << ", shed "
+                  << stats.shedServerFull + stats.shedSourceFull + stats.shedRateLimited
+                  << " (server full " << stats.shedServerFull << ", per address " << stats.shedSourceFull
+                  << ", rate " << stats.shedRateLimited << ")" << std::endl;
+    }
+    admissionControl.reset();
     messageRouter.reset();
+    if (databaseWriter) {
+        const DatabaseWriter::Stats stats = databaseWriter->stats();
+        std::cout << "[db] " << stats.jobs << " write(s) in " << stats.batches << " commit(s), "
+                  << stats.failed << " failed" << std::endl;
+        databaseWriter.reset();
+    }
     authManager.reset();
+    userDirectory.reset();
     cryptoEngine.reset();
     protocolHandler.reset();
     statusManager.reset();
@@ -209,32 +505,77 @@ void* HuxleyServer::acceptThreadEntry(void* arg)
     return nullptr;
 }
 
+// Polls so stopAccepting() can end the loop through acceptWakeFd: shutting
+// the listeners down instead would also break them for a hot-restart successor.
 void HuxleyServer::acceptLoop()
 {
+    std::vector<pollfd> watched;
+    for (const int fd : {acceptWakeFd, listenFd, unixListenFd}) {
+        if (fd != -1) {
+            watched.push_back(pollfd{fd, POLLIN, 0});
+        }
+    }
+
     while (running.load()) {
-        sockaddr_in clientAddr{};
-        socklen_t addrLen = sizeof(clientAddr);
-        const int clientFd = ::accept(listenFd, reinterpret_cast<sockaddr*>(&clientAddr), &addrLen);
-        if (clientFd == -1) {
+        if (::poll(watched.data(), watched.size(), -1) == -1) {
             if (errno == EINTR) {
                 continue;
             }
-            if (!running.load()) {
-                break;
-            }
-            std::perror("accept");
-            continue;
+            std::perror("poll");
+            break;
+        }
+        if (watched[0].revents != 0) {
+            break;
         }
 
-        pthread_mutex_lock(&queueMutex);
-        socketQueue.push(clientFd);
-        pthread_mutex_unlock(&queueMutex);
-        pthread_cond_signal(&queueCond);
+        for (std::size_t i = 1; i < watched.size(); ++i) {
+            if (watched[i].revents == 0) {
+                continue;
+            }
+            while (true) {
+                sockaddr_storage peer{};
+                socklen_t peerLength = sizeof(peer);
+                const int clientFd = ::accept4(watched[i].fd, reinterpret_cast<sockaddr*>(&peer), &peerLength, SOCK_CLOEXEC);
+                if (clientFd == -1) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        std::perror("accept");
+                    }
+                    break;
+                }
+                const AdmissionControl::Verdict verdict = admissionControl->admit(clientFd, peer);
+                if (verdict != AdmissionControl::Verdict::Admitted) {
+                    admissionControl->reject(clientFd, verdict);
+                    continue;
+                }
+
+                pthread_mutex_lock(&queueMutex);
+                socketQueue.push(clientFd);
+                pthread_mutex_unlock(&queueMutex);
+                pthread_cond_signal(&queueCond);
+            }
+        }
 
         dispatchPendingClients();
     }
 }
 
+void HuxleyServer::stopAccepting()
+{
+    if (acceptThread) {
+        const uint64_t value = 1;
+        ::write(acceptWakeFd, &value, sizeof(value));
+        pthread_join(acceptThread, nullptr);
+        acceptThread = 0;
+    }
+    if (acceptWakeFd != -1) {
+        ::close(acceptWakeFd);
+        acceptWakeFd = -1;
+    }
+}
+
 void HuxleyServer::dispatchPendingClients()
 {
     while (true) {
@@ -252,12 +593,153 @@ void HuxleyServer::dispatchPendingClients()
         }
 
         if (workerThreads.empty()) {
+            admissionControl->release(clientFd);
             ::close(clientFd);
             continue;
         }
 
-        WorkerThread* worker = workerThreads[nextWorkerIndex].get();
-        nextWorkerIndex = (nextWorkerIndex + 1) % workerThreads.size();
-        worker->assignClient(clientFd);
+        pickWorker()->assignClient(clientFd);
+    }
+}
+
+// Power-of-two-choices placement: sample two distinct workers and hand the
+// socket to the one with the lower live load score. Cheap, needs no global
+// scan, and avoids herding every new client onto one momentarily idle worker.
+WorkerThread* HuxleyServer::pickWorker()
+{
+    const std::size_t count = workerThreads.size();
+    if (count == 1) {
+        return workerThreads.front().get();
+    }
+
+    // xorshift64; only the accept thread draws from it
+    const auto next = [this]() {
+        placementRng ^= placementRng << 13;
+        placementRng ^= placementRng >> 7;
+        placementRng ^= placementRng << 17;
+        return placementRng;
+    };
+
+    const std::size_t first = next() % count;
+    std::size_t second = next() % (count - 1);
+    if (second >= first) {
+        ++second;
+    }
+
+    WorkerThread* a = workerThreads[first].get();
+    WorkerThread* b = workerThreads[second].get();
+    return a->loadScore() <= b->loadScore() ? a : b;
+}
+
+/*
+Hot restart
+
+A successor started with --takeover connects to the running server's
+upgrade socket and gets its listening sockets first, so it can start its
+workers on them while the old process is still accepting. Once it reports
+Ready, the old process stops accepting, has every worker give up its
+connections, and streams them over with their buffers and login; the
+successor registers them as if they had just logged in. Nobody reconnects.
+*/
+int HuxleyServer::receiveListeners()
+{
+    const int channel = handoff::connect(config.upgradeSocketPath);
+    if (channel == -1) {
+        return -1;
+    }
+    if (!handoff::recvListeners(channel, inheritedListeners)) {
+        ::close(channel);
+        return -1;
+    }
+    takeoverChannel = channel;
+    return channel;
+}
+
+void HuxleyServer::completeTakeover()
+{
+    std::size_t adopted = 0;
+    bool done = false;
+    if (handoff::sendReady(takeoverChannel)) {
+        SessionHandoff session;
+        while (handoff::recvSession(takeoverChannel, session, done)) {
+            pickWorker()->adoptSession(std::move(session));
+            ++adopted;
+        }
+    }
+    if (!done) {
+        std::cerr << "[takeover] predecessor hung up before the handoff finished" << std::endl;
+    }
+    std::cout << "[takeover] adopted " << adopted << " connection(s)" << std::endl;
+    ::close(takeoverChannel);
+    takeoverChannel = -1;
+
+    // The predecessor has stopped accepting; pick up whoever it registered.
+    userDirectory->load();
+}
+
+void* HuxleyServer::upgradeThreadEntry(void* arg)
+{
+    auto* server = static_cast<HuxleyServer*>(arg);
+    server->upgradeLoop();
+    return nullptr;
+}
+
+void HuxleyServer::upgradeLoop()
+{
+    while (running.load()) {
+        const int channel = ::accept4(upgradeFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // shut down by stop()
+        }
+
+        const bool handedOver = handOffTo(channel);
+        ::close(channel);
+        if (handedOver) {
+            handoffComplete.store(true);
+            break;
+        }
+    }
+}
+
+// A successor that fails before Ready leaves this server running untouched.
+bool HuxleyServer::handOffTo(int channel)
+{
+    std::vector<int> listeners;
+    if (unixListenFd != -1) {
+        listeners.push_back(unixListenFd);
+    }
+    if (config.acceptMode == ServerConfig::AcceptMode::SharedQueue) {
+        if (listenFd != -1) {
+            listeners.push_back(listenFd);
+        }
+    } else {
+        for (const auto& worker : workerThreads) {
+            if (worker->listenerFd() != -1) {
+                listeners.push_back(worker->listenerFd());
+            }
+        }
+    }
+
+    if (!handoff::sendListeners(channel, listeners) || !handoff::recvReady(channel)) {
+        std::cerr << "[upgrade] successor did not come up, still serving" << std::endl;
+        return false;
     }
+
+    stopAccepting();
+    std::size_t migrated = 0;
+    for (const auto& worker : workerThreads) {
+        for (const SessionHandoff& session : worker->detachForHandoff(config.migrateClients)) {
+            if (handoff::sendSession(channel, session)) {
+                ++migrated;
+            }
+            ::close(session.fd);
+        }
+    }
+    handoff::sendDone(channel);
+
+    database->logActivity("INFO", "Hot restart: handed " + std::to_string(migrated) + " connection(s) to successor");
+    return true;
 }
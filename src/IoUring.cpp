@@ -0,0 +1,333 @@
+#include "IoUring.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Builds against kernel uapi headers >= 6.1; at runtime init()/probe fail
+// cleanly on older kernels and the worker stays on epoll.
+namespace {
+int uringSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int uringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+void* mapRing(int fd, std::size_t size, off_t offset)
+{
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+template <typename T>
+T* ringField(void* base, unsigned offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+} // namespace
+
+IoUring::IoUring()
+    : ringFd(-1)
+    , sqRingPtr(nullptr)
+    , sqRingSize(0)
+    , cqRingPtr(nullptr)
+    , cqRingSize(0)
+    , sqes(nullptr)
+    , sqesSize(0)
+    , sqHead(nullptr)
+    , sqTail(nullptr)
+    , sqMask(0)
+    , sqEntries(0)
+    , sqLocalTail(0)
+    , cqHead(nullptr)
+    , cqTail(nullptr)
+    , cqMask(0)
+    , cqes(nullptr)
+    , bufRingPtr(nullptr)
+    , bufRingSize(0)
+    , bufRingTail(nullptr)
+    , bufRingMask(0)
+    , bufPool(nullptr)
+    , bufCount(0)
+    , bufSize(0)
+    , bufGroup(0)
+    , bufRegistered(false)
+{
+}
+
+IoUring::~IoUring()
+{
+    teardown();
+}
+
+bool IoUring::init(unsigned entries)
+{
+    if (ringFd != -1) {
+        return false;
+    }
+
+    // Prefer deferred task running (6.1+): completions are only processed
+    // when we ask for them, which suits a loop that always waits in enter().
+    static constexpr unsigned kFlagSets[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_COOP_TASKRUN,
+        0,
+    };
+
+    io_uring_params params{};
+    for (const unsigned flags : kFlagSets) {
+        std::memset(&params, 0, sizeof(params));
+        params.flags = flags;
+        ringFd = uringSetup(entries, &params);
+        if (ringFd >= 0) {
+            break;
+        }
+        if (errno == ENOSYS || errno == EPERM) {
+            return false; // kernel without io_uring, or disabled by sysctl/seccomp
+        }
+    }
+    if (ringFd < 0) {
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRingPtr = mapRing(ringFd, sqRingSize, IORING_OFF_SQ_RING);
+    cqRingPtr = singleMmap ? sqRingPtr : mapRing(ringFd, cqRingSize, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mapRing(ringFd, sqesSize, IORING_OFF_SQES));
+    if (!sqRingPtr || !cqRingPtr || !sqes) {
+        std::perror("io_uring mmap");
+        teardown();
+        return false;
+    }
+
+    sqHead = ringField<unsigned>(sqRingPtr, params.sq_off.head);
+    sqTail = ringField<unsigned>(sqRingPtr, params.sq_off.tail);
+    sqMask = *ringField<unsigned>(sqRingPtr, params.sq_off.ring_mask);
+    sqEntries = *ringField<unsigned>(sqRingPtr, params.sq_off.ring_entries);
+    sqLocalTail = *sqTail;
+
+    // Identity-map the indirection array once; SQEs are used in ring order.
+    unsigned* sqArray = ringField<unsigned>(sqRingPtr, params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; ++i) {
+        sqArray[i] = i;
+    }
+
+    cqHead = ringField<unsigned>(cqRingPtr, params.cq_off.head);
+    cqTail = ringField<unsigned>(cqRingPtr, params.cq_off.tail);
+    cqMask = *ringField<unsigned>(cqRingPtr, params.cq_off.ring_mask);
+    cqes = ringField<io_uring_cqe>(cqRingPtr, params.cq_off.cqes);
+    return true;
+}
+
+bool IoUring::setupBufferRing(uint16_t groupId, unsigned count, unsigned bufferSize)
+{
+    if (ringFd == -1 || bufRegistered || count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+        return false;
+    }
+
+    bufRingSize = count * sizeof(io_uring_buf);
+    void* ringMem = ::mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ringMem == MAP_FAILED) {
+        return false;
+    }
+    bufRingPtr = ringMem;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRingPtr);
+    reg.ring_entries = count;
+    reg.bgid = groupId;
+    if (uringRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        ::munmap(bufRingPtr, bufRingSize);
+        bufRingPtr = nullptr;
+        return false;
+    }
+    bufRegistered = true;
+
+    bufPool = static_cast<char*>(std::aligned_alloc(64, static_cast<std::size_t>(count) * bufferSize));
+    if (!bufPool) {
+        return false;
+    }
+
+    // The ring tail shares storage with the first entry's reserved field.
+    auto* bufs = static_cast<io_uring_buf*>(bufRingPtr);
+    bufRingTail = &bufs[0].resv;
+    bufRingMask = count - 1;
+    bufCount = count;
+    bufSize = bufferSize;
+    bufGroup = groupId;
+
+    for (unsigned i = 0; i < count; ++i) {
+        recycleBuffer(static_cast<uint16_t>(i));
+    }
+    return true;
+}
+
+bool IoUring::probeMultishotRecv()
+{
+    if (!bufRegistered) {
+        return false;
+    }
+
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+        return false;
+    }
+
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        ::close(pair[0]);
+        ::close(pair[1]);
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = pair[0];
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufGroup;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = 1;
+
+    const char probe = 'p';
+    ::write(pair[1], &probe, 1);
+    ::close(pair[1]); // EOF ends the multishot after the first byte
+
+    bool sawData = false;
+    bool finished = false;
+    for (int attempts = 0; attempts < 4 && !finished; ++attempts) {
+        if (submit(1) < 0 && errno != EINTR) {
+            break;
+        }
+        drainCompletions([&](const io_uring_cqe& cqe) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            if (cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE)) {
+                sawData = true;
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                finished = true;
+            }
+        });
+    }
+
+    ::close(pair[0]);
+    return sawData && finished;
+}
+
+io_uring_sqe* IoUring::nextSqe()
+{
+    if (ringFd == -1) {
+        return nullptr;
+    }
+
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqLocalTail - head >= sqEntries) {
+        submit(0);
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqLocalTail - head >= sqEntries) {
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sqLocalTail;
+    return sqe;
+}
+
+unsigned IoUring::reserveSqes(unsigned wanted)
+{
+    if (ringFd == -1) {
+        return 0;
+    }
+
+    unsigned space = sqEntries - (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+    if (space < wanted) {
+        submit(0);
+        space = sqEntries - (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+    }
+    return std::min(space, wanted);
+}
+
+int IoUring::submit(unsigned waitFor)
+{
+    const unsigned published = *sqTail;
+    const unsigned toSubmit = sqLocalTail - published;
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+    if (toSubmit == 0 && waitFor == 0) {
+        return 0;
+    }
+    const unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return uringEnter(ringFd, toSubmit, waitFor, flags);
+}
+
+char* IoUring::providedBuffer(uint16_t bufferId) const
+{
+    return bufPool + static_cast<std::size_t>(bufferId) * bufSize;
+}
+
+void IoUring::recycleBuffer(uint16_t bufferId)
+{
+    auto* bufs = static_cast<io_uring_buf*>(bufRingPtr);
+    const uint16_t tail = *bufRingTail;
+    io_uring_buf& slot = bufs[tail & bufRingMask];
+    slot.addr = reinterpret_cast<uint64_t>(providedBuffer(bufferId));
+    slot.len = bufSize;
+    slot.bid = bufferId;
+    __atomic_store_n(bufRingTail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+void IoUring::teardown()
+{
+    if (ringFd != -1) {
+        if (bufRegistered) {
+            io_uring_buf_reg reg{};
+            reg.bgid = bufGroup;
+            uringRegister(ringFd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            bufRegistered = false;
+        }
+        ::close(ringFd);
+        ringFd = -1;
+    }
+    if (sqes) {
+        ::munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if (cqRingPtr && cqRingPtr != sqRingPtr) {
+        ::munmap(cqRingPtr, cqRingSize);
+    }
+    cqRingPtr = nullptr;
+    if (sqRingPtr) {
+        ::munmap(sqRingPtr, sqRingSize);
+        sqRingPtr = nullptr;
+    }
+    if (bufRingPtr) {
+        ::munmap(bufRingPtr, bufRingSize);
+        bufRingPtr = nullptr;
+    }
+    std::free(bufPool);
+    bufPool = nullptr;
+}
@@ -3,59 +3,143 @@
 #include "../include/DatabaseEngine.h"
 
 #include <chrono>
+#include <functional>
 #include <ctime>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 
 MessageRouter::MessageRouter(Database& db,
-                             CryptoEngine& crypto)
+                             DatabaseWriter& writer,
+                             UserDirectory& directory,
+                             CryptoEngine& crypto,
+                             ServerConfig::SlowConsumerPolicy policy)
     : database(db)
+    , databaseWriter(writer)
     , cryptoEngine(crypto)
+    , slowConsumerPolicy(policy)
+    , users(directory)
 {
-    pthread_mutex_init(&clientsMutex, nullptr);
+    for (auto& shard : registry) {
+        pthread_rwlock_init(&shard.lock, nullptr);
+    }
 }
 
 MessageRouter::~MessageRouter()
 {
-    pthread_mutex_destroy(&clientsMutex);
+    for (auto& shard : registry) {
+        pthread_rwlock_destroy(&shard.lock);
+    }
 }
 
-bool MessageRouter::isRegistered(const std::string& username)
+MessageRouter::RegistryShard& MessageRouter::shardFor(int userId)
 {
-    pthread_mutex_lock(&clientsMutex);
-    const bool registered = activeClients.find(username) != activeClients.end();
-    pthread_mutex_unlock(&clientsMutex);
+    return registry[static_cast<unsigned>(userId) % kRegistryShards];
+}
+
+std::shared_ptr<ClientHandle> MessageRouter::findClient(int userId)
+{
+    RegistryShard& shard = shardFor(userId);
+    pthread_rwlock_rdlock(&shard.lock);
+    auto it = shard.clients.find(userId);
+    std::shared_ptr<ClientHandle> client = it != shard.clients.end() ? it->second.client : nullptr;
+    pthread_rwlock_unlock(&shard.lock);
+    return client;
+}
+
+bool MessageRouter::isRegistered(int userId)
+{
+    RegistryShard& shard = shardFor(userId);
+    pthread_rwlock_rdlock(&shard.lock);
+    const bool registered = shard.clients.find(userId) != shard.clients.end();
+    pthread_rwlock_unlock(&shard.lock);
     return registered;
 }
 
-void MessageRouter::registerClient(const std::string& username, ClientState* state)
+bool MessageRouter::registerClient(int userId, const std::string& username, std::shared_ptr<ClientHandle> client)
 {
-    pthread_mutex_lock(&clientsMutex);
-    activeClients[username] = state;
-    pthread_mutex_unlock(&clientsMutex);
+    RegistryShard& shard = shardFor(userId);
+    pthread_rwlock_wrlock(&shard.lock);
+    const bool inserted = shard.clients.emplace(userId, OnlineUser{username, std::move(client)}).second;
+    if (inserted) {
+        // under the shard lock, so a user's changes are logged in registry order
+        presenceLog.record(username, true);
+    }
+    pthread_rwlock_unlock(&shard.lock);
 
-    database.logActivity("INFO", "Client online: " + username);
+    if (inserted) {
+        users.remember(userId, username);
+        databaseWriter.submit([username](Database& db) {
+            return db.logActivity("INFO", "Client online: " + username);
+        });
+    }
+    return inserted;
 }
 
-void MessageRouter::unregisterClient(const std::string& username)
+void MessageRouter::unregisterClient(int userId)
 {
-    pthread_mutex_lock(&clientsMutex);
-    activeClients.erase(username);
-    pthread_mutex_unlock(&clientsMutex);
+    std::string username;
+    RegistryShard& shard = shardFor(userId);
+    pthread_rwlock_wrlock(&shard.lock);
+    auto it = shard.clients.find(userId);
+    if (it != shard.clients.end()) {
+        username = std::move(it->second.username);
+        shard.clients.erase(it);
+        presenceLog.record(username, false);
+    }
+    pthread_rwlock_unlock(&shard.lock);
 
-    database.logActivity("INFO", "Client offline: " + username);
+    if (!username.empty()) {
+        databaseWriter.submit([username](Database& db) {
+            return db.logActivity("INFO", "Client offline: " + username);
+        });
+    }
 }
 
+// Not a point-in-time snapshot: a user may log in or out while later shards
+// are read, which LIST_ONLINE never promised anyway.
 std::vector<std::string> MessageRouter::listActiveUsers()
 {
-    std::vector<std::string> users;
-    pthread_mutex_lock(&clientsMutex);
-    users.reserve(activeClients.size());
-    for (const auto& entry : activeClients) {
-        users.push_back(entry.first);
+    std::vector<std::string> online;
+    for (auto& shard : registry) {
+        pthread_rwlock_rdlock(&shard.lock);
+        online.reserve(online.size() + shard.clients.size());
+        for (const auto& entry : shard.clients) {
+            online.push_back(entry.second.username);
+        }
+        pthread_rwlock_unlock(&shard.lock);
+    }
+    return online;
+}
+
+std::vector<std::string> MessageRouter::listBackloggedUsers()
+{
+    std::vector<std::string> online;
+    for (auto& shard : registry) {
+        pthread_rwlock_rdlock(&shard.lock);
+        for (const auto& entry : shard.clients) {
+            if (entry.second.client->isBacklogged()) {
+                online.push_back(entry.second.username);
+            }
+        }
+        pthread_rwlock_unlock(&shard.lock);
     }
-    pthread_mutex_unlock(&clientsMutex);
-    return users;
+    return online;
+}
+
+// A recipient that closes meanwhile releases its waiters as it goes, and one
+// registering after that finds the handle no longer backlogged.
+bool MessageRouter::blockOnBackloggedRecipient(const std::string& recipient, ClientState& senderState)
+{
+    int recipientId = 0;
+    if (!users.resolve(recipient, recipientId)) {
+        return false;
+    }
+    const std::shared_ptr<ClientHandle> client = findClient(recipientId);
+    if (!client || client == senderState.handle() || !client->isBacklogged()) {
+        return false;
+    }
+    return client->addBlockedSender(senderState.handle()->asBlockedSender());
 }
 
 namespace {
@@ -78,48 +162,184 @@ std::string isoTimestampNow()
 }
 } // namespace
 
-bool MessageRouter::routeMessage(const std::string& sender,
+bool MessageRouter::routeMessage(int senderId,
+                                 const std::string& sender,
                                  const std::string& recipient,
-                                 const std::string& plaintext)
+                                 const std::string& plaintext,
+                                 DatabaseWriter::Completion onStored)
 {
-    const auto cipher = cryptoEngine.encryptMessage(plaintext);
-    int senderId = 0;
     int recipientId = 0;
 
-    // check users exist
-    if (!database.findUserId(sender, senderId) || !database.findUserId(recipient, recipientId)) {
-        database.logActivity("WARN", "Failed to persist message - unknown user");
+    // check recipient exists; the sender was resolved at login
+    if (!users.resolve(recipient, recipientId)) {
+        databaseWriter.submit([](Database& db) {
+            return db.logActivity("WARN", "Failed to persist message - unknown user");
+        });
         return false;
     }
 
-    // persist message in database
-    int messageId = 0;
-    if (!database.insertMessage(senderId, recipientId, cipher.ciphertext, cipher.nonce, messageId)) {
-        return false;
-    }
+    // persist message in database; the job fills in the id for the completion
+    auto cipher = std::make_shared<CryptoEngine::CipherMessage>(cryptoEngine.encryptMessage(plaintext));
+    auto messageId = std::make_shared<int>(0);
+    databaseWriter.submit(
+        [senderId, recipientId, cipher, messageId](Database& db) {
+            return db.insertMessage(senderId, recipientId, cipher->ciphertext, cipher->nonce, *messageId);
+        },
+        [this, sender, recipient, recipientId, plaintext, messageId, onStored = std::move(onStored)](bool stored) {
+            if (stored) {
+                deliverStored(sender, recipient, recipientId, plaintext, *messageId);
+            }
+            if (onStored) {
+                onStored(stored);
+            }
+        });
+    return true;
+}
+
+// Writer thread, after the insert committed. The message goes to the
+// recipient's worker, which confirms it once queued; if the connection is gone
+// by then it stays undelivered for the next login.
+void MessageRouter::deliverStored(const std::string& sender,
+                                  const std::string& recipient,
+                                  int recipientId,
+                                  const std::string& plaintext,
+                                  int messageId)
+{
+    const std::shared_ptr<ClientHandle> client = findClient(recipientId);
 
-    ClientState* recipientState = nullptr;
-    pthread_mutex_lock(&clientsMutex);
-    auto it = activeClients.find(recipient);
-    if (it != activeClients.end()) {
-        recipientState = it->second;
+    // user offline, message stored for later delivery
+    if (!client) {
+        return;
     }
-    pthread_mutex_unlock(&clientsMutex);
 
-    // user offline, message stored
-    if (!recipientState) {
-        return true; // Stored for later delivery.
+    // recipient can't keep up; its worker delivers from the store once it drains
+    if (slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::SpillOffline && client->isBacklogged()) {
+        databaseWriter.submit([sender, recipient](Database& db) {
+            return db.logActivity("INFO", "Recipient backlogged, stored for later delivery: " + sender + " -> " + recipient);
+        });
+        return;
     }
 
-    // user online, deliver in real-time
+    client->postMessage(IncomingMessage{sender, recipient, recipientId, plaintext, isoTimestampNow(), messageId, 0, nullptr});
+}
+
+void MessageRouter::routeGroupMessage(int senderId,
+                                      const std::string& sender,
+                                      int groupId,
+                                      const std::string& group,
+                                      const std::string& plaintext,
+                                      DatabaseWriter::Completion onStored)
+{
+    // one row and one encryption for the whole group; the member list is read
+    // in the same transaction, so a concurrent join either sees the message
+    // or has a cursor past it
+    auto cipher = std::make_shared<CryptoEngine::CipherMessage>(cryptoEngine.encryptMessage(plaintext));
+    auto messageId = std::make_shared<int>(0);
+    auto members = std::make_shared<std::vector<int>>();
+    databaseWriter.submit(
+        [groupId, senderId, cipher, messageId, members](Database& db) {
+            if (!db.insertGroupMessage(groupId, senderId, cipher->ciphertext, cipher->nonce, *messageId)) {
+                return false;
+            }
+            *members = db.groupMemberIds(groupId);
+            return true;
+        },
+        [this, senderId, sender, group, groupId, plaintext, messageId, members, onStored = std::move(onStored)](bool stored) {
+            if (stored) {
+                fanOutGroupMessage(senderId, sender, group, groupId, plaintext, *messageId, *members);
+            }
+            if (onStored) {
+                onStored(stored);
+            }
+        });
+}
+
+// Writer thread, after the insert committed. The notification is serialized
+// and framed once; every online member's worker queues the same buffer.
+// Members that are offline or backlogged catch up from their cursor.
+void MessageRouter::fanOutGroupMessage(int senderId,
+                                       const std::string& sender,
+                                       const std::string& group,
+                                       int groupId,
+                                       const std::string& plaintext,
+                                       int messageId,
+                                       const std::vector<int>& members)
+{
     const std::string timestamp = isoTimestampNow();
-    recipientState->queueIncomingMessage(sender, plaintext, timestamp, messageId);
-    if (!database.markDelivered(messageId)) {
-        database.logActivity("ERROR", "Realtime delivery persisted but markDelivered failed for message "
-                                         + std::to_string(messageId));
-        return false;
+    std::shared_ptr<const std::string> frame;
+
+    for (int memberId : members) {
+        if (memberId == senderId) {
+            continue;
+        }
+        const std::shared_ptr<ClientHandle> client = findClient(memberId);
+        if (!client) {
+            continue;
+        }
+        if (slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::SpillOffline && client->isBacklogged()) {
+            continue;
+        }
+        if (!frame) {
+            Response notification;
+            notification.command = "incoming_message";
+            notification.sender = sender;
+            notification.content = plaintext;
+            notification.timestamp = timestamp;
+            notification.id = messageId;
+            notification.group = group;
+            frame = std::make_shared<const std::string>(
+                ClientState::encodeFrame(protocolHandler.serializeResponse(notification)));
+        }
+        client->postMessage(IncomingMessage{sender, group, memberId, {}, timestamp, messageId, groupId, frame});
     }
+}
 
-    database.logActivity("INFO", "Queued realtime delivery: " + sender + " -> " + recipient);
-    return true;
+void MessageRouter::createGroup(int creatorId,
+                                const std::string& name,
+                                std::function<void(bool created, int groupId)> done)
+{
+    auto groupId = std::make_shared<int>(0);
+    databaseWriter.submit(
+        [creatorId, name, groupId](Database& db) {
+            return db.createGroup(name, creatorId, *groupId);
+        },
+        [groupId, done = std::move(done)](bool created) {
+            done(created, *groupId);
+        });
+}
+
+void MessageRouter::joinGroup(int userId, int groupId, DatabaseWriter::Completion done)
+{
+    databaseWriter.submit([userId, groupId](Database& db) { return db.joinGroup(groupId, userId); },
+                          std::move(done));
+}
+
+void MessageRouter::leaveGroup(int userId, int groupId, DatabaseWriter::Completion done)
+{
+    databaseWriter.submit([userId, groupId](Database& db) { return db.leaveGroup(groupId, userId); },
+                          std::move(done));
+}
+
+// user online, delivered in real-time
+void MessageRouter::confirmDelivered(const IncomingMessage& message)
+{
+    const int messageId = message.id;
+    if (message.groupId != 0) {
+        const int groupId = message.groupId;
+        const int memberId = message.recipientId;
+        databaseWriter.submit([groupId, memberId, messageId](Database& db) {
+            return db.advanceGroupCursor(groupId, memberId, messageId);
+        });
+        return;
+    }
+    const std::string sender = message.sender;
+    const std::string recipient = message.recipient;
+    databaseWriter.submit([sender, recipient, messageId](Database& db) {
+        if (!db.markDelivered(messageId)) {
+            db.logActivity("ERROR", "Realtime delivery persisted but markDelivered failed for message "
+                                       + std::to_string(messageId));
+            return false;
+        }
+        return db.logActivity("INFO", "Queued realtime delivery: " + sender + " -> " + recipient);
+    });
 }
@@ -3,28 +3,39 @@
 #include "ClientState.h"
 #include "CryptoEngine.h"
 #include "DatabaseEngine.h"
+#include "DatabaseWriter.h"
+#include "UserDirectory.h"
 
+#include <algorithm>
 #include <string>
+#include <utility>
+#include <vector>
 
-bool deliverOfflineMessages(Database& database,
-                            CryptoEngine& crypto,
-                            const std::string& username,
-                            ClientState& state)
+bool fetchOfflineMessages(Database& database,
+                          CryptoEngine& crypto,
+                          UserDirectory& users,
+                          const std::string& username,
+                          OfflineBatch& out,
+                          int afterId,
+                          const OfflineBatch* after)
 {
+    out.messages.clear();
+    out.lastId = afterId;
+    out.groupCursors.clear();
+
     int recipientId = 0;
-    if (!database.findUserId(username, recipientId)) {
+    if (!users.resolve(username, recipientId)) {
         database.logActivity("WARN", "Offline delivery aborted - unknown user " + username);
         return false;
     }
 
     auto messages = database.getQueuedMessages(recipientId);
-    if (messages.empty()) {
-        return true;
-    }
-
-    bool allMarkedDelivered = true;
-
     for (const auto& stored : messages) {
+        if (stored.id <= afterId) {
+            continue;
+        }
+        out.lastId = std::max(out.lastId, stored.id);
+
         CryptoEngine::CipherMessage cipher { stored.nonce, stored.ciphertext };
         std::string plaintext;
         if (!crypto.decryptMessage(cipher, plaintext)) {
@@ -33,26 +44,107 @@ bool deliverOfflineMessages(Database& database,
         }
 
         std::string senderName;
-        if (!database.findUsername(stored.senderId, senderName)) {
+        if (!users.nameOf(stored.senderId, senderName)) {
             senderName = "unknown";
         }
 
-        state.queueIncomingMessage(senderName, plaintext, stored.timestamp, stored.id);
-        if (!database.markDelivered(stored.id)) {
-            allMarkedDelivered = false;
-            database.logActivity("ERROR", "Failed to mark delivered for message " + std::to_string(stored.id)
-                                             + " (recipient: " + username + ")");
-        } else {
-            database.logActivity("INFO", "Delivered marked successfully");
+        out.messages.push_back({stored.id, std::move(senderName), std::move(plaintext), stored.timestamp, {}});
+    }
+
+    for (const auto& stored : database.getQueuedGroupMessages(recipientId)) {
+        if (after) {
+            auto seen = after->groupCursors.find(stored.groupId);
+            if (seen != after->groupCursors.end() && stored.id <= seen->second) {
+                continue;
+            }
+        }
+        int& cursor = out.groupCursors[stored.groupId];
+        cursor = std::max(cursor, stored.id);
+
+        CryptoEngine::CipherMessage cipher { stored.nonce, stored.ciphertext };
+        std::string plaintext;
+        if (!crypto.decryptMessage(cipher, plaintext)) {
+            database.logActivity("ERROR", "Failed to decrypt stored group message " + std::to_string(stored.id));
+            continue;
+        }
+
+        std::string senderName;
+        if (!users.nameOf(stored.senderId, senderName)) {
+            senderName = "unknown";
         }
+
+        out.messages.push_back({stored.id, std::move(senderName), std::move(plaintext), stored.timestamp, stored.group});
+    }
+    return true;
+}
+
+void queueOfflineMessages(DatabaseWriter& writer,
+                          const std::string& username,
+                          const OfflineBatch& batch,
+                          ClientState& state)
+{
+    state.noteCaughtUp(batch.lastId);
+    for (const auto& cursor : batch.groupCursors) {
+        state.noteGroupCaughtUp(cursor.first, cursor.second);
+    }
+    if (batch.messages.empty() && batch.groupCursors.empty()) {
+        return;
     }
 
-    if (allMarkedDelivered) {
-        database.logActivity("INFO", "Delivered queued messages to " + username);
-    } else {
-        database.logActivity("WARN", "Delivered queued messages to " + username +
-                                       " with pending delivery state errors");
+    std::vector<int> direct;
+    for (const auto& message : batch.messages) {
+        state.queueIncomingMessage(message.sender, message.plaintext, message.timestamp, message.id, message.group);
+        if (message.group.empty()) {
+            direct.push_back(message.id); // group messages are covered by the cursors
+        }
     }
 
-    return allMarkedDelivered;
+    // one job for the whole drain; the marks above keep a later fetch from
+    // queueing these again before it commits
+    writer.submit([username, userId = state.userId(), direct = std::move(direct), cursors = batch.groupCursors](Database& db) {
+        bool allMarkedDelivered = true;
+        for (const int messageId : direct) {
+            if (!db.markDelivered(messageId)) {
+                allMarkedDelivered = false;
+                db.logActivity("ERROR", "Failed to mark delivered for message " + std::to_string(messageId)
+                                           + " (recipient: " + username + ")");
+            }
+        }
+
+        for (const auto& cursor : cursors) {
+            if (!db.setGroupCursor(cursor.first, userId, cursor.second)) {
+                allMarkedDelivered = false;
+                db.logActivity("ERROR", "Failed to move cursor of group " + std::to_string(cursor.first)
+                                           + " (member: " + username + ")");
+            }
+        }
+
+        if (allMarkedDelivered) {
+            db.logActivity("INFO", "Delivered queued messages to " + username);
+        } else {
+            db.logActivity("WARN", "Delivered queued messages to " + username +
+                                     " with pending delivery state errors");
+        }
+        return allMarkedDelivered;
+    });
+}
+
+bool deliverOfflineMessages(Database& database,
+                            DatabaseWriter& writer,
+                            CryptoEngine& crypto,
+                            UserDirectory& users,
+                            const std::string& username,
+                            ClientState& state)
+{
+    // skip what an earlier drain queued but the writer may not have marked yet
+    OfflineBatch queued;
+    queued.lastId = state.caughtUp();
+    queued.groupCursors.insert(state.groupsCaughtUp().begin(), state.groupsCaughtUp().end());
+
+    OfflineBatch batch;
+    if (!fetchOfflineMessages(database, crypto, users, username, batch, queued.lastId, &queued)) {
+        return false;
+    }
+    queueOfflineMessages(writer, username, batch, state);
+    return true;
 }
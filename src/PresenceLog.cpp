@@ -0,0 +1,56 @@
+// PresenceLog.cpp
+#include "../include/PresenceLog.h"
+
+#include <unordered_map>
+
+PresenceLog::PresenceLog(std::size_t maxEntries)
+    : capacity(maxEntries > 0 ? maxEntries : 1)
+{
+    pthread_mutex_init(&mutex, nullptr);
+}
+
+PresenceLog::~PresenceLog()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+void PresenceLog::record(const std::string& username, bool online)
+{
+    pthread_mutex_lock(&mutex);
+    if (entries.size() == capacity) {
+        entries.pop_front();
+    }
+    entries.push_back(Change{username, online});
+    current.fetch_add(1, std::memory_order_release);
+    pthread_mutex_unlock(&mutex);
+}
+
+bool PresenceLog::changesSince(uint64_t since, uint64_t& upTo, std::vector<Change>& out) const
+{
+    out.clear();
+    pthread_mutex_lock(&mutex);
+    const uint64_t latest = current.load(std::memory_order_relaxed);
+    upTo = latest;
+    if (since >= latest) {
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+    if (latest - since > entries.size()) {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    // A user who came and went within the window is reported once, in the
+    // position of their last change.
+    std::unordered_map<std::string, std::size_t> latestFor;
+    for (std::size_t i = entries.size() - (latest - since); i < entries.size(); ++i) {
+        latestFor[entries[i].username] = i;
+    }
+    for (std::size_t i = entries.size() - (latest - since); i < entries.size(); ++i) {
+        if (latestFor[entries[i].username] == i) {
+            out.push_back(entries[i]);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return true;
+}
@@ -4,12 +4,12 @@
 #include <cctype>
 #include <nlohmann/json.hpp>
 
-Command ProtocolHandler::parseCommand(const std::string& json) const
+Command ProtocolHandler::parseCommand(std::string_view json) const
 {
     Command command;
     nlohmann::json payload;
     try {
-        payload = nlohmann::json::parse(json);
+        payload = nlohmann::json::parse(json.begin(), json.end());
     } catch (const nlohmann::json::exception&) {
         command.type = Command::Type::Unknown;
         return command;
@@ -33,8 +33,28 @@ Command ProtocolHandler::parseCommand(const std::string& json) const
         command.type = Command::Type::ListUsers;
     } else if (upperType == "LIST_ONLINE") {
         command.type = Command::Type::ListOnline;
+    } else if (upperType == "LIST_BACKLOGGED") {
+        command.type = Command::Type::ListBacklogged;
     } else if (upperType == "GET_HISTORY") {
         command.type = Command::Type::GetHistory;
+    } else if (upperType == "PING") {
+        command.type = Command::Type::Ping;
+    } else if (upperType == "PONG") {
+        command.type = Command::Type::Pong;
+    } else if (upperType == "SHM_ATTACH") {
+        command.type = Command::Type::ShmAttach;
+    } else if (upperType == "RESUME") {
+        command.type = Command::Type::Resume;
+    } else if (upperType == "CREATE_GROUP") {
+        command.type = Command::Type::CreateGroup;
+    } else if (upperType == "JOIN_GROUP") {
+        command.type = Command::Type::JoinGroup;
+    } else if (upperType == "LEAVE_GROUP") {
+        command.type = Command::Type::LeaveGroup;
+    } else if (upperType == "SEND_GROUP") {
+        command.type = Command::Type::SendGroup;
+    } else if (upperType == "SUBSCRIBE_PRESENCE") {
+        command.type = Command::Type::SubscribePresence;
     } else {
         command.type = Command::Type::Unknown;
     }
@@ -46,6 +66,16 @@ Command ProtocolHandler::parseCommand(const std::string& json) const
     command.targetUser = payload.value("with", payload.value("target", std::string{}));
     command.limit      = payload.value("limit", command.limit);
     command.offset     = payload.value("offset", command.offset);
+    command.token      = payload.value("token", std::string{});
+    command.wantResumeToken = payload.value("resume", false);
+    command.group      = payload.value("group", std::string{});
+
+    const std::string ack = payload.value("ack", std::string{});
+    if (ack == "commit") {
+        command.ackOnCommit = true;
+    } else if (ack == "enqueue") {
+        command.ackOnCommit = false;
+    }
 
     return command;
 }
@@ -81,6 +111,9 @@ std::string ProtocolHandler::serializeResponse(const Response& response) const
     if (response.timestamp) {
         jsonResponse["timestamp"] = *response.timestamp;
     }
+    if (response.group) {
+        jsonResponse["group"] = *response.group;
+    }
 
     return jsonResponse.dump() + "\n";
 }
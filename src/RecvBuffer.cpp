@@ -0,0 +1,50 @@
+#include "RecvBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+char* RecvBuffer::prepare(std::size_t minBytes)
+{
+    if (capacity - writePos >= minBytes) {
+        return storage.get() + writePos;
+    }
+
+    const std::size_t unread = size();
+    if (capacity - unread >= minBytes) {
+        // Enough room once the consumed prefix is reclaimed.
+        std::memmove(storage.get(), storage.get() + readPos, unread);
+    } else {
+        std::size_t grown = std::max(capacity, kDefaultCapacity);
+        while (grown - unread < minBytes) {
+            grown *= 2;
+        }
+        std::unique_ptr<char[]> next(new char[grown]);
+        if (unread > 0) {
+            std::memcpy(next.get(), storage.get() + readPos, unread);
+        }
+        storage = std::move(next);
+        capacity = grown;
+    }
+    readPos = 0;
+    writePos = unread;
+    return storage.get() + writePos;
+}
+
+void RecvBuffer::append(const char* data, std::size_t bytes)
+{
+    std::memcpy(prepare(bytes), data, bytes);
+    commit(bytes);
+}
+
+void RecvBuffer::consume(std::size_t bytes)
+{
+    readPos += std::min(bytes, size());
+    if (readPos == writePos) {
+        readPos = writePos = 0; // cheap rewind whenever the buffer drains
+    }
+}
+
+void RecvBuffer::clear()
+{
+    readPos = writePos = 0;
+}
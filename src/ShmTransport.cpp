@@ -0,0 +1,281 @@
+#include "ShmTransport.h"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring positions are shared between processes");
+
+// One cache line per field: producer and consumer never write the same line.
+struct ShmTransport::RingControl {
+    alignas(64) std::atomic<uint64_t> head;           // consumer position
+    alignas(64) std::atomic<uint64_t> tail;           // producer position
+    alignas(64) std::atomic<uint32_t> writerWaiting;  // producer found the ring full
+};
+
+struct ShmTransport::Segment {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ringBytes;
+    RingControl toServer;
+    RingControl toClient;
+};
+
+namespace {
+constexpr uint32_t kMagic = 0x48555853; // "HUXS"
+constexpr uint32_t kVersion = 1;
+constexpr std::size_t kPageSize = 4096;
+constexpr std::size_t kHeaderBytes = (sizeof(uint64_t) * 2 + 3 * 3 * 64 + kPageSize - 1) / kPageSize * kPageSize;
+constexpr std::size_t kMaxRingBytes = std::size_t {1} << 30;
+
+std::size_t roundUpPowerOfTwo(std::size_t value)
+{
+    std::size_t result = kPageSize;
+    while (result < value && result < kMaxRingBytes) {
+        result <<= 1;
+    }
+    return result;
+}
+
+void closeIfOpen(int fd)
+{
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+// Copies `bytes` into / out of a power-of-two ring at a free-running position.
+void copyIn(char* ring, std::size_t capacity, uint64_t pos, const char* src, std::size_t bytes)
+{
+    const std::size_t start = static_cast<std::size_t>(pos & (capacity - 1));
+    const std::size_t first = std::min(bytes, capacity - start);
+    std::memcpy(ring + start, src, first);
+    std::memcpy(ring, src + first, bytes - first);
+}
+
+void copyOut(const char* ring, std::size_t capacity, uint64_t pos, char* dst, std::size_t bytes)
+{
+    const std::size_t start = static_cast<std::size_t>(pos & (capacity - 1));
+    const std::size_t first = std::min(bytes, capacity - start);
+    std::memcpy(dst, ring + start, first);
+    std::memcpy(dst + first, ring, bytes - first);
+}
+} // namespace
+
+std::unique_ptr<ShmTransport> ShmTransport::create(std::size_t ringBytes)
+{
+    static_assert(sizeof(Segment) <= kHeaderBytes, "segment header outgrew its page");
+
+    std::unique_ptr<ShmTransport> transport(new ShmTransport());
+    transport->capacity = roundUpPowerOfTwo(ringBytes);
+    const std::size_t length = kHeaderBytes + 2 * transport->capacity;
+
+    transport->memFd = ::memfd_create("huxley-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (transport->memFd == -1 || ::ftruncate(transport->memFd, static_cast<off_t>(length)) == -1) {
+        std::perror("shm segment");
+        return nullptr;
+    }
+    // The client must not be able to shrink the file under our mapping.
+    ::fcntl(transport->memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    transport->waitEventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    transport->kickEventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (transport->waitEventFd == -1 || transport->kickEventFd == -1) {
+        std::perror("shm eventfd");
+        return nullptr;
+    }
+    if (!transport->map(transport->memFd, length)) {
+        return nullptr;
+    }
+
+    auto* segment = new (transport->base) Segment{};
+    segment->magic = kMagic;
+    segment->version = kVersion;
+    segment->ringBytes = transport->capacity;
+    char* data = static_cast<char*>(transport->base) + kHeaderBytes;
+    transport->incoming = &segment->toServer;
+    transport->outgoing = &segment->toClient;
+    transport->incomingData = data;
+    transport->outgoingData = data + transport->capacity;
+    return transport;
+}
+
+std::unique_ptr<ShmTransport> ShmTransport::attach(int memFd, int waitFd, int kickFd)
+{
+    std::unique_ptr<ShmTransport> transport(new ShmTransport());
+    transport->memFd = memFd;
+    transport->waitEventFd = waitFd;
+    transport->kickEventFd = kickFd;
+
+    struct stat info {};
+    if (::fstat(memFd, &info) == -1 || static_cast<std::size_t>(info.st_size) < kHeaderBytes
+        || !transport->map(memFd, static_cast<std::size_t>(info.st_size))) {
+        return nullptr;
+    }
+    auto* segment = static_cast<Segment*>(transport->base);
+    const uint64_t ringBytes = segment->ringBytes;
+    if (segment->magic != kMagic || segment->version != kVersion || ringBytes == 0
+        || (ringBytes & (ringBytes - 1)) != 0 || kHeaderBytes + 2 * ringBytes != transport->mappedBytes) {
+        std::fprintf(stderr, "shm: unrecognised segment\n");
+        return nullptr;
+    }
+
+    transport->capacity = static_cast<std::size_t>(ringBytes);
+    char* data = static_cast<char*>(transport->base) + kHeaderBytes;
+    transport->incoming = &segment->toClient;
+    transport->outgoing = &segment->toServer;
+    transport->incomingData = data + transport->capacity;
+    transport->outgoingData = data;
+    transport->readPos = transport->incoming->head.load(std::memory_order_acquire);
+    transport->writePos = transport->outgoing->tail.load(std::memory_order_acquire);
+    return transport;
+}
+
+ShmTransport::~ShmTransport()
+{
+    if (base) {
+        ::munmap(base, mappedBytes);
+    }
+    closeIfOpen(memFd);
+    closeIfOpen(waitEventFd);
+    closeIfOpen(kickEventFd);
+}
+
+bool ShmTransport::map(int fd, std::size_t length)
+{
+    void* mapped = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        std::perror("shm mmap");
+        return false;
+    }
+    base = mapped;
+    mappedBytes = length;
+    return true;
+}
+
+bool ShmTransport::offer(int socketFd, const std::string& frame) const
+{
+    // The client waits on what we kick, and kicks what we wait on.
+    const int fds[3] = {memFd, kickEventFd, waitEventFd};
+
+    iovec iov {};
+    iov.iov_base = const_cast<char*>(frame.data());
+    iov.iov_len = frame.size();
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] {};
+    msghdr message {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    ssize_t sent = -1;
+    do {
+        sent = ::sendmsg(socketFd, &message, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    return sent == static_cast<ssize_t>(frame.size());
+}
+
+void ShmTransport::clearWakeup()
+{
+    uint64_t value = 0;
+    ::read(waitEventFd, &value, sizeof(value));
+}
+
+void ShmTransport::kick()
+{
+    const uint64_t value = 1;
+    ::write(kickEventFd, &value, sizeof(value));
+}
+
+// Publishing the tail and then reading the head (both seq_cst) pairs with the
+// reader publishing its head and then re-reading the tail: at least one side
+// sees the other, so either we kick or the reader finds the new bytes itself.
+std::size_t ShmTransport::send(const iovec* iov, std::size_t count)
+{
+    if (corrupt) {
+        return 0;
+    }
+
+    std::size_t taken = 0;
+    std::size_t index = 0;
+    std::size_t offset = 0; // into iov[index]
+    const uint64_t startPos = writePos;
+    while (index < count) {
+        const uint64_t used = writePos - outgoing->head.load(std::memory_order_seq_cst);
+        if (used > capacity) {
+            corrupt = true;
+            return taken;
+        }
+        std::size_t space = capacity - static_cast<std::size_t>(used);
+        if (space == 0) {
+            // Ask for a kick, then look once more in case the reader just made room.
+            outgoing->writerWaiting.store(1, std::memory_order_seq_cst);
+            if (writePos - outgoing->head.load(std::memory_order_seq_cst) >= capacity) {
+                break;
+            }
+            continue;
+        }
+
+        while (index < count && space > 0) {
+            const auto* src = static_cast<const char*>(iov[index].iov_base) + offset;
+            const std::size_t chunk = std::min(space, iov[index].iov_len - offset);
+            copyIn(outgoingData, capacity, writePos, src, chunk);
+            writePos += chunk;
+            taken += chunk;
+            space -= chunk;
+            offset += chunk;
+            if (offset == iov[index].iov_len) {
+                ++index;
+                offset = 0;
+            }
+        }
+    }
+
+    if (taken > 0) {
+        outgoing->tail.store(writePos, std::memory_order_seq_cst);
+        if (outgoing->head.load(std::memory_order_seq_cst) == startPos) {
+            kick(); // the reader may have seen the ring empty and gone to sleep
+        }
+    }
+    return taken;
+}
+
+std::size_t ShmTransport::readable()
+{
+    const uint64_t available = incoming->tail.load(std::memory_order_seq_cst) - readPos;
+    if (available > capacity) {
+        corrupt = true;
+        return 0;
+    }
+    return corrupt ? 0 : static_cast<std::size_t>(available);
+}
+
+std::size_t ShmTransport::receive(char* out, std::size_t maxBytes)
+{
+    const std::size_t bytes = std::min(readable(), maxBytes);
+    if (bytes == 0) {
+        return 0;
+    }
+    copyOut(incomingData, capacity, readPos, out, bytes);
+    readPos += bytes;
+    incoming->head.store(readPos, std::memory_order_seq_cst);
+    if (incoming->writerWaiting.exchange(0, std::memory_order_seq_cst) != 0) {
+        kick();
+    }
+    return bytes;
+}
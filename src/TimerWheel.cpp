@@ -0,0 +1,97 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(uint64_t startTick)
+    : currentTick(startTick)
+{
+    slots[0].assign(1u << kLevel0Bits, -1);
+    for (unsigned level = 1; level < kLevels; ++level) {
+        slots[level].assign(1u << kLevelNBits, -1);
+    }
+}
+
+void TimerWheel::schedule(int fd, uint32_t generation, uint64_t dueTick)
+{
+    if (fd < 0) {
+        return;
+    }
+    const auto index = static_cast<std::size_t>(fd);
+    if (index >= nodes.size()) {
+        nodes.resize(std::max<std::size_t>(index + 1, nodes.size() * 2));
+    }
+    if (nodes[index].level != -1) {
+        unlink(fd);
+    }
+
+    Node& node = nodes[index];
+    node.generation = generation;
+    node.due = std::min(std::max(dueTick, currentTick + 1), currentTick + kHorizon);
+    link(fd);
+}
+
+void TimerWheel::cancel(int fd)
+{
+    if (armed(fd)) {
+        unlink(fd);
+    }
+}
+
+bool TimerWheel::armed(int fd) const
+{
+    const auto index = static_cast<std::size_t>(fd);
+    return fd >= 0 && index < nodes.size() && nodes[index].level != -1;
+}
+
+// Level 0 resolves single ticks; each coarser level covers 64 slots of the
+// previous level's full span. A deadline due right now lands in the level-0
+// slot that advance() is about to fire.
+void TimerWheel::link(int fd)
+{
+    Node& node = nodes[static_cast<std::size_t>(fd)];
+    const uint64_t delta = node.due - currentTick;
+    if (delta < (1ull << kLevel0Bits)) {
+        node.level = 0;
+        node.slot = static_cast<uint16_t>(node.due & ((1u << kLevel0Bits) - 1));
+    } else if (delta < (1ull << (kLevel0Bits + kLevelNBits))) {
+        node.level = 1;
+        node.slot = static_cast<uint16_t>((node.due >> kLevel0Bits) & ((1u << kLevelNBits) - 1));
+    } else {
+        node.level = 2;
+        node.slot = static_cast<uint16_t>((node.due >> (kLevel0Bits + kLevelNBits)) & ((1u << kLevelNBits) - 1));
+    }
+
+    int& head = slots[static_cast<std::size_t>(node.level)][node.slot];
+    node.prev = -1;
+    node.next = head;
+    if (head != -1) {
+        nodes[static_cast<std::size_t>(head)].prev = fd;
+    }
+    head = fd;
+}
+
+void TimerWheel::unlink(int fd)
+{
+    Node& node = nodes[static_cast<std::size_t>(fd)];
+    if (node.prev != -1) {
+        nodes[static_cast<std::size_t>(node.prev)].next = node.next;
+    } else {
+        slots[static_cast<std::size_t>(node.level)][node.slot] = node.next;
+    }
+    if (node.next != -1) {
+        nodes[static_cast<std::size_t>(node.next)].prev = node.prev;
+    }
+    node.prev = node.next = -1;
+    node.level = -1;
+}
+
+void TimerWheel::cascade(unsigned level, unsigned slot)
+{
+    int fd = slots[level][slot];
+    slots[level][slot] = -1;
+    while (fd != -1) {
+        const int next = nodes[static_cast<std::size_t>(fd)].next;
+        link(fd);
+        fd = next;
+    }
+}
@@ -0,0 +1,136 @@
+// UserDirectory.cpp
+#include "../include/UserDirectory.h"
+#include "../include/DatabaseEngine.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+// Double hashing: bit i of a name is h1 + i * h2.
+struct FilterHash {
+    explicit FilterHash(const std::string& username)
+        : h1(std::hash<std::string>{}(username))
+        , h2(((h1 >> 32) | (h1 << 32)) * 0x9E3779B97F4A7C15ULL | 1)
+    {
+    }
+    std::size_t bit(unsigned i, std::size_t bits) const { return (h1 + i * h2) % bits; }
+
+    uint64_t h1;
+    uint64_t h2;
+};
+} // namespace
+
+UserDirectory::UserDirectory(Database& db)
+    : database(db)
+    , filter(new std::atomic<uint64_t>[kFilterBits / 64])
+{
+    for (std::size_t i = 0; i < kFilterBits / 64; ++i) {
+        filter[i].store(0, std::memory_order_relaxed);
+    }
+    pthread_rwlock_init(&lock, nullptr);
+}
+
+UserDirectory::~UserDirectory()
+{
+    pthread_rwlock_destroy(&lock);
+}
+
+std::size_t UserDirectory::load(bool authoritative)
+{
+    const auto users = database.listAllUsers();
+    for (const auto& user : users) {
+        remember(user.id, user.username);
+    }
+    if (authoritative) {
+        complete.store(true, std::memory_order_release);
+    }
+    return users.size();
+}
+
+bool UserDirectory::mayContain(const std::string& username) const
+{
+    const FilterHash hash(username);
+    for (unsigned i = 0; i < kFilterHashes; ++i) {
+        const std::size_t bit = hash.bit(i, kFilterBits);
+        if ((filter[bit / 64].load(std::memory_order_acquire) & (uint64_t{1} << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void UserDirectory::addToFilter(const std::string& username)
+{
+    const FilterHash hash(username);
+    for (unsigned i = 0; i < kFilterHashes; ++i) {
+        const std::size_t bit = hash.bit(i, kFilterBits);
+        filter[bit / 64].fetch_or(uint64_t{1} << (bit % 64), std::memory_order_release);
+    }
+}
+
+bool UserDirectory::resolve(const std::string& username, int& outId)
+{
+    const bool authoritative = complete.load(std::memory_order_acquire);
+    if (authoritative && !mayContain(username)) {
+        return false;
+    }
+
+    pthread_rwlock_rdlock(&lock);
+    auto it = ids.find(username);
+    const bool cached = it != ids.end();
+    if (cached) {
+        outId = it->second;
+    }
+    pthread_rwlock_unlock(&lock);
+    if (cached) {
+        return true;
+    }
+
+    // Either a filter false positive or a name some other writer added
+    // (tools, a predecessor during a hot restart); SQLite decides.
+    if (!database.findUserId(username, outId)) {
+        return false;
+    }
+    remember(outId, username);
+    return true;
+}
+
+bool UserDirectory::nameOf(int userId, std::string& outUsername)
+{
+    bool cached = false;
+    pthread_rwlock_rdlock(&lock);
+    if (userId > 0 && static_cast<std::size_t>(userId) < names.size() && !names[userId].empty()) {
+        outUsername = names[userId];
+        cached = true;
+    }
+    pthread_rwlock_unlock(&lock);
+    if (cached) {
+        return true;
+    }
+
+    // Ids come from stored rows, so this is only reached before load() or
+    // for ids beyond the dense table.
+    if (!database.findUsername(userId, outUsername)) {
+        return false;
+    }
+    remember(userId, outUsername);
+    return true;
+}
+
+// The filter bits go in before the map entry: a reader that passes the
+// filter and misses the map falls back to SQLite, which already has the row.
+void UserDirectory::remember(int userId, const std::string& username)
+{
+    addToFilter(username);
+    pthread_rwlock_wrlock(&lock);
+    ids.emplace(username, userId);
+    if (userId > 0 && userId < kMaxDenseId) {
+        if (static_cast<std::size_t>(userId) >= names.size()) {
+            // doubling, but never past the dense range (userId + 1 is within it)
+            names.resize(std::min<std::size_t>(std::max<std::size_t>(userId + 1, names.size() * 2), kMaxDenseId));
+        }
+        names[userId] = username;
+    }
+    pthread_rwlock_unlock(&lock);
+}
+
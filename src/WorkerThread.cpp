@@ -1,20 +1,31 @@
 #include "WorkerThread.h"
 
+#include "AdmissionControl.h"
 #include "AuthManager.h"
+#include "CpuAffinity.h"
 #include "ClientState.h"
+#include "IoUring.h"
 #include "MessageRouter.h"
 #include "OfflineDelivery.h"
 #include "ProtocolHandler.h"
+#include "RecvBuffer.h"
+#include "ShmTransport.h"
 #include "CryptoEngine.h"
 #include "DatabaseEngine.h"
 #include "StatusManager.h"
 
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -27,13 +38,91 @@
 #include <nlohmann/json.hpp>
 
 namespace {
-constexpr uint32_t kBaseEvents = EPOLLIN | EPOLLRDHUP | EPOLLERR; // EPOLLERR not required to be in the base events mask since it's always reported
+// Clients are edge-triggered with EPOLLOUT armed for their whole lifetime:
+// reads drain to EAGAIN (across loop passes, see kMaxReadPerWakeup), and writes are attempted directly when output is
+// queued, so the interest mask never has to be changed with epoll_ctl.
+constexpr uint32_t kClientEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
 constexpr std::size_t kFrameHeaderSize = sizeof(uint32_t);
 constexpr uint32_t kMaxFrameSize = 64 * 1024; // 64 KiB guardrail
+constexpr std::size_t kReadChunkSize = 4096;   // minimum free space offered to each recv
+constexpr std::size_t kMaxReadPerWakeup = 4 * kReadChunkSize; // per client per loop pass, so one sender can't starve the rest
+constexpr std::size_t kMaxGatherFrames = 64;   // queued frames per sendmsg (well under IOV_MAX)
+constexpr int kAcceptBatch = 64; // accepts per listener wakeup before servicing clients again
+constexpr int64_t kLoadWindowNs = 250'000'000; // busy-time sampling window
+constexpr uint64_t kCloseLingerTicks = 2;       // seconds an expired session gets to flush `timeout`
+constexpr std::size_t kLockedStackSize = 1024 * 1024;  // worker stack under --lock-memory (all of it resident)
+constexpr std::size_t kPrefaultStackBytes = 256 * 1024; // touched up front so the loop never page-faults on it
+
+// io_uring backend sizing
+constexpr unsigned kUringEntries = 256;
+constexpr uint16_t kUringBufferGroup = 0;
+constexpr unsigned kUringBufferCount = 256;   // power of two, required by the buffer ring
+constexpr unsigned kUringBufferSize = 4096;   // matches kReadChunkSize; completions are copied into the RecvBuffer
+constexpr std::size_t kMaxLinkedSends = 16;   // frames per linked send chain
+
+// io_uring user_data layout: [op:8][fd:24][generation:32]. The generation
+// lets late completions for a closed socket be told apart from a new
+// connection that reused the same fd number.
+enum class UringOp : uint8_t { EpollReady = 1, Recv, Send, Cancel };
+
+uint64_t packUserData(UringOp op, int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(op) << 56)
+         | (static_cast<uint64_t>(static_cast<uint32_t>(fd) & 0xFFFFFFu) << 32)
+         | generation;
+}
+
+UringOp userDataOp(uint64_t data) { return static_cast<UringOp>(data >> 56); }
+int userDataFd(uint64_t data) { return static_cast<int>((data >> 32) & 0xFFFFFFu); }
+uint32_t userDataGeneration(uint64_t data) { return static_cast<uint32_t>(data); }
+
+// epoll_event.data tagging: client entries carry their ClientState* (at
+// least 8-byte aligned), control fds carry an odd tag value instead.
+enum ControlTag : uint64_t {
+    kWakeupTag = 1,
+    kListenerTag = 3,
+    kTimerTag = 5,
+};
+
+bool isControlTag(uint64_t data) { return (data & 1u) != 0; }
+
+epoll_data_t controlData(ControlTag tag)
+{
+    epoll_data_t data{};
+    data.u64 = tag;
+    return data;
+}
+
+int64_t monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t monotonicSeconds()
+{
+    return static_cast<uint64_t>(monotonicNs() / 1'000'000'000);
+}
+
+// Wall clock, for resume tokens that must outlive this process.
+uint64_t unixSeconds()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
 
-uint32_t eventMaskHasWrite(bool hasPending)
+// Bytes still missing for the frame at the head of the buffer, or zero when
+// its length header has not fully arrived (or the frame is complete).
+std::size_t missingFrameBytes(const RecvBuffer& buffer)
 {
-    return hasPending ? static_cast<uint32_t>(kBaseEvents | EPOLLOUT) : kBaseEvents;
+    const std::string_view pending = buffer.readable();
+    if (pending.size() < kFrameHeaderSize) {
+        return 0;
+    }
+    uint32_t netSize = 0;
+    std::memcpy(&netSize, pending.data(), kFrameHeaderSize);
+    const std::size_t frameSize = kFrameHeaderSize + std::min(ntohl(netSize), kMaxFrameSize);
+    return frameSize > pending.size() ? frameSize - pending.size() : 0;
 }
 
 ssize_t recvNonBlocking(int fd, char* buffer, std::size_t size)
@@ -41,12 +130,15 @@ ssize_t recvNonBlocking(int fd, char* buffer, std::size_t size)
     return ::recv(fd, buffer, size, 0);
 }
 
-ssize_t sendNonBlocking(int fd, const char* buffer, std::size_t size)
+ssize_t sendGathered(int fd, iovec* iov, std::size_t count)
 {
+    msghdr message {};
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
 #ifdef MSG_NOSIGNAL
-    return ::send(fd, buffer, size, MSG_NOSIGNAL); // prevent SIGPIPE on Linux on broken pipe / closed socket
+    return ::sendmsg(fd, &message, MSG_NOSIGNAL); // prevent SIGPIPE on Linux on broken pipe / closed socket
 #else
-    return ::send(fd, buffer, size, 0);
+    return ::sendmsg(fd, &message, 0);
 #endif
 }
 
@@ -62,21 +154,29 @@ Here, we also setup the **listenFd** and **wakeupFd**, file descriptors used for
 event notification from (1) sockets and (2) inter-thread wakeup signals respectively (from the main thread)
 The epoll instance is created to monitor these file descriptors for events
 
-The *clientsMutex* is initialized to protect access to the *clientStates* map, ensuring thread-safe operations
-Other threads may write to the outbound buffer of a ClientState instance, so proper synchronization is crucial
-Clients are managed here and only here, which is why they're also std::unique_ptr<ClientState> instances
+The *clientsMutex* is initialized to protect the hand-off list (*pendingClients*) the accept thread appends to
+Other threads never touch a ClientState's send queue: their frames go through the lock-free *outbox* and the loop appends them,
+and routed messages arrive the same way through the *mailbox*, addressed by (fd, generation) via the client's ClientHandle
+Clients are managed here and only here, in the fd-indexed *clientSlots* table that only the loop thread touches,
+which is why they're also std::unique_ptr<ClientState> instances
  */
 WorkerThread::WorkerThread(int id,
+                           const ServerConfig& serverConfig,
                            AuthManager& auth,
                            MessageRouter& router,
                            ProtocolHandler& protocol,
                            StatusManager& status,
                            Database& db,
-                           CryptoEngine& crypto)
+                           CryptoEngine& crypto,
+                           AdmissionControl& admission)
     : workerId(id)
+    , config(serverConfig)
     , epollFd(-1)
     , wakeupFd(-1)
+    , listenFd(-1)
+    , timerFd(-1)
     , running(false)
+    , uringActive(false)
     , threadHandle(0)
     , authManager(auth)
     , messageRouter(router)
@@ -84,16 +184,23 @@ WorkerThread::WorkerThread(int id,
     , statusManager(status)
     , database(db)
     , cryptoEngine(crypto)
+    , admissionControl(admission)
     , eventBuffer(64)
+    , idleTimers(monotonicSeconds())
+    , ring()
+    , epollPollArmed(false)
+    , controlBacklog(false)
 {
 
     pthread_mutex_init(&clientsMutex, nullptr);
+    pthread_cond_init(&handoffCond, nullptr);
 }
 
 // Destructor, cleans up resources
 WorkerThread::~WorkerThread()
 {
     stop();
+    pthread_cond_destroy(&handoffCond);
     pthread_mutex_destroy(&clientsMutex);
 }
 
@@ -127,7 +234,7 @@ void WorkerThread::start()
 
     epoll_event wakeEvent{};
     wakeEvent.events = EPOLLIN;   // events is a bit mask of events, implemented in the kernel as __poll_t (instead of __u32)
-    wakeEvent.data.fd = wakeupFd; // data is a union, here we use fd to store the wakeupFd. kernel implements this as a __u64 
+    wakeEvent.data = controlData(kWakeupTag); // data is a union; clients store a ClientState*, control fds an odd tag. kernel implements this as a __u64 
     if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &wakeEvent) == -1) {
         std::perror("epoll_ctl add wakeup");
         ::close(wakeupFd);
@@ -137,10 +244,47 @@ void WorkerThread::start()
         return;
     }
 
+    // Listener stays level-triggered: acceptPendingClients takes a bounded
+    // batch and leaves the rest for the next epoll_wait round.
+    if (listenFd != -1) {
+        epoll_event listenEvent{};
+        listenEvent.events = EPOLLIN;
+        listenEvent.data = controlData(kListenerTag);
+        if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) == -1) {
+            std::perror("epoll_ctl add listener");
+            ::close(wakeupFd);
+            ::close(epollFd);
+            wakeupFd = -1;
+            epollFd = -1;
+            return;
+        }
+    }
+
+    // Always armed: presence deltas go out on the tick even with idle expiry
+    // and heartbeats off (the wheel then simply holds nothing). Best effort:
+    // without a timerfd sessions never expire and subscribers only get snapshots.
+    if (!setupTimer()) {
+        std::cerr << "[worker " << workerId << "] timer unavailable, sessions will not expire" << std::endl;
+    }
+
+    // With mlockall(MCL_FUTURE) the whole stack mapping is locked, so keep it
+    // to a known size instead of the 8 MiB default.
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (config.lockMemory) {
+        pthread_attr_setstacksize(&attr, kLockedStackSize);
+    }
+
     running.store(true);
-    if (pthread_create(&threadHandle, nullptr, &WorkerThread::threadEntry, this) != 0) {
+    const int created = pthread_create(&threadHandle, &attr, &WorkerThread::threadEntry, this);
+    pthread_attr_destroy(&attr);
+    if (created != 0) {
         std::perror("pthread_create");
         running.store(false);
+        if (timerFd != -1) {
+            ::close(timerFd);
+            timerFd = -1;
+        }
         ::close(wakeupFd);
         ::close(epollFd);
         wakeupFd = -1;
@@ -148,6 +292,32 @@ void WorkerThread::start()
     }
 }
 
+// One-second periodic timerfd in the epoll set; each expiry advances the
+// idle wheel and pushes presence deltas (see advanceTimers).
+bool WorkerThread::setupTimer()
+{
+    timerFd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd == -1) {
+        std::perror("timerfd_create");
+        return false;
+    }
+
+    itimerspec period{};
+    period.it_interval.tv_sec = 1;
+    period.it_value.tv_sec = 1;
+    epoll_event timerEvent{};
+    timerEvent.events = EPOLLIN;
+    timerEvent.data = controlData(kTimerTag);
+    if (::timerfd_settime(timerFd, 0, &period, nullptr) == -1
+        || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &timerEvent) == -1) {
+        std::perror("idle timer");
+        ::close(timerFd);
+        timerFd = -1;
+        return false;
+    }
+    return true;
+}
+
 void WorkerThread::stop()
 {
     if (!running.exchange(false)) {
@@ -166,17 +336,49 @@ void WorkerThread::stop()
         threadHandle = 0;
     }
 
-    // close all client connections in the clientStates unordered_map
-    pthread_mutex_lock(&clientsMutex);
-    for (auto& [fd, state] : clientStates) {
-        if (state) {
-            ::close(fd);
+    // close all client connections in the slot table, plus sockets handed
+    // over but never adopted by the loop
+    for (std::size_t fd = 0; fd < clientSlots.size(); ++fd) {
+        if (clientSlots[fd].state) {
+            ::close(static_cast<int>(fd));
         }
     }
-    clientStates.clear();
-    pthread_mutex_unlock(&clientsMutex);
+    clientSlots.clear();
+    for (auto& [fd, state] : retiringClients) {
+        ::close(fd);
+    }
+    retiringClients.clear();
+    closedClients.clear();
 
-    // finally, close the wakeup and epoll file descriptors
+    pthread_mutex_lock(&clientsMutex);
+    for (const int fd : pendingClients) {
+        ::close(fd);
+    }
+    pendingClients.clear();
+    for (const SessionHandoff& session : pendingSessions) {
+        ::close(session.fd);
+    }
+    pendingSessions.clear();
+    handoffPending = false; // the loop is gone; release a waiting detachForHandoff()
+    pthread_cond_broadcast(&handoffCond);
+    pthread_mutex_unlock(&clientsMutex);
+    pendingWrites.clear();
+    pendingReads.clear();
+    outbox.clear();
+    mailbox.clear();
+    tasks.clear();
+    connectionCount.store(0);
+    outboundBytes.store(0);
+
+    // finally, close the listener, wakeup and epoll file descriptors
+    if (listenFd != -1) {
+        ::close(listenFd);
+        listenFd = -1;
+    }
+    if (timerFd != -1) {
+        ::close(timerFd);
+        timerFd = -1;
+    }
     if (wakeupFd != -1) {
         ::close(wakeupFd);
         wakeupFd = -1;
@@ -188,6 +390,9 @@ void WorkerThread::stop()
 }
 
 // assign client to this worker thread
+// Called from the accept thread: the socket is only queued here and adopted
+// by the worker's own loop, so the client table and (with io_uring) the
+// submission ring are only ever touched by the owning thread.
 void WorkerThread::assignClient(int clientFd)
 {
 
@@ -202,59 +407,474 @@ void WorkerThread::assignClient(int clientFd)
     const int flags = ::fcntl(clientFd, F_GETFL, 0);
     ::fcntl(clientFd, F_SETFL, flags | O_NONBLOCK);
 
+    // counted right away so back-to-back placements see it
+    connectionCount.fetch_add(1, std::memory_order_relaxed);
+    pthread_mutex_lock(&clientsMutex);
+    pendingClients.push_back(clientFd);
+    pthread_mutex_unlock(&clientsMutex);
+
+    if (wakeupFd != -1) {
+        const uint64_t value = 1;
+        ::write(wakeupFd, &value, sizeof(value));
+    }
+}
+
+// Hand this worker its own SO_REUSEPORT listening socket. Must be called
+// before start(); the worker takes ownership and closes it on stop().
+void WorkerThread::adoptListener(int socketFd)
+{
+    if (running.load() || listenFd != -1) {
+        ::close(socketFd);
+        return;
+    }
+    listenFd = socketFd;
+}
+
+void WorkerThread::adoptPendingClients()
+{
+    std::vector<int> adopted;
+    std::vector<SessionHandoff> sessions;
+    pthread_mutex_lock(&clientsMutex);
+    adopted.swap(pendingClients);
+    sessions.swap(pendingSessions);
+    pthread_mutex_unlock(&clientsMutex);
+
+    for (const int clientFd : adopted) {
+        addClient(clientFd);
+    }
+    for (SessionHandoff& session : sessions) {
+        restoreSession(session);
+    }
+}
+
+// register a non-blocking client socket with the active backend and the client table
+bool WorkerThread::addClient(int clientFd)
+{
+    const auto index = static_cast<std::size_t>(clientFd);
+    if (index >= clientSlots.size()) {
+        clientSlots.resize(std::max<std::size_t>(index + 1, clientSlots.size() * 2));
+    }
+
+    ClientSlot& slot = clientSlots[index];
+    ++slot.generation;
+    slot.state = std::make_unique<ClientState>(this, clientFd, slot.generation, protocolHandler);
+    ClientState* state = slot.state.get();
+    state->updateActivity(idleTimers.now());
+    state->markHeard(idleTimers.now());
+    scheduleIdleCheck(*state);
+
+    // Bound how long sent data (heartbeat pings included) may stay unacked,
+    // so a vanished peer surfaces as a socket error instead of lingering.
+    if (config.heartbeatSeconds > 0) {
+        const unsigned userTimeoutMs = config.heartbeatSeconds * 1000;
+        ::setsockopt(clientFd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeoutMs, sizeof(userTimeoutMs));
+    }
+
+    if (uringActive.load(std::memory_order_relaxed)) {
+        armUringRecv(*state);
+        return true;
+    }
+
     epoll_event clientEvent{};
-    clientEvent.events = kBaseEvents;
-    clientEvent.data.fd = clientFd;
+    clientEvent.events = kClientEvents;
+    clientEvent.data.ptr = state;
     if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &clientEvent) == -1) {
         std::perror("epoll_ctl add client");
+        idleTimers.cancel(clientFd);
+        slot.state.reset();
+        connectionCount.fetch_sub(1, std::memory_order_relaxed);
+        admissionControl.release(clientFd);
         ::close(clientFd);
+        return false;
+    }
+    return true;
+}
+
+// Migrated connection: same registration as a fresh one, then the old
+// process's buffers and login are put back before anything else runs.
+void WorkerThread::restoreSession(SessionHandoff& session)
+{
+    if (!addClient(session.fd)) {
         return;
     }
+    ClientState& state = *getClient(session.fd);
+    state.mutableRecvBuffer().append(session.recvPending.data(), session.recvPending.size());
+    if (!session.sendPending.empty()) {
+        outboundBytes.fetch_add(static_cast<int64_t>(session.sendPending.size()), std::memory_order_relaxed);
+        state.appendQueuedFrame(std::move(session.sendPending));
+        scheduleFlush(state);
+    }
 
-    auto state = std::make_unique<ClientState>(this, clientFd, protocolHandler);
-    pthread_mutex_lock(&clientsMutex);
-    clientStates[clientFd] = std::move(state);
-    pthread_mutex_unlock(&clientsMutex);
+    int userId = 0;
+    if (session.authenticated && messageRouter.directory().resolve(session.username, userId)) {
+        if (!messageRouter.registerClient(userId, session.username, state.handle())) {
+            logActivity("WARN", "Migrated session already logged in elsewhere: " + session.username);
+        } else {
+            state.setAuthenticated(true);
+            state.setUsername(session.username);
+            state.setUserId(userId);
+            // Messages routed while the session was in transit were stored.
+            deliverOfflineMessages(database, messageRouter.writer(), cryptoEngine, messageRouter.directory(), session.username, state);
+        }
+    }
+    processFrames(state);
+}
 
-    notifyEvent(clientFd);
+// Drain up to kAcceptBatch connections from this worker's own listener.
+// The kernel already spread them across the SO_REUSEPORT group, so the
+// accepted fds never leave this thread.
+void WorkerThread::acceptPendingClients()
+{
+    for (int i = 0; i < kAcceptBatch; ++i) {
+        sockaddr_storage peer{};
+        socklen_t peerLength = sizeof(peer);
+        const int clientFd = ::accept4(listenFd, reinterpret_cast<sockaddr*>(&peer), &peerLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::perror("accept4");
+            }
+            return;
+        }
+        const AdmissionControl::Verdict verdict = admissionControl.admit(clientFd, peer);
+        if (verdict != AdmissionControl::Verdict::Admitted) {
+            admissionControl.reject(clientFd, verdict);
+            continue;
+        }
+        connectionCount.fetch_add(1, std::memory_order_relaxed);
+        addClient(clientFd);
+    }
 }
 
-void WorkerThread::notifyEvent(int clientFd)
+// Frames from our own thread go straight into the client's queue; both
+// backends flush pendingWrites before they wait again. Other threads push
+// onto the outbox, and only the push that finds it empty has to kick the
+// eventfd: the loop detaches the whole outbox on every pass, so later
+// producers just ride along with that wakeup.
+void WorkerThread::postFrame(int clientFd, uint32_t generation, FrameBuffer frame)
 {
     if (epollFd == -1) {
         return;
     }
 
-    pthread_mutex_lock(&clientsMutex);
-    const bool exists = clientStates.find(clientFd) != clientStates.end();
-    pthread_mutex_unlock(&clientsMutex);
+    outboundBytes.fetch_add(static_cast<int64_t>(frame.size()), std::memory_order_relaxed);
+
+    if (pthread_equal(pthread_self(), threadHandle)) {
+        ClientState* state = getClient(clientFd);
+        if (!state || state->generation() != generation) {
+            outboundBytes.fetch_sub(static_cast<int64_t>(frame.size()), std::memory_order_relaxed);
+            return;
+        }
+        state->appendQueuedFrame(std::move(frame));
+        scheduleFlush(*state);
+        return;
+    }
 
-    if (exists) {
-        epoll_event ev{};
-        ev.events = eventMaskHasWrite(true);
-        ev.data.fd = clientFd;
-        ::epoll_ctl(epollFd, EPOLL_CTL_MOD, clientFd, &ev);
+    if (outbox.push(OutboundFrame{clientFd, generation, std::move(frame)}) && wakeupFd != -1) {
+        const uint64_t value = 1;
+        ::write(wakeupFd, &value, sizeof(value));
     }
+}
 
-    if (wakeupFd != -1) {
+void WorkerThread::resumeReading(int clientFd, uint32_t generation)
+{
+    if (epollFd == -1) {
+        return;
+    }
+    if (resumeRequests.push(ClientRef{clientFd, generation})
+        && !pthread_equal(pthread_self(), threadHandle) && wakeupFd != -1) {
+        const uint64_t value = 1;
+        ::write(wakeupFd, &value, sizeof(value));
+    }
+}
+
+void WorkerThread::postMessage(int clientFd, uint32_t generation, IncomingMessage message)
+{
+    if (epollFd == -1) {
+        return;
+    }
+
+    if (pthread_equal(pthread_self(), threadHandle)) {
+        ClientState* state = getClient(clientFd);
+        if (state && state->generation() == generation) {
+            deliverMessage(*state, message);
+        }
+        return;
+    }
+
+    if (mailbox.push(MailboxItem{clientFd, generation, std::move(message)}) && wakeupFd != -1) {
+        const uint64_t value = 1;
+        ::write(wakeupFd, &value, sizeof(value));
+    }
+}
+
+void WorkerThread::postTask(std::function<void()> task)
+{
+    if (epollFd == -1) {
+        return;
+    }
+    if (tasks.push(std::move(task))
+        && !pthread_equal(pthread_self(), threadHandle) && wakeupFd != -1) {
         const uint64_t value = 1;
         ::write(wakeupFd, &value, sizeof(value));
     }
 }
 
+WorkerThread::LoadStats WorkerThread::loadStats() const
+{
+    LoadStats stats{};
+    stats.connections = connectionCount.load(std::memory_order_relaxed);
+    stats.queuedBytes = static_cast<std::size_t>(std::max<int64_t>(0, outboundBytes.load(std::memory_order_relaxed)));
+    stats.busyPermille = busyPermille.load(std::memory_order_relaxed);
+    stats.cpu = lastCpu.load(std::memory_order_relaxed);
+
+    // The ratio is only refreshed when the loop wakes up; a worker that has
+    // been blocked for a whole window is idle, whatever it last reported.
+    const int64_t idleSince = idleSinceNs.load(std::memory_order_relaxed);
+    if (idleSince != 0 && monotonicNs() - idleSince >= kLoadWindowNs) {
+        stats.busyPermille = 0;
+    }
+    return stats;
+}
+
+std::size_t WorkerThread::loadScore() const
+{
+    const LoadStats stats = loadStats();
+    return stats.connections + stats.queuedBytes / (16 * 1024) + stats.busyPermille / 10;
+}
+
+// Called right before blocking for events.
+void WorkerThread::markIdle()
+{
+    const int64_t now = monotonicNs();
+    if (busyStartNs != 0) {
+        busyWindowNs += now - busyStartNs;
+    }
+    if (busyWindowStartNs == 0) {
+        busyWindowStartNs = now;
+    } else if (now - busyWindowStartNs >= kLoadWindowNs) {
+        busyPermille.store(static_cast<unsigned>(busyWindowNs * 1000 / (now - busyWindowStartNs)),
+                           std::memory_order_relaxed);
+        busyWindowStartNs = now;
+        busyWindowNs = 0;
+        lastCpu.store(sched_getcpu(), std::memory_order_relaxed);
+    }
+    idleSinceNs.store(now, std::memory_order_relaxed);
+}
+
+// Called as soon as the wait returns.
+void WorkerThread::markBusy()
+{
+    busyStartNs = monotonicNs();
+    idleSinceNs.store(0, std::memory_order_relaxed);
+}
+
 // Entry point for the worker thread
 void* WorkerThread::threadEntry(void* arg)
 {
     auto* worker = static_cast<WorkerThread*>(arg);
+    worker->applyCpuProfile();
+    // Lookups from this thread then read a WAL snapshot without queueing
+    // behind the writer; falls back to the shared connection on failure.
+    if (!worker->database.openThreadReader()) {
+        std::cerr << "[Worker] No read connection, sharing the writer" << std::endl;
+    }
     worker->eventLoop();
+    worker->database.closeThreadReader();
     return nullptr;
 }
 
-// Main event loop for the worker thread
+int WorkerThread::assignedCpu() const
+{
+    if (config.workerCpus.empty()) {
+        return -1;
+    }
+    return config.workerCpus[static_cast<std::size_t>(workerId) % config.workerCpus.size()];
+}
+
+// Runs on the worker thread before its loop starts. Each step is best
+// effort: a worker that cannot be pinned or raised still serves, and the
+// report below shows what it actually got.
+void WorkerThread::applyCpuProfile()
+{
+    const int cpu = assignedCpu();
+    if (cpu != -1) {
+        cpu_set_t wanted;
+        CPU_ZERO(&wanted);
+        CPU_SET(cpu, &wanted);
+        const int rc = pthread_setaffinity_np(pthread_self(), sizeof(wanted), &wanted);
+        if (rc != 0) {
+            std::cerr << "[worker " << workerId << "] cannot pin to CPU " << cpu << ": " << std::strerror(rc) << std::endl;
+        }
+    }
+
+    if (config.realtimePriority > 0) {
+        sched_param param{};
+        param.sched_priority = config.realtimePriority;
+        const int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (rc != 0) {
+            std::cerr << "[worker " << workerId << "] SCHED_FIFO unavailable: " << std::strerror(rc) << std::endl;
+        }
+    }
+
+    if (config.lockMemory) {
+        volatile unsigned char stackPage[kPrefaultStackBytes];
+        for (std::size_t offset = 0; offset < sizeof(stackPage); offset += 4096) {
+            stackPage[offset] = 0;
+        }
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+    int policy = SCHED_OTHER;
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    lastCpu.store(sched_getcpu(), std::memory_order_relaxed);
+
+    std::cout << "[worker " << workerId << "] on CPU " << lastCpu.load(std::memory_order_relaxed)
+              << " (allowed " << affinity::formatCpuSet(allowed) << "), "
+              << (policy == SCHED_FIFO ? "SCHED_FIFO " + std::to_string(param.sched_priority) : std::string("SCHED_OTHER"))
+              << std::endl;
+}
+
+void WorkerThread::adoptSession(SessionHandoff session)
+{
+    const int flags = ::fcntl(session.fd, F_GETFL, 0);
+    ::fcntl(session.fd, F_SETFL, flags | O_NONBLOCK);
+
+    admissionControl.track(session.fd);
+    connectionCount.fetch_add(1, std::memory_order_relaxed);
+    pthread_mutex_lock(&clientsMutex);
+    pendingSessions.push_back(std::move(session));
+    pthread_mutex_unlock(&clientsMutex);
+
+    if (wakeupFd != -1) {
+        const uint64_t value = 1;
+        ::write(wakeupFd, &value, sizeof(value));
+    }
+}
+
+// Called from the server's upgrade thread. The loop does the actual work in
+// performHandoff() so the client table is still only touched by its owner.
+std::vector<SessionHandoff> WorkerThread::detachForHandoff(bool includeClients)
+{
+    std::vector<SessionHandoff> sessions;
+    pthread_mutex_lock(&clientsMutex);
+    if (!running.load()) {
+        pthread_mutex_unlock(&clientsMutex);
+        return sessions;
+    }
+    handoffPending = true;
+    handoffIncludeClients = includeClients;
+    pthread_mutex_unlock(&clientsMutex);
+
+    if (wakeupFd != -1) {
+        const uint64_t value = 1;
+        ::write(wakeupFd, &value, sizeof(value));
+    }
+
+    pthread_mutex_lock(&clientsMutex);
+    while (handoffPending) {
+        pthread_cond_wait(&handoffCond, &clientsMutex);
+    }
+    sessions.swap(handoffSessions);
+    pthread_mutex_unlock(&clientsMutex);
+    return sessions;
+}
+
+// Stops accepting and, if asked, gives up every connection: the socket stays
+// open (the caller passes it on) while the ClientState is retired here. With
+// io_uring, kernel operations still reference the connections' buffers, so
+// they are not migrated; they are closed when this process stops.
+void WorkerThread::performHandoff()
+{
+    pthread_mutex_lock(&clientsMutex);
+    const bool requested = handoffPending;
+    const bool includeClients = handoffIncludeClients;
+    pthread_mutex_unlock(&clientsMutex);
+    if (!requested) {
+        return;
+    }
+
+    if (listenFd != -1) {
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+    }
+
+    std::vector<SessionHandoff> sessions;
+    if (includeClients && !uringActive.load(std::memory_order_relaxed)) {
+        drainOutbox();
+        for (ClientSlot& slot : clientSlots) {
+            if (!slot.state) {
+                continue;
+            }
+            ClientState& state = *slot.state;
+            // Shared-memory sessions stay behind: the client reattaches after
+            // reconnecting. So do ones mid-login, whose answer comes back here.
+            if (state.closing() || state.sharedMemory() || state.authPending()) {
+                closeClient(state);
+                continue;
+            }
+
+            SessionHandoff session;
+            session.fd = state.socket();
+            session.authenticated = state.isAuthenticated();
+            session.username = state.username();
+            session.recvPending = std::string(state.mutableRecvBuffer().readable());
+            sendViews.clear();
+            state.peekQueuedResponses(sendViews, SIZE_MAX);
+            for (const std::string_view frame : sendViews) {
+                session.sendPending.append(frame);
+            }
+
+            if (state.isAuthenticated()) {
+                messageRouter.unregisterClient(state.userId());
+            }
+            if (state.isBacklogged()) {
+                state.setBacklogged(false);
+            }
+            releaseBlockedSenders(state);
+            idleTimers.cancel(session.fd);
+            admissionControl.release(session.fd);
+            ::epoll_ctl(epollFd, EPOLL_CTL_DEL, session.fd, nullptr);
+            connectionCount.fetch_sub(1, std::memory_order_relaxed);
+            outboundBytes.fetch_sub(static_cast<int64_t>(state.queuedBytes()), std::memory_order_relaxed);
+            closedClients.push_back(removeClient(state)); // the current epoll batch may still name it
+            sessions.push_back(std::move(session));
+        }
+    }
+
+    pthread_mutex_lock(&clientsMutex);
+    handoffSessions = std::move(sessions);
+    handoffPending = false;
+    pthread_cond_broadcast(&handoffCond);
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+// Pick the backend on the worker thread itself: an io_uring created with
+// SINGLE_ISSUER belongs to the thread that set it up.
 void WorkerThread::eventLoop()
+{
+    if (config.ioBackend == ServerConfig::IoBackend::IoUring) {
+        if (setupUring()) {
+            uringLoop();
+            return;
+        }
+        std::cerr << "[worker " << workerId << "] io_uring unavailable, falling back to epoll" << std::endl;
+    }
+    epollLoop();
+}
+
+// Main event loop for the worker thread
+void WorkerThread::epollLoop()
 {
     while (running.load()) { // ; check if running 
-        const int ready = ::epoll_wait(epollFd, eventBuffer.data(), static_cast<int>(eventBuffer.size()), -1); // no timeout, wait blocks thread but cpu efficient 
+        markIdle();
+        // no timeout, wait blocks thread but cpu efficient; just poll while reads are owed
+        const int ready = ::epoll_wait(epollFd, eventBuffer.data(), static_cast<int>(eventBuffer.size()), pendingReads.empty() ? -1 : 0);
+        markBusy();
         if (ready == -1) {
             if (errno == EINTR) {
                 continue;
@@ -265,177 +885,393 @@ void WorkerThread::eventLoop()
 
         for (int i = 0; i < ready; ++i) {
             const epoll_event& event = eventBuffer[i];
-            const int fd = event.data.fd;
+            if (isControlTag(event.data.u64)) {
+                handleControlEvent(event.data.u64);
+                continue;
+            }
 
-            if (fd == wakeupFd) {
-                uint64_t value = 0;
-                ::read(wakeupFd, &value, sizeof(value));
+            // A client closed earlier in this batch is still allocated (see
+            // closedClients) but no longer owns its slot.
+            ClientState* state = liveClient(static_cast<ClientState*>(event.data.ptr));
+            if (!state) {
                 continue;
             }
 
             // error or connection closed by peer 
             if ((event.events & (EPOLLERR | EPOLLRDHUP | EPOLLHUP)) != 0) {
-                closeClient(fd);
+                closeClient(*state);
                 continue;
             }
 
             // socket is ready for read event 
             if (event.events & EPOLLIN) {
-                handleReadEvent(fd);
+                if (!handleReadEvent(*state)) {
+                    continue;
+                }
             } // socket is ready for write event
             if (event.events & EPOLLOUT) {
-                handleWriteEvent(fd);
+                handleWriteEvent(*state);
+                if (ClientState* open = liveClient(state)) {
+                    onFlushed(*open);
+                }
             }
         }
+
+        serviceReadyReads();
+        flushPendingWrites();
+        closedClients.clear();
     }
 }
 
-// no mutex required here, called from within the event loop thread only
-ClientState* WorkerThread::getClient(int clientFd)
+// Wakeup eventfd and listener; shared by both backends.
+void WorkerThread::handleControlEvent(uint64_t tag)
 {
-    //pthread_mutex_lock(&clientsMutex); // lock the mutex to protect access to clientStates
-    ClientState* state = nullptr;
-    const auto it = clientStates.find(clientFd);
-    if (it != clientStates.end()) {
-        state = it->second.get();
+    if (tag == kWakeupTag) {
+        uint64_t value = 0;
+        ::read(wakeupFd, &value, sizeof(value));
+        adoptPendingClients();
+        performHandoff();
+    } else if (tag == kListenerTag) {
+        acceptPendingClients();
+    } else if (tag == kTimerTag) {
+        advanceTimers();
     }
-    //pthread_mutex_unlock(&clientsMutex);
-    return state;
 }
 
-void WorkerThread::removeClient(int clientFd)
+// no mutex required here, the slot table is only touched by the event loop thread
+ClientState* WorkerThread::getClient(int clientFd)
 {
-    pthread_mutex_lock(&clientsMutex);
-    clientStates.erase(clientFd);
-    pthread_mutex_unlock(&clientsMutex);
+    const auto index = static_cast<std::size_t>(clientFd);
+    if (clientFd < 0 || index >= clientSlots.size()) {
+        return nullptr;
+    }
+    return clientSlots[index].state.get();
 }
 
-void WorkerThread::handleReadEvent(int clientFd)
+// Validates a ClientState* recovered from an epoll event.
+ClientState* WorkerThread::liveClient(ClientState* candidate)
 {
-    ClientState* state = getClient(clientFd);
-    if (!state) {
-        closeClient(clientFd);
-        return;
+    if (!candidate) {
+        return nullptr;
     }
+    const auto index = static_cast<std::size_t>(candidate->socket());
+    if (index >= clientSlots.size()) {
+        return nullptr;
+    }
+    const ClientSlot& slot = clientSlots[index];
+    if (slot.state.get() != candidate || slot.generation != candidate->generation()) {
+        return nullptr;
+    }
+    return candidate;
+}
 
-    char buffer[4096];
-    bool connectionOpen = true;
-
-    while (connectionOpen) {
-        const ssize_t bytes = recvNonBlocking(clientFd, buffer, sizeof(buffer));
-        if (bytes > 0) {
-            state->mutableRecvBuffer().append(buffer, static_cast<std::size_t>(bytes));
-            state->updateActivity(::time(nullptr));
-        } else if (bytes == 0) {
-            connectionOpen = false;
-            break;
-        } else {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            }
-            connectionOpen = false;
-            break;
-        }
+std::unique_ptr<ClientState> WorkerThread::removeClient(ClientState& state)
+{
+    ClientSlot& slot = clientSlots[static_cast<std::size_t>(state.socket())];
+    if (slot.state.get() != &state) {
+        return nullptr;
     }
+    return std::move(slot.state);
+}
 
-    if (!connectionOpen) {
-        closeClient(clientFd);
-        return;
+// Edge-triggered: read until the socket reports EAGAIN, running each chunk's
+// frames as it lands, so a command that pauses the client stops the reading
+// too. A client still sending after kMaxReadPerWakeup bytes goes on
+// pendingReads, which keeps its edge for the next pass of the loop.
+// Returns false if the client was closed.
+bool WorkerThread::handleReadEvent(ClientState& state)
+{
+    if (state.sharedMemory()) {
+        return handleShmRead(state);
     }
 
-    std::string& recvBuffer = state->mutableRecvBuffer();
-    while (true) {
-        if (recvBuffer.size() < kFrameHeaderSize) {
-            break;
+    RecvBuffer& recvBuffer = state.mutableRecvBuffer();
+    const int clientFd = state.socket();
+    std::size_t readThisWakeup = 0;
+
+    // Paused behind a backlogged peer: leave the data in the socket so TCP
+    // pushes back on the sender. resumeClient() reads it later.
+    while (!state.readPaused()) {
+        if (readThisWakeup >= kMaxReadPerWakeup) {
+            if (!state.readScheduled()) {
+                state.setReadScheduled(true);
+                pendingReads.push_back(clientFd);
+            }
+            return true;
         }
 
-        uint32_t netSize = 0;
-        std::memcpy(&netSize, recvBuffer.data(), kFrameHeaderSize);
-        const uint32_t payloadSize = ntohl(netSize);
-        if (payloadSize > kMaxFrameSize) {
-            closeClient(clientFd);
-            return;
+        // Read straight into the buffer, leaving room for the rest of a
+        // partially received frame so large frames land in a single recv.
+        char* tail = recvBuffer.prepare(std::max(kReadChunkSize, missingFrameBytes(recvBuffer)));
+        const ssize_t bytes = recvNonBlocking(clientFd, tail, recvBuffer.writable());
+        if (bytes > 0) {
+            recvBuffer.commit(static_cast<std::size_t>(bytes));
+            state.markHeard(idleTimers.now());
+            readThisWakeup += static_cast<std::size_t>(bytes);
+            if (!processFrames(state) || getClient(clientFd) != &state) {
+                return false; // closed by a frame or by one of its commands
+            }
+            continue;
         }
-        if (recvBuffer.size() < kFrameHeaderSize + payloadSize) {
-            break;
+        if (bytes == -1 && errno == EINTR) {
+            continue;
         }
-
-        std::string frame = recvBuffer.substr(kFrameHeaderSize, payloadSize);
-        recvBuffer.erase(0, kFrameHeaderSize + payloadSize);
-        const Command command = protocolHandler.parseCommand(frame);
-        processCommand(*state, command);
+        if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        closeClient(state);
+        return false;
     }
+    return true;
 }
 
-void WorkerThread::handleWriteEvent(int clientFd)
+// Clients that hit the read cap on an earlier pass; the epoll loop does not
+// block while any are listed.
+void WorkerThread::serviceReadyReads()
 {
-    ClientState* state = getClient(clientFd);
-    if (!state) {
-        closeClient(clientFd);
-        return;
+    std::vector<int> ready;
+    ready.swap(pendingReads);
+    for (const int fd : ready) {
+        ClientState* state = getClient(fd);
+        if (!state || !state->readScheduled()) {
+            continue; // closed, or the fd now belongs to a new connection
+        }
+        state->setReadScheduled(false);
+        handleReadEvent(*state);
     }
+}
 
-    std::string message;
-    while (state->popQueuedResponse(message)) {
-        std::size_t totalSent = 0;
-        while (totalSent < message.size()) {
-            const ssize_t sent = sendNonBlocking(clientFd, message.data() + totalSent, message.size() - totalSent);
-            if (sent > 0) {
-                totalSent += static_cast<std::size_t>(sent);
-                continue;
-            }
-            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                const std::string remainder = message.substr(totalSent);
-                state->queueResponse(remainder);
-                return;
+// Shared-memory sessions: the eventfd says the client wrote to its ring or
+// made room in ours; the socket only matters for hangup.
+bool WorkerThread::handleShmRead(ClientState& state)
+{
+    ShmTransport& shm = *state.sharedMemory();
+    shm.clearWakeup();
+
+    char discard[256];
+    while (true) {
+        const ssize_t bytes = recvNonBlocking(state.socket(), discard, sizeof(discard));
+        if (bytes > 0 || (bytes == -1 && errno == EINTR)) {
+            continue;
+        }
+        if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        closeClient(state);
+        return false;
+    }
+
+    // A paused client's bytes stay in its ring, which pushes back on it.
+    RecvBuffer& recvBuffer = state.mutableRecvBuffer();
+    while (!state.readPaused()) {
+        const std::size_t available = shm.readable();
+        if (available == 0) {
+            break;
+        }
+        char* tail = recvBuffer.prepare(available);
+        recvBuffer.commit(shm.receive(tail, available));
+        state.markHeard(idleTimers.now());
+        if (!processFrames(state)) {
+            return false;
+        }
+    }
+    if (shm.broken()) {
+        closeClient(state);
+        return false;
+    }
+    if (state.queuedBytes() > 0) {
+        scheduleFlush(state);
+    }
+    return true;
+}
+
+// Only offered on the Unix socket. The reply carries the segment and both
+// eventfds as SCM_RIGHTS; every byte after it, in both directions, goes
+// through the rings.
+bool WorkerThread::attachSharedMemory(ClientState& state, Response& response)
+{
+    response.success = false;
+    int family = AF_UNSPEC;
+    socklen_t length = sizeof(family);
+    if (config.shmRingBytes == 0) {
+        response.message = "Shared-memory transport disabled";
+        return false;
+    }
+    if (state.sharedMemory()) {
+        response.message = "Already attached";
+        return false;
+    }
+    if (uringActive.load(std::memory_order_relaxed)) {
+        response.message = "Not available on the io_uring backend";
+        return false;
+    }
+    if (::getsockopt(state.socket(), SOL_SOCKET, SO_DOMAIN, &family, &length) == -1 || family != AF_UNIX) {
+        response.message = "Only available over the Unix socket";
+        return false;
+    }
+    if (state.queuedBytes() > 0) {
+        response.message = "Output pending, retry";
+        return false;
+    }
+
+    std::unique_ptr<ShmTransport> transport = ShmTransport::create(config.shmRingBytes);
+    epoll_event ringEvent{};
+    ringEvent.events = EPOLLIN | EPOLLET;
+    ringEvent.data.ptr = &state;
+    if (!transport || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, transport->waitFd(), &ringEvent) == -1) {
+        response.message = "Shared memory unavailable";
+        return false;
+    }
+
+    Response accepted;
+    accepted.command = "shm_attach";
+    accepted.success = true;
+    accepted.message = "ok";
+    accepted.payload = nlohmann::json{{"ring_bytes", transport->ringBytes()}};
+    const std::string payload = protocolHandler.serializeResponse(accepted);
+    std::string frame(kFrameHeaderSize, '\0');
+    const uint32_t netSize = htonl(static_cast<uint32_t>(payload.size()));
+    std::memcpy(frame.data(), &netSize, kFrameHeaderSize);
+    frame += payload;
+
+    // The send queue is empty, so a frame this small goes out whole.
+    if (!transport->offer(state.socket(), frame)) {
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, transport->waitFd(), nullptr);
+        response.message = "Shared memory unavailable";
+        return false;
+    }
+    state.attachSharedMemory(std::move(transport));
+    return true;
+}
+
+// Parse and execute every complete frame in the receive buffer. Payloads are
+// handed to the parser as views into the buffer, which stays untouched until
+// the whole batch is consumed.
+// Stops early, leaving the rest buffered, if a command pauses the client.
+// Returns false if the client was closed (oversized frame).
+bool WorkerThread::processFrames(ClientState& state)
+{
+    RecvBuffer& recvBuffer = state.mutableRecvBuffer();
+    const std::string_view pending = recvBuffer.readable();
+    std::size_t offset = 0;
+    while (!state.readPaused() && pending.size() - offset >= kFrameHeaderSize) {
+        uint32_t netSize = 0;
+        std::memcpy(&netSize, pending.data() + offset, kFrameHeaderSize);
+        const uint32_t payloadSize = ntohl(netSize);
+        if (payloadSize > kMaxFrameSize) {
+            closeClient(state);
+            return false;
+        }
+        if (pending.size() - offset < kFrameHeaderSize + payloadSize) {
+            break;
+        }
+
+        const Command command = protocolHandler.parseCommand(pending.substr(offset + kFrameHeaderSize, payloadSize));
+        offset += kFrameHeaderSize + payloadSize;
+        processCommand(state, command);
+    }
+    recvBuffer.consume(offset);
+    return true;
+}
+
+// Writes until the queue is empty or the socket is full, gathering up to
+// kMaxGatherFrames queued frames into each sendmsg. A short write leaves the
+// rest of the head frame in place (tracked by offset), so ordering is kept.
+// On EAGAIN the armed EPOLLOUT edge brings us back once the peer has drained
+// some data.
+void WorkerThread::handleWriteEvent(ClientState& state)
+{
+    const int clientFd = state.socket();
+    while (true) {
+        sendViews.clear();
+        const std::size_t count = state.peekQueuedResponses(sendViews, kMaxGatherFrames);
+        if (count == 0) {
+            return;
+        }
+
+        sendIovecs.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            sendIovecs[i].iov_base = const_cast<char*>(sendViews[i].data());
+            sendIovecs[i].iov_len = sendViews[i].size();
+        }
+
+        ShmTransport* shm = state.sharedMemory();
+        const ssize_t sent = shm ? static_cast<ssize_t>(shm->send(sendIovecs.data(), count))
+                                 : sendGathered(clientFd, sendIovecs.data(), count);
+        if (sent > 0) {
+            state.consumeQueuedBytes(static_cast<std::size_t>(sent));
+            outboundBytes.fetch_sub(sent, std::memory_order_relaxed);
+            continue;
+        }
+        if (shm) {
+            // Ring full: the client kicks our eventfd once it has drained some.
+            if (shm->broken()) {
+                closeClient(state);
             }
-            closeClient(clientFd);
             return;
         }
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        closeClient(state);
+        return;
     }
-
-    epoll_event ev{};
-    ev.events = eventMaskHasWrite(false);
-    ev.data.fd = clientFd;
-    ::epoll_ctl(epollFd, EPOLL_CTL_MOD, clientFd, &ev);
 }
 
 void WorkerThread::processCommand(ClientState& state, const Command& command)
 {
     Response response;
 
+    // Heartbeats prove the peer is alive but don't keep a session from idling out.
+    if (command.type != Command::Type::Ping && command.type != Command::Type::Pong) {
+        state.updateActivity(idleTimers.now());
+    }
+
     switch (command.type) {
-    case Command::Type::Register: {
-        response.command = "register";
-        const bool ok = authManager.registerUser(command.username, command.password);
-        response.success = ok;
-        response.message = ok ? "Registered" : "Registration failed";
+    case Command::Type::Register:
+    case Command::Type::Login: {
+        response.command = command.type == Command::Type::Login ? "login" : "register";
+        if (command.type == Command::Type::Login && state.isAuthenticated()) {
+            response.success = false;
+            response.message = "Already logged in!";
+            break;
+        }
+        if (submitAuth(state, command)) {
+            return; // answered by finishAuth
+        }
+        response.success = false;
+        response.message = "Server busy, try again";
         break;
     }
-    case Command::Type::Login: {
-        response.command = "login";
+    case Command::Type::Resume: {
+        // A MAC check instead of Argon2, so reconnect storms stay cheap;
+        // answered inline. The token is replaced with a fresh one, and one
+        // below the user's stored epoch has been retired or revoked.
+        response.command = "resume";
+        std::string username;
+        uint32_t epoch = 0;
+        int userId = 0;
+        int currentEpoch = 0;
         if (state.isAuthenticated()) {
             response.success = false;
             response.message = "Already logged in!";
-        }
-        else if (authManager.loginUser(command.username, command.password)) {
-            // check if user is already logged in elsewhere?
-            if (messageRouter.isRegistered(command.username)) {
-                response.success = false;
-                response.message = "User already logged in elsewhere";
-                break;
-            }
-            state.setAuthenticated(true);
-            state.setUsername(command.username);
-            messageRouter.registerClient(command.username, &state);
-            // Flush queued messages via OfflineDelivery helper once auth succeeds
-            deliverOfflineMessages(database, cryptoEngine, command.username, state);
-            statusManager.setState(StatusManager::State::Operational);
-            response.success = true;
-            response.message = "Login successful";
-        } else {
+        } else if (config.resumeTokenSeconds == 0
+                   || !cryptoEngine.verifyResumeToken(command.token, unixSeconds(), username, epoch)
+                   || !messageRouter.directory().resolve(username, userId)
+                   || !database.tokenEpoch(userId, currentEpoch)
+                   || epoch < static_cast<uint32_t>(currentEpoch)) {
             response.success = false;
-            response.message = "Invalid credentials";
+            response.message = "Invalid or expired token";
+        } else if (!establishSession(state, userId, username, OfflineBatch{})) {
+            response.success = false;
+            response.message = "User already logged in elsewhere";
+        } else {
+            response.success = true;
+            response.message = "Session resumed";
+            grantResumeToken(response, userId, username, epoch);
         }
         break;
     }
@@ -452,11 +1288,88 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
             response.message = "Missing recipient";
             break;
         }
-        if (!messageRouter.routeMessage(sender, command.recipient, command.content)) {
+        // Ack after commit: the writer's completion comes back to this loop
+        // and answers the connection, if it is still the same one.
+        const bool ackOnCommit = command.ackOnCommit.value_or(config.sendMessageAck == ServerConfig::WriteAck::Committed);
+        DatabaseWriter::Completion onStored;
+        if (ackOnCommit) {
+            onStored = replyOnCommit(state, "send_message", {}, "Message stored", "Delivery failed");
+        }
+        if (!messageRouter.routeMessage(state.userId(), sender, command.recipient, command.content, std::move(onStored))) {
             response.success = false;
             response.message = "Delivery failed";
             break;
         }
+        if (config.slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::PauseSenders
+            && messageRouter.blockOnBackloggedRecipient(command.recipient, state)) {
+            pauseReading(state);
+        }
+        if (ackOnCommit) {
+            return; // answered by the completion
+        }
+        response.success = true;
+        response.message = "Message queued";
+        break;
+    }
+    case Command::Type::CreateGroup:
+    case Command::Type::JoinGroup:
+    case Command::Type::LeaveGroup:
+    case Command::Type::SendGroup: {
+        response.command = command.type == Command::Type::CreateGroup ? "create_group"
+                         : command.type == Command::Type::JoinGroup   ? "join_group"
+                         : command.type == Command::Type::LeaveGroup  ? "leave_group"
+                                                                      : "send_group";
+        response.group = command.group;
+        if (!state.isAuthenticated()) {
+            response.success = false;
+            response.message = "Authentication required";
+            break;
+        }
+        if (command.group.empty()) {
+            response.success = false;
+            response.message = "Missing group";
+            break;
+        }
+        if (command.type == Command::Type::CreateGroup) {
+            // answered once the writer has committed (or refused a taken name)
+            auto reply = replyOnCommit(state, response.command, command.group, "Group created", "Group name taken");
+            messageRouter.createGroup(state.userId(), command.group,
+                                      [reply](bool created, int) { reply(created); });
+            return;
+        }
+
+        int groupId = 0;
+        if (!database.findGroupId(command.group, groupId)) {
+            response.success = false;
+            response.message = "Unknown group";
+            break;
+        }
+        if (command.type == Command::Type::JoinGroup) {
+            messageRouter.joinGroup(state.userId(), groupId,
+                                    replyOnCommit(state, response.command, command.group, "Joined group", "Join failed"));
+            return;
+        }
+        if (command.type == Command::Type::LeaveGroup) {
+            messageRouter.leaveGroup(state.userId(), groupId,
+                                     replyOnCommit(state, response.command, command.group, "Left group", "Not a member"));
+            return;
+        }
+
+        if (!database.isGroupMember(groupId, state.userId())) {
+            response.success = false;
+            response.message = "Not a member";
+            break;
+        }
+        const bool ackOnCommit = command.ackOnCommit.value_or(config.sendMessageAck == ServerConfig::WriteAck::Committed);
+        DatabaseWriter::Completion onStored;
+        if (ackOnCommit) {
+            onStored = replyOnCommit(state, response.command, command.group, "Message stored", "Delivery failed");
+        }
+        messageRouter.routeGroupMessage(state.userId(), state.username(), groupId, command.group, command.content,
+                                        std::move(onStored));
+        if (ackOnCommit) {
+            return; // answered by the completion
+        }
         response.success = true;
         response.message = "Message queued";
         break;
@@ -465,10 +1378,18 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
         response.command = "logout";
         if (state.isAuthenticated()) {
             const std::string username = state.username();
-            messageRouter.unregisterClient(username);
-            database.logActivity("INFO", "User logout: " + username);
+            const int userId = state.userId();
+            messageRouter.unregisterClient(userId);
+            messageRouter.writer().submit([userId](Database& db) { return db.revokeTokens(userId); });
+            logActivity("INFO", "User logout: " + username);
+            presenceSubscribers.erase(std::remove_if(presenceSubscribers.begin(), presenceSubscribers.end(),
+                                                     [&state](const PresenceSubscriber& subscriber) {
+                                                         return subscriber.fd == state.socket();
+                                                     }),
+                                      presenceSubscribers.end());
             state.setAuthenticated(false);
             state.setUsername({});
+            state.setUserId(0);
             response.success = true;
             response.message = "Logged out";
         } else {
@@ -529,6 +1450,53 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
         };
         break;
     }
+    case Command::Type::ListBacklogged: {
+        response.command = "list_backlogged";
+        if (!state.isAuthenticated()) {
+            response.success = false;
+            response.message = "Authentication required";
+            break;
+        }
+        auto backlogged = messageRouter.listBackloggedUsers();
+        std::sort(backlogged.begin(), backlogged.end());
+
+        nlohmann::json userArray = nlohmann::json::array();
+        for (const auto& user : backlogged) {
+            userArray.push_back({{"username", user}});
+        }
+
+        response.success = true;
+        response.message = "ok";
+        response.payload = nlohmann::json{
+            {"users", userArray}
+        };
+        break;
+    }
+    case Command::Type::SubscribePresence: {
+        response.command = "subscribe_presence";
+        if (!state.isAuthenticated()) {
+            response.success = false;
+            response.message = "Authentication required";
+            break;
+        }
+        // pending changes go to the current subscribers first, so the
+        // snapshot's version is as recent as it can be
+        pushPresence();
+        const auto subscribed = std::find_if(presenceSubscribers.begin(), presenceSubscribers.end(),
+                                             [&state](const PresenceSubscriber& subscriber) {
+                                                 return subscriber.fd == state.socket()
+                                                     && subscriber.generation == state.generation();
+                                             });
+        if (subscribed == presenceSubscribers.end()) {
+            presenceSubscribers.push_back(PresenceSubscriber{state.socket(), state.generation(), false});
+        } else {
+            subscribed->stale = false;
+        }
+        response.success = true;
+        response.message = "ok";
+        fillPresenceSnapshot(response);
+        break;
+    }
     case Command::Type::GetHistory: {
         response.command = "get_history";
         if (!state.isAuthenticated()) {
@@ -536,7 +1504,7 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
             response.message = "Authentication required";
             break;
         }
-        const std::string requester = state.username();
+        const int requesterId = state.userId();
         const std::string other = command.targetUser;
         if (other.empty()) {
             response.success = false;
@@ -544,14 +1512,8 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
             break;
         }
 
-        int requesterId = 0;
         int otherId = 0;
-        if (!database.findUserId(requester, requesterId)) {
-            response.success = false;
-            response.message = "Unknown requester";
-            break;
-        }
-        if (!database.findUserId(other, otherId)) {
+        if (!messageRouter.directory().resolve(other, otherId)) {
             response.success = false;
             response.message = "Unknown user";
             break;
@@ -566,16 +1528,16 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
             CryptoEngine::CipherMessage cipher { msg.nonce, msg.ciphertext };
             std::string plaintext;
             if (!cryptoEngine.decryptMessage(cipher, plaintext)) {
-                database.logActivity("ERROR", "Failed to decrypt message id " + std::to_string(msg.id));
+                logActivity("ERROR", "Failed to decrypt message id " + std::to_string(msg.id));
                 continue;
             }
 
             std::string senderName;
             std::string recipientName;
-            if (!database.findUsername(msg.senderId, senderName)) {
+            if (!messageRouter.directory().nameOf(msg.senderId, senderName)) {
                 senderName = "unknown";
             }
-            if (!database.findUsername(msg.recipientId, recipientName)) {
+            if (!messageRouter.directory().nameOf(msg.recipientId, recipientName)) {
                 recipientName = "unknown";
             }
 
@@ -601,6 +1563,20 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
         };
         break;
     }
+    case Command::Type::Ping: {
+        response.command = "pong";
+        response.success = true;
+        response.message = "pong";
+        break;
+    }
+    case Command::Type::Pong:
+        return; // answer to our heartbeat; receiving it was the point
+    case Command::Type::ShmAttach:
+        response.command = "shm_attach";
+        if (attachSharedMemory(state, response)) {
+            return; // the reply went out with the descriptors
+        }
+        break;
     case Command::Type::Unknown:
     default:
         response.command = "unknown";
@@ -612,18 +1588,799 @@ void WorkerThread::processCommand(ClientState& state, const Command& command)
     state.queueProtocolResponse(response);
 }
 
-void WorkerThread::closeClient(int clientFd)
+
+void WorkerThread::closeClient(ClientState& state)
+{
+    if (state.isAuthenticated()) {
+        const std::string username = state.username();
+        messageRouter.unregisterClient(state.userId());
+        logActivity("INFO", "User disconnected: " + username);
+    }
+
+    std::unique_ptr<ClientState> owned = removeClient(state);
+    if (!owned) {
+        return;
+    }
+    admissionControl.release(owned->socket());
+    idleTimers.cancel(owned->socket());
+    if (owned->isBacklogged()) {
+        owned->setBacklogged(false);
+    }
+    releaseBlockedSenders(*owned);
+    connectionCount.fetch_sub(1, std::memory_order_relaxed);
+    outboundBytes.fetch_sub(static_cast<int64_t>(owned->queuedBytes()), std::memory_order_relaxed);
+
+    if (uringActive.load(std::memory_order_relaxed)) {
+        retireUringClient(std::move(owned));
+        return;
+    }
+
+    if (const ShmTransport* shm = owned->sharedMemory()) {
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, shm->waitFd(), nullptr);
+    }
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, owned->socket(), nullptr);
+    ::close(owned->socket());
+    // Other events from this epoll_wait batch may still point at it.
+    closedClients.push_back(std::move(owned));
+}
+
+/*
+io_uring backend
+
+Client sockets never enter the epoll set. Each one gets a multishot RECV that
+picks buffers from the worker's provided-buffer ring, so one submission
+delivers every subsequent read. Outbound frames go out as a chain of linked
+SENDs pointing straight into ClientState::sendQueue; frames are only dropped
+from the queue when their completion arrives, so a short send or error breaks
+the chain (the rest complete with -ECANCELED) and the next chain resumes from
+the first unsent byte.
+
+The epoll set keeps the control fds (wakeup eventfd, listener) and is itself
+watched by a multishot POLL_ADD, so cross-thread wakeups and accepts work the
+same as in the epoll backend.
+*/
+bool WorkerThread::setupUring()
+{
+    auto candidate = std::make_unique<IoUring>();
+    if (!candidate->init(kUringEntries)
+        || !candidate->setupBufferRing(kUringBufferGroup, kUringBufferCount, kUringBufferSize)
+        || !candidate->probeMultishotRecv()) {
+        return false;
+    }
+
+    ring = std::move(candidate);
+    uringActive.store(true, std::memory_order_release);
+    return true;
+}
+
+void WorkerThread::uringLoop()
+{
+    armEpollPoll();
+
+    while (running.load()) {
+        // Don't block while the epoll set still has work left over from a
+        // bounded accept batch: the multishot poll only fires on new wakeups.
+        markIdle();
+        const int submitted = ring->submit(controlBacklog ? 0 : 1);
+        markBusy();
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            std::perror("io_uring_enter");
+            break;
+        }
+        ring->drainCompletions([this](const io_uring_cqe& cqe) { handleCompletion(cqe); });
+        if (controlBacklog) {
+            drainControlEvents();
+        }
+        flushPendingWrites();
+    }
+
+    drainUringOnExit();
+}
+
+void WorkerThread::armEpollPoll()
+{
+    io_uring_sqe* sqe = ring->nextSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = epollFd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = packUserData(UringOp::EpollReady, epollFd, 0);
+    epollPollArmed = true;
+}
+
+// One non-blocking pass over the control fds. controlBacklog stays set until
+// a pass comes back empty, so level-triggered leftovers are never stranded.
+void WorkerThread::drainControlEvents()
+{
+    const int ready = ::epoll_wait(epollFd, eventBuffer.data(), static_cast<int>(eventBuffer.size()), 0);
+    for (int i = 0; i < ready; ++i) {
+        handleControlEvent(eventBuffer[i].data.u64);
+    }
+    controlBacklog = ready > 0;
+}
+
+void WorkerThread::armUringRecv(ClientState& state)
+{
+    if (state.receiveArmed() || state.readPaused() || !running.load()) {
+        return;
+    }
+
+    io_uring_sqe* sqe = ring->nextSqe();
+    if (!sqe) {
+        closeClient(state);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = state.socket();
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ring->bufferGroup();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = packUserData(UringOp::Recv, state.socket(), state.generation());
+    state.setReceiveArmed(true);
+}
+
+void WorkerThread::submitUringSends(ClientState& state)
+{
+    if (state.sendsInFlight() > 0 || !running.load()) {
+        return;
+    }
+
+    // Reserve the whole chain up front: a link must never point at an SQE
+    // that was submitted on its own.
+    const std::size_t room = ring->reserveSqes(kMaxLinkedSends);
+    sendViews.clear();
+    const std::size_t count = state.peekQueuedResponses(sendViews, room);
+    if (count == 0) {
+        return;
+    }
+
+    const int fd = state.socket();
+    for (std::size_t i = 0; i < count; ++i) {
+        io_uring_sqe* sqe = ring->nextSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(sendViews[i].data());
+        sqe->len = static_cast<uint32_t>(sendViews[i].size());
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->flags = (i + 1 < count) ? IOSQE_IO_LINK : 0;
+        sqe->user_data = packUserData(UringOp::Send, fd, state.generation());
+    }
+    state.setSendsInFlight(static_cast<unsigned>(count));
+}
+
+void WorkerThread::handleCompletion(const io_uring_cqe& cqe)
+{
+    const UringOp op = userDataOp(cqe.user_data);
+    if (op == UringOp::Cancel) {
+        return;
+    }
+
+    if (op == UringOp::EpollReady) {
+        drainControlEvents();
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            epollPollArmed = false;
+            if (running.load()) {
+                armEpollPoll();
+            }
+        }
+        return;
+    }
+
+    const int fd = userDataFd(cqe.user_data);
+    const uint32_t generation = userDataGeneration(cqe.user_data);
+    ClientState* state = getClient(fd);
+    if (!state || state->generation() != generation) {
+        handleRetiredCompletion(fd, generation, cqe);
+        return;
+    }
+
+    if (op == UringOp::Recv) {
+        const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        if (!more) {
+            state->setReceiveArmed(false);
+        }
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            const auto bufferId = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0) {
+                state->mutableRecvBuffer().append(ring->providedBuffer(bufferId), static_cast<std::size_t>(cqe.res));
+            }
+            ring->recycleBuffer(bufferId);
+        }
+
+        if (cqe.res > 0) {
+            state->markHeard(idleTimers.now());
+            if (processFrames(*state) && !more) {
+                armUringRecv(*state);
+            }
+        } else if (cqe.res == -ENOBUFS) {
+            armUringRecv(*state); // buffer ring ran dry; they are recycled by now
+        } else if (cqe.res == -ECANCELED) {
+            armUringRecv(*state); // cancelled by pauseReading(); a no-op until resumed
+        } else {
+            closeClient(*state); // EOF or socket error
+        }
+        return;
+    }
+
+    // UringOp::Send: completions of one chain arrive in submission order.
+    state->setSendsInFlight(state->sendsInFlight() - 1);
+    if (cqe.res < 0) {
+        if (cqe.res != -ECANCELED) {
+            closeClient(*state);
+            return;
+        }
+    } else {
+        state->consumeQueuedBytes(static_cast<std::size_t>(cqe.res));
+        outboundBytes.fetch_sub(cqe.res, std::memory_order_relaxed);
+        if (state->sendsInFlight() == 0) {
+            onFlushed(*state);
+            if (getClient(fd) != state) {
+                return; // closed: expired session drained, or slow consumer dropped
+            }
+        }
+    }
+
+    if (state->sendsInFlight() == 0) {
+        submitUringSends(*state);
+    }
+}
+
+void WorkerThread::handleRetiredCompletion(int fd, uint32_t generation, const io_uring_cqe& cqe)
+{
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        ring->recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+    }
+
+    const auto it = retiringClients.find(fd);
+    if (it == retiringClients.end() || it->second->generation() != generation) {
+        return;
+    }
+
+    ClientState& state = *it->second;
+    if (userDataOp(cqe.user_data) == UringOp::Recv) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            state.setReceiveArmed(false);
+        }
+    } else {
+        state.setSendsInFlight(state.sendsInFlight() - 1);
+    }
+
+    if (!state.receiveArmed() && state.sendsInFlight() == 0) {
+        ::close(fd);
+        retiringClients.erase(it);
+    }
+}
+
+// Loops because flushing can queue more output on this thread (spilled
+// messages delivered once a backlog clears, resumed readers' responses).
+void WorkerThread::flushPendingWrites()
+{
+    const bool uring = uringActive.load(std::memory_order_relaxed);
+    std::vector<int> dirty;
+    do {
+        drainOutbox();
+
+        dirty.clear();
+        dirty.swap(pendingWrites);
+        for (const int fd : dirty) {
+            ClientState* state = getClient(fd);
+            if (!state) {
+                continue;
+            }
+            state->setFlushScheduled(false);
+            if (uring) {
+                submitUringSends(*state);
+            } else {
+                handleWriteEvent(*state);
+            }
+            if (getClient(fd) == state) {
+                onFlushed(*state);
+            }
+        }
+    } while (!pendingWrites.empty() || !resumeRequests.empty() || !mailbox.empty() || !tasks.empty());
+}
+
+void WorkerThread::scheduleFlush(ClientState& state)
+{
+    if (!state.flushScheduled()) {
+        state.setFlushScheduled(true);
+        pendingWrites.push_back(state.socket());
+    }
+}
+
+// Frames for a connection that closed (or whose fd was reused) after they
+// were posted are dropped here.
+void WorkerThread::drainOutbox()
+{
+    outbox.drain([this](OutboundFrame& item) {
+        ClientState* state = getClient(item.fd);
+        if (!state || state->generation() != item.generation) {
+            outboundBytes.fetch_sub(static_cast<int64_t>(item.frame.size()), std::memory_order_relaxed);
+            return;
+        }
+        state->appendQueuedFrame(std::move(item.frame));
+        scheduleFlush(*state);
+    });
+
+    mailbox.drain([this](MailboxItem& item) {
+        ClientState* state = getClient(item.fd);
+        if (state && state->generation() == item.generation) {
+            deliverMessage(*state, item.message);
+        }
+    });
+
+    resumeRequests.drain([this](ClientRef& ref) {
+        ClientState* state = getClient(ref.fd);
+        if (state && state->generation() == ref.generation) {
+            resumeClient(*state);
+        }
+    });
+
+    tasks.drain([](std::function<void()>& task) {
+        task();
+    });
+}
+
+// A message that finds its recipient logged out (the connection may have
+// logged in as someone else since), or backlogged under SpillOffline, stays
+// undelivered in the store; login and backlog recovery pick it up from there.
+void WorkerThread::deliverMessage(ClientState& state, const IncomingMessage& message)
+{
+    if (!state.isAuthenticated() || state.userId() != message.recipientId
+        || (config.slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::SpillOffline && state.isBacklogged())) {
+        return;
+    }
+    // stored before a catch-up that already queued it, but routed after the
+    // session registered (or after the backlog cleared)
+    if (state.alreadyQueued(message)) {
+        return;
+    }
+    if (message.frame) {
+        state.queueFrame(message.frame);
+    } else {
+        state.queueIncomingMessage(message.sender, message.content, message.timestamp, message.id);
+    }
+    messageRouter.confirmDelivered(message);
+}
+
+// Activity rows go through the writer like every other write, so a batch in
+// progress never stalls this loop.
+void WorkerThread::logActivity(const char* level, std::string message)
+{
+    messageRouter.writer().submit([level, message = std::move(message)](Database& db) {
+        return db.logActivity(level, message);
+    });
+}
+
+// Writer completion that answers the connection from this loop once the job's
+// batch is over, if the connection is still the same one.
+DatabaseWriter::Completion WorkerThread::replyOnCommit(ClientState& state,
+                                                       const std::string& command,
+                                                       const std::string& group,
+                                                       const std::string& okMessage,
+                                                       const std::string& failMessage)
+{
+    const int clientFd = state.socket();
+    const uint32_t generation = state.generation();
+    return [this, clientFd, generation, command, group, okMessage, failMessage](bool committed) {
+        postTask([this, clientFd, generation, command, group, okMessage, failMessage, committed] {
+            ClientState* target = getClient(clientFd);
+            if (!target || target->generation() != generation) {
+                return;
+            }
+            Response ack;
+            ack.command = command;
+            ack.success = committed;
+            ack.message = committed ? okMessage : failMessage;
+            if (!group.empty()) {
+                ack.group = group;
+            }
+            target->queueProtocolResponse(ack);
+        });
+    };
+}
+
+// Argon2 takes ~50 ms, so the hash runs on the auth pool while this loop
+// serves everyone else. The connection stops reading until the answer is
+// back, so the commands it pipelined behind the login see the outcome. A
+// successful login also reads the offline queue on the pool thread.
+bool WorkerThread::submitAuth(ClientState& state, const Command& command)
+{
+    const int clientFd = state.socket();
+    const uint32_t generation = state.generation();
+    const bool login = command.type == Command::Type::Login;
+    Command request = command;
+    request.password.clear();
+
+    auto done = [this, clientFd, generation, login, request](bool ok) {
+        int userId = 0;
+        OfflineBatch prefetched;
+        if (login && ok) {
+            ok = messageRouter.directory().resolve(request.username, userId);
+            fetchOfflineMessages(database, cryptoEngine, messageRouter.directory(), request.username, prefetched);
+        }
+        postTask([this, clientFd, generation, request, ok, userId, prefetched = std::move(prefetched)] {
+            ClientState* target = getClient(clientFd);
+            if (target && target->generation() == generation) {
+                finishAuth(*target, request, ok, userId, prefetched);
+            }
+        });
+    };
+
+    // The completion is posted to this loop, so it cannot run before we pause.
+    const bool queued = login
+        ? authManager.loginUserAsync(command.username, command.password, std::move(done))
+        : authManager.registerUserAsync(command.username, command.password, std::move(done));
+    if (queued) {
+        state.setAuthPending(true);
+        pauseReading(state);
+    }
+    return queued;
+}
+
+void WorkerThread::finishAuth(ClientState& state, const Command& command, bool ok, int userId, const OfflineBatch& prefetched)
+{
+    state.setAuthPending(false);
+
+    Response response;
+    if (command.type != Command::Type::Login) {
+        response.command = "register";
+        response.success = ok;
+        response.message = ok ? "Registered" : "Registration failed";
+    } else if (!ok) {
+        response.command = "login";
+        response.success = false;
+        response.message = "Invalid credentials";
+    } else if (!establishSession(state, userId, command.username, prefetched)) {
+        response.command = "login";
+        response.success = false;
+        response.message = "User already logged in elsewhere";
+    } else {
+        response.command = "login";
+        response.success = true;
+        response.message = "Login successful";
+        if (command.wantResumeToken) {
+            grantResumeToken(response, userId, command.username, 0);
+        }
+    }
+    state.queueProtocolResponse(response);
+    resumeClient(state);
+}
+
+// Shared by LOGIN and RESUME once the user is known to be who they claim.
+bool WorkerThread::establishSession(ClientState& state, int userId, const std::string& username, const OfflineBatch& prefetched)
 {
-    ClientState* state = getClient(clientFd);
-    if (state) {
-        if (state->isAuthenticated()) {
-            const std::string username = state->username();
-            messageRouter.unregisterClient(username);
-            database.logActivity("INFO", "User disconnected: " + username);
+    if (!messageRouter.registerClient(userId, username, state.handle())) {
+        return false;
+    }
+    state.setAuthenticated(true);
+    state.setUsername(username);
+    state.setUserId(userId);
+    // Flush the prefetched queue, then whatever was stored between the
+    // prefetch and registerClient (later messages arrive in real time).
+    queueOfflineMessages(messageRouter.writer(), username, prefetched, state);
+    OfflineBatch late;
+    if (fetchOfflineMessages(database, cryptoEngine, messageRouter.directory(), username, late, prefetched.lastId, &prefetched)) {
+        queueOfflineMessages(messageRouter.writer(), username, late, state);
+    }
+    statusManager.setState(StatusManager::State::Operational);
+    return true;
+}
+
+// The new token carries an epoch above every earlier one (`presented` is the
+// one RESUME just accepted, which may be ahead of a raise not yet committed),
+// and raising the stored epoch to it retires them.
+void WorkerThread::grantResumeToken(Response& response, int userId, const std::string& username, uint32_t presented)
+{
+    int stored = 0;
+    if (config.resumeTokenSeconds == 0 || !database.tokenEpoch(userId, stored)) {
+        return;
+    }
+    const uint32_t epoch = std::max(static_cast<uint32_t>(stored), presented) + 1;
+    messageRouter.writer().submit([userId, epoch](Database& db) {
+        return db.raiseTokenEpoch(userId, static_cast<int>(epoch));
+    });
+
+    const uint64_t expiresAt = unixSeconds() + config.resumeTokenSeconds;
+    response.payload = nlohmann::json{
+        {"username", username},
+        {"resume_token", cryptoEngine.issueResumeToken(username, epoch, expiresAt)},
+        {"expires_in", config.resumeTokenSeconds}
+    };
+}
+
+// Runs after every flush attempt on a client that is still open.
+void WorkerThread::onFlushed(ClientState& state)
+{
+    if (state.closing()) {
+        if (state.queuedBytes() == 0) {
+            closeClient(state);
+        }
+        return;
+    }
+    updateBacklog(state);
+}
+
+// Watermark hysteresis on the client's send queue. Only the owner thread
+// sees queuedBytes(), so it is checked after every flush attempt.
+void WorkerThread::updateBacklog(ClientState& state)
+{
+    const std::size_t queued = state.queuedBytes();
+    const auto who = [&state]() {
+        return state.isAuthenticated() ? state.username() : "fd " + std::to_string(state.socket());
+    };
+
+    if (!state.isBacklogged()) {
+        if (queued < config.sendHighWatermark) {
+            return;
+        }
+        if (config.slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::Disconnect) {
+            logActivity("WARN", "Disconnecting slow consumer " + who() + " (" + std::to_string(queued) + " bytes queued)");
+            closeClient(state);
+            return;
+        }
+        state.setBacklogged(true);
+        logActivity("WARN", "Slow consumer " + who() + " (" + std::to_string(queued) + " bytes queued)");
+        return;
+    }
+
+    if (queued > config.sendLowWatermark) {
+        return;
+    }
+    state.setBacklogged(false);
+    logActivity("INFO", "Slow consumer recovered: " + who());
+    releaseBlockedSenders(state);
+    if (config.slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::SpillOffline && state.isAuthenticated()) {
+        deliverOfflineMessages(database, messageRouter.writer(), cryptoEngine, messageRouter.directory(), state.username(), state);
+    }
+}
+
+void WorkerThread::releaseBlockedSenders(ClientState& state)
+{
+    for (const ClientState::BlockedSender& sender : state.takeBlockedSenders()) {
+        sender.owner->resumeReading(sender.socketFd, sender.generation);
+    }
+}
+
+void WorkerThread::pauseReading(ClientState& state)
+{
+    state.setReadPaused(true);
+    if (!uringActive.load(std::memory_order_relaxed) || !state.receiveArmed()) {
+        return;
+    }
+    // Stop the multishot recv so the kernel, not our buffer, holds the data.
+    if (io_uring_sqe* sqe = ring->nextSqe()) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = packUserData(UringOp::Recv, state.socket(), state.generation());
+        sqe->user_data = packUserData(UringOp::Cancel, state.socket(), state.generation());
+    }
+}
+
+// Pick up where processFrames stopped, then read whatever arrived meanwhile.
+void WorkerThread::resumeClient(ClientState& state)
+{
+    if (!state.readPaused() || state.closing() || state.authPending()) {
+        return;
+    }
+    state.setReadPaused(false);
+    if (uringActive.load(std::memory_order_relaxed)) {
+        if (processFrames(state)) {
+            armUringRecv(state);
+        }
+        return;
+    }
+    if (processFrames(state)) {
+        handleReadEvent(state);
+    }
+}
+
+// Sessions only reach the wheel's callback at their earliest deadline, so
+// reads never touch the wheel: they just bump the timestamps, and a timer
+// that fires early re-arms itself from them.
+void WorkerThread::advanceTimers()
+{
+    uint64_t expirations = 0;
+    ::read(timerFd, &expirations, sizeof(expirations));
+    idleTimers.advance(monotonicSeconds(), [this](int fd, uint32_t generation) {
+        ClientState* state = getClient(fd);
+        if (state && state->generation() == generation) {
+            handleIdleTimer(*state);
+        }
+    });
+    pushPresence();
+}
+
+// Everyone online, as of presenceVersion: the next delta this loop pushes
+// starts there. Changes that land while the registry is being listed come
+// again in that delta, which is harmless since deltas carry states.
+void WorkerThread::fillPresenceSnapshot(Response& response)
+{
+    auto onlineUsers = messageRouter.listActiveUsers();
+    std::sort(onlineUsers.begin(), onlineUsers.end());
+    response.payload = nlohmann::json{
+        {"version", presenceVersion},
+        {"online", onlineUsers}
+    };
+}
+
+// Once a tick: everything that changed since the last one, coalesced per
+// user, serialized once and queued on every subscriber of this loop.
+void WorkerThread::pushPresence()
+{
+    PresenceLog& presence = messageRouter.presence();
+    if (presenceSubscribers.empty()) {
+        presenceVersion = presence.version();
+        return;
+    }
+
+    std::vector<PresenceLog::Change> changes;
+    const uint64_t from = presenceVersion;
+    const bool complete = presence.changesSince(from, presenceVersion, changes);
+
+    std::shared_ptr<const std::string> frame;
+    if (complete && !changes.empty()) {
+        nlohmann::json online = nlohmann::json::array();
+        nlohmann::json offline = nlohmann::json::array();
+        for (const auto& change : changes) {
+            (change.online ? online : offline).push_back(change.username);
+        }
+        Response delta;
+        delta.command = "presence";
+        delta.message = "";
+        delta.payload = nlohmann::json{
+            {"from", from},
+            {"version", presenceVersion},
+            {"online", std::move(online)},
+            {"offline", std::move(offline)}
+        };
+        frame = std::make_shared<const std::string>(
+            ClientState::encodeFrame(protocolHandler.serializeResponse(delta)));
+    }
+
+    auto subscriber = presenceSubscribers.begin();
+    while (subscriber != presenceSubscribers.end()) {
+        ClientState* state = getClient(subscriber->fd);
+        if (!state || state->generation() != subscriber->generation || !state->isAuthenticated()) {
+            subscriber = presenceSubscribers.erase(subscriber);
+            continue;
+        }
+        const bool backlogged = config.slowConsumerPolicy == ServerConfig::SlowConsumerPolicy::SpillOffline
+                             && state->isBacklogged();
+        if (!complete || (frame && backlogged)) {
+            subscriber->stale = true;
+        }
+        if (subscriber->stale && !backlogged) {
+            Response snapshot;
+            snapshot.command = "presence";
+            snapshot.message = "";
+            fillPresenceSnapshot(snapshot);
+            state->queueProtocolResponse(snapshot);
+            subscriber->stale = false;
+        } else if (frame && !subscriber->stale) {
+            state->queueFrame(frame);
+        }
+        ++subscriber;
+    }
+}
+
+void WorkerThread::scheduleIdleCheck(ClientState& state)
+{
+    const uint64_t now = idleTimers.now();
+    uint64_t due = UINT64_MAX;
+    if (config.idleTimeoutSeconds > 0) {
+        due = state.lastActivity() + config.idleTimeoutSeconds;
+    }
+    if (config.heartbeatSeconds > 0) {
+        uint64_t ping = state.lastHeard() + config.heartbeatSeconds;
+        if (ping <= now) {
+            ping = now + config.heartbeatSeconds; // just pinged; next probe one interval on
+        }
+        due = std::min(due, ping);
+    }
+    if (due != UINT64_MAX) {
+        idleTimers.schedule(state.socket(), state.generation(), due);
+    }
+}
+
+void WorkerThread::handleIdleTimer(ClientState& state)
+{
+    if (state.closing()) {
+        closeClient(state); // `timeout` did not drain within the linger period
+        return;
+    }
+
+    const uint64_t now = idleTimers.now();
+    if (config.idleTimeoutSeconds > 0 && now - state.lastActivity() >= config.idleTimeoutSeconds) {
+        expireSession(state);
+        return;
+    }
+
+    // Silent peer: a ping either gets acked by its TCP stack or, once
+    // TCP_USER_TIMEOUT runs out, turns into a socket error that closes it.
+    if (config.heartbeatSeconds > 0 && now - state.lastHeard() >= config.heartbeatSeconds) {
+        Response ping;
+        ping.command = "ping";
+        ping.message = "";
+        state.queueProtocolResponse(ping);
+    }
+    scheduleIdleCheck(state);
+}
+
+// Queue the protocol's `timeout` notification, stop reading, and close once
+// it has been written (or after kCloseLingerTicks, whichever comes first).
+void WorkerThread::expireSession(ClientState& state)
+{
+    Response notification;
+    notification.command = "timeout";
+    notification.message = "Session expired after " + std::to_string(config.idleTimeoutSeconds) + "s of inactivity";
+    state.queueProtocolResponse(notification);
+
+    if (state.isAuthenticated()) {
+        logActivity("INFO", "Session timeout: " + state.username());
+    }
+    pauseReading(state);
+    state.setClosing(true);
+    idleTimers.schedule(state.socket(), state.generation(), idleTimers.now() + kCloseLingerTicks);
+}
+
+// The fd stays open until the kernel has returned every operation that
+// references it or the ClientState's buffers.
+void WorkerThread::retireUringClient(std::unique_ptr<ClientState> state)
+{
+    const int fd = state->socket();
+    if (!state->receiveArmed() && state->sendsInFlight() == 0) {
+        ::close(fd);
+        return;
+    }
+
+    ::shutdown(fd, SHUT_RDWR);
+    if (io_uring_sqe* sqe = ring->nextSqe()) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = packUserData(UringOp::Cancel, fd, state->generation());
+    }
+    retiringClients[fd] = std::move(state);
+}
+
+// Runs on the worker thread after the loop ends: cancel everything and reap
+// the completions so no send or recv outlives the memory it points at.
+void WorkerThread::drainUringOnExit()
+{
+    for (std::size_t fd = 0; fd < clientSlots.size(); ++fd) {
+        if (clientSlots[fd].state) {
+            ::shutdown(static_cast<int>(fd), SHUT_RDWR);
+        }
+    }
+    if (io_uring_sqe* sqe = ring->nextSqe()) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = packUserData(UringOp::Cancel, 0, 0);
+    }
+
+    const auto outstanding = [this]() {
+        std::size_t ops = epollPollArmed ? 1 : 0;
+        for (const ClientSlot& slot : clientSlots) {
+            if (slot.state) {
+                ops += (slot.state->receiveArmed() ? 1 : 0) + slot.state->sendsInFlight();
+            }
+        }
+        for (const auto& [fd, state] : retiringClients) {
+            ops += (state->receiveArmed() ? 1 : 0) + state->sendsInFlight();
+        }
+        return ops;
+    };
+
+    while (outstanding() > 0) {
+        if (ring->submit(1) < 0 && errno != EINTR) {
+            break;
         }
+        ring->drainCompletions([this](const io_uring_cqe& cqe) { handleCompletion(cqe); });
     }
 
-    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, clientFd, nullptr);
-    ::close(clientFd);
-    removeClient(clientFd);
+    ring.reset();
 }
@@ -1,12 +1,15 @@
 #include "AuthManager.h"
+#include "CpuAffinity.h"
 #include "DatabaseEngine.h"
 #include "HuxleyServer.h"
+#include "ServerConfig.h"
 
 #include <atomic>
 #include <chrono>
 #include <csignal>
 #include <iostream>
 #include <optional>
+#include <sched.h>
 #include <string>
 #include <thread>
 
@@ -20,8 +23,48 @@ void handleSignal(int)
 
 void printUsage(const char* prog)
 {
-    std::cout << "Usage: " << prog << " [--port <port>] [--duration <seconds>] [--no-block]" << std::endl;
+    std::cout << "Usage: " << prog << " [--port <port>] [--duration <seconds>] [--no-block] [--reuseport] [--io-uring]" << std::endl;
+    std::cout << "       [--ipv6] [--unix-socket <path> [--shm-ring <bytes>]]" << std::endl;
+    std::cout << "       [--max-connections <n>] [--max-per-ip <n>] [--accept-rate <n>] [--accept-rate-per-ip <n>]" << std::endl;
+    std::cout << "       [--send-high-water <bytes>] [--send-low-water <bytes>] [--slow-consumer <policy>]" << std::endl;
+    std::cout << "       [--idle-timeout <seconds>] [--heartbeat <seconds>]" << std::endl;
+    std::cout << "       [--db-batch <ops>] [--db-batch-us <micros>] [--send-ack <when>]" << std::endl;
+    std::cout << "       [--auth-threads <n>] [--auth-queue <n>] [--resume-ttl <seconds>]" << std::endl;
+    std::cout << "       [--hash-target-ms <ms>] [--hash-memory <MiB>] [--auth-memory-budget <MiB>] [--recalibrate-hash]" << std::endl;
+    std::cout << "       [--upgrade-socket <path> [--takeover] [--no-migrate-clients]]" << std::endl;
+    std::cout << "       [--workers <n>] [--worker-cpus <list>] [--rt-priority <1-99>] [--lock-memory]" << std::endl;
     std::cout << "       --port <port>        TCP port to bind (default: 8080)" << std::endl;
+    std::cout << "       --reuseport         One SO_REUSEPORT listener per worker instead of an accept thread" << std::endl;
+    std::cout << "       --ipv6              Dual-stack TCP listener on [::] (IPv4 clients still connect)" << std::endl;
+    std::cout << "       --unix-socket <path> Also accept local clients on this Unix socket, same protocol" << std::endl;
+    std::cout << "       --shm-ring <bytes>   Let Unix-socket clients switch to shared-memory rings of this size" << std::endl;
+    std::cout << "       --max-connections <n> Refuse connections beyond this many (default: fd limit minus 64)" << std::endl;
+    std::cout << "       --max-per-ip <n>     Connections allowed from one address (default: unlimited)" << std::endl;
+    std::cout << "       --accept-rate <n>    New connections per second, bursts of 2 s worth (default: unlimited)" << std::endl;
+    std::cout << "       --accept-rate-per-ip <n> The same per address (default: unlimited)" << std::endl;
+    std::cout << "       --io-uring          io_uring event loop in each worker (falls back to epoll)" << std::endl;
+    std::cout << "       --send-high-water <bytes> Per-client send backlog that marks a slow consumer (default: 1 MiB)" << std::endl;
+    std::cout << "       --send-low-water <bytes>  Backlog at which a slow consumer recovers (default: 256 KiB)" << std::endl;
+    std::cout << "       --slow-consumer <policy>  pause | spill | disconnect (default: spill)" << std::endl;
+    std::cout << "       --idle-timeout <seconds>  Expire sessions without commands for this long, 0 = never (default: 1800)" << std::endl;
+    std::cout << "       --heartbeat <seconds>     Ping silent peers this often to detect dead ones, 0 = never (default: 60)" << std::endl;
+    std::cout << "       --db-batch <ops>          Message writes committed together at most (default: 64)" << std::endl;
+    std::cout << "       --db-batch-us <micros>    Longest a write waits for its batch to fill (default: 2000)" << std::endl;
+    std::cout << "       --send-ack <when>         enqueue | commit: when send_message is answered (default: enqueue)" << std::endl;
+    std::cout << "       --auth-threads <n>        Threads hashing passwords for register/login, 0 = on the workers (default: 2)" << std::endl;
+    std::cout << "       --auth-queue <n>          Register/login requests allowed to wait for them (default: 64)" << std::endl;
+    std::cout << "       --hash-target-ms <ms>     Password hash time to calibrate for (default: 50)" << std::endl;
+    std::cout << "       --hash-memory <MiB>       Most memory one password hash may use (default: 64)" << std::endl;
+    std::cout << "       --auth-memory-budget <MiB> Memory all hashes in flight may use, 0 = unlimited (default: 256)" << std::endl;
+    std::cout << "       --recalibrate-hash        Measure the hash cost again instead of using the stored one" << std::endl;
+    std::cout << "       --resume-ttl <seconds>    Lifetime of the resume token LOGIN hands out, 0 = no RESUME (default: 86400)" << std::endl;
+    std::cout << "       --upgrade-socket <path>   Unix socket a successor connects to for a hot restart" << std::endl;
+    std::cout << "       --takeover                Take over sockets and connections from the server on --upgrade-socket" << std::endl;
+    std::cout << "       --no-migrate-clients      Hand only the listening sockets to a successor" << std::endl;
+    std::cout << "       --workers <n>             Worker threads (default: one per --worker-cpus entry, else per core)" << std::endl;
+    std::cout << "       --worker-cpus <list>      Pin workers to these CPUs, e.g. 1-3; other threads get the rest" << std::endl;
+    std::cout << "       --rt-priority <1-99>      Run workers under SCHED_FIFO at this priority (needs CAP_SYS_NICE)" << std::endl;
+    std::cout << "       --lock-memory             mlockall and prefault worker stacks (needs CAP_IPC_LOCK)" << std::endl;
     std::cout << "       --duration <seconds> Run headless for N seconds then exit" << std::endl;
     std::cout << "       --no-block          Run headless until SIGINT/SIGTERM" << std::endl;
 }
@@ -32,6 +75,7 @@ int main(int argc, char** argv)
     int port = 8080;
     bool waitForEnter = true;
     std::optional<int> durationSeconds;
+    ServerConfig config;
 
     for (int i = 1; i < argc; ++i) {
         const std::string arg = argv[i];
@@ -42,6 +86,91 @@ int main(int argc, char** argv)
             waitForEnter = false;
         } else if (arg == "--no-block") {
             waitForEnter = false;
+        } else if (arg == "--reuseport") {
+            config.acceptMode = ServerConfig::AcceptMode::ReusePort;
+        } else if (arg == "--ipv6") {
+            config.dualStack = true;
+        } else if (arg == "--unix-socket" && i + 1 < argc) {
+            config.unixSocketPath = argv[++i];
+        } else if (arg == "--shm-ring" && i + 1 < argc) {
+            config.shmRingBytes = std::stoul(argv[++i]);
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            config.maxConnections = std::stoul(argv[++i]);
+        } else if (arg == "--max-per-ip" && i + 1 < argc) {
+            config.maxConnectionsPerSource = std::stoul(argv[++i]);
+        } else if (arg == "--accept-rate" && i + 1 < argc) {
+            config.acceptRate = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--accept-rate-per-ip" && i + 1 < argc) {
+            config.acceptRatePerSource = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--io-uring") {
+            config.ioBackend = ServerConfig::IoBackend::IoUring;
+        } else if (arg == "--send-high-water" && i + 1 < argc) {
+            config.sendHighWatermark = std::stoul(argv[++i]);
+        } else if (arg == "--send-low-water" && i + 1 < argc) {
+            config.sendLowWatermark = std::stoul(argv[++i]);
+        } else if (arg == "--idle-timeout" && i + 1 < argc) {
+            config.idleTimeoutSeconds = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--heartbeat" && i + 1 < argc) {
+            config.heartbeatSeconds = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--db-batch" && i + 1 < argc) {
+            config.dbBatchOps = std::stoul(argv[++i]);
+        } else if (arg == "--db-batch-us" && i + 1 < argc) {
+            config.dbBatchMicros = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--send-ack" && i + 1 < argc) {
+            const std::string when = argv[++i];
+            if (when == "enqueue") {
+                config.sendMessageAck = ServerConfig::WriteAck::Enqueued;
+            } else if (when == "commit") {
+                config.sendMessageAck = ServerConfig::WriteAck::Committed;
+            } else {
+                std::cerr << "Unknown --send-ack value: " << when << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--auth-threads" && i + 1 < argc) {
+            config.authThreads = std::stoul(argv[++i]);
+        } else if (arg == "--auth-queue" && i + 1 < argc) {
+            config.authQueueLimit = std::stoul(argv[++i]);
+        } else if (arg == "--hash-target-ms" && i + 1 < argc) {
+            config.hashTargetMillis = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--hash-memory" && i + 1 < argc) {
+            config.hashMemoryBytes = std::stoul(argv[++i]) * 1024 * 1024;
+        } else if (arg == "--auth-memory-budget" && i + 1 < argc) {
+            config.authMemoryBudget = std::stoul(argv[++i]) * 1024 * 1024;
+        } else if (arg == "--recalibrate-hash") {
+            config.recalibrateHash = true;
+        } else if (arg == "--resume-ttl" && i + 1 < argc) {
+            config.resumeTokenSeconds = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--upgrade-socket" && i + 1 < argc) {
+            config.upgradeSocketPath = argv[++i];
+        } else if (arg == "--takeover") {
+            config.takeover = true;
+        } else if (arg == "--no-migrate-clients") {
+            config.migrateClients = false;
+        } else if (arg == "--workers" && i + 1 < argc) {
+            config.workerCount = std::stoul(argv[++i]);
+        } else if (arg == "--worker-cpus" && i + 1 < argc) {
+            if (!affinity::parseCpuList(argv[++i], config.workerCpus)) {
+                std::cerr << "Bad CPU list: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rt-priority" && i + 1 < argc) {
+            config.realtimePriority = std::stoi(argv[++i]);
+        } else if (arg == "--lock-memory") {
+            config.lockMemory = true;
+        } else if (arg == "--slow-consumer" && i + 1 < argc) {
+            const std::string policy = argv[++i];
+            if (policy == "pause") {
+                config.slowConsumerPolicy = ServerConfig::SlowConsumerPolicy::PauseSenders;
+            } else if (policy == "spill") {
+                config.slowConsumerPolicy = ServerConfig::SlowConsumerPolicy::SpillOffline;
+            } else if (policy == "disconnect") {
+                config.slowConsumerPolicy = ServerConfig::SlowConsumerPolicy::Disconnect;
+            } else {
+                std::cerr << "Unknown slow consumer policy: " << policy << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
         } else if (arg == "--help" || arg == "-h") {
             printUsage(argv[0]);
             return 0;
@@ -52,13 +181,34 @@ int main(int argc, char** argv)
         }
     }
 
+    if (config.dbBatchOps == 0) {
+        std::cerr << "--db-batch must be at least 1" << std::endl;
+        return 1;
+    }
+    if (config.takeover && config.upgradeSocketPath.empty()) {
+        std::cerr << "--takeover requires --upgrade-socket" << std::endl;
+        return 1;
+    }
+    if (config.shmRingBytes > 0 && config.unixSocketPath.empty()) {
+        std::cerr << "--shm-ring requires --unix-socket" << std::endl;
+        return 1;
+    }
+    if (config.realtimePriority < 0 || config.realtimePriority > sched_get_priority_max(SCHED_FIFO)) {
+        std::cerr << "--rt-priority must be between 1 and " << sched_get_priority_max(SCHED_FIFO) << std::endl;
+        return 1;
+    }
+    if (config.sendLowWatermark > config.sendHighWatermark) {
+        std::cerr << "--send-low-water must not exceed --send-high-water" << std::endl;
+        return 1;
+    }
+
     Database database("huxley.db");
     if (!database.isOpen()) {
         std::cerr << "Failed to open database" << std::endl;
         return 1;
     }
 
-    HuxleyServer server;
+    HuxleyServer server(config);
     if (!server.start(port)) {
         std::cerr << "Server failed to start" << std::endl;
         return 1;
@@ -74,9 +224,12 @@ int main(int argc, char** argv)
         std::cout << "Server running on port " << port << ". Send SIGINT (Ctrl+C) to stop." << std::endl;
         std::signal(SIGINT, handleSignal);
         std::signal(SIGTERM, handleSignal);
-        while (gKeepRunning.load()) {
+        while (gKeepRunning.load() && !server.handedOff()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(200));
         }
+        if (server.handedOff()) {
+            std::cout << "Handed off to successor, exiting." << std::endl;
+        }
     }
 
     server.stop();
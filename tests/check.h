@@ -0,0 +1,26 @@
+// tests/check.h
+#pragma once
+
+#include <iostream>
+
+// Shared by the host unit tests: one line per check, and main() returns
+// checkResult() so the binary exits non-zero if any of them failed.
+inline int& checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void check(bool ok, const char* what)
+{
+    std::cout << (ok ? "ok   " : "FAIL ") << what << "\n";
+    if (!ok) {
+        ++checkFailures();
+    }
+}
+
+inline int checkResult()
+{
+    std::cout << (checkFailures() ? "FAILED" : "PASSED") << "\n";
+    return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// tests/test_admission.cpp
+#include "AdmissionControl.h"
+#include "ProtocolHandler.h"
+#include "check.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+namespace {
+using Verdict = AdmissionControl::Verdict;
+
+sockaddr_storage ipv4(const char* address)
+{
+    sockaddr_storage peer {};
+    auto& in = reinterpret_cast<sockaddr_in&>(peer);
+    in.sin_family = AF_INET;
+    ::inet_pton(AF_INET, address, &in.sin_addr);
+    return peer;
+}
+
+sockaddr_storage ipv6(const char* address)
+{
+    sockaddr_storage peer {};
+    auto& in6 = reinterpret_cast<sockaddr_in6&>(peer);
+    in6.sin6_family = AF_INET6;
+    ::inet_pton(AF_INET6, address, &in6.sin6_addr);
+    return peer;
+}
+
+sockaddr_storage local()
+{
+    sockaddr_storage peer {};
+    peer.ss_family = AF_UNIX;
+    return peer;
+}
+
+// admit() and release() only use the fd as a table index, so plain numbers
+// stand in for sockets.
+int admitMany(AdmissionControl& admission, int firstFd, int count, const sockaddr_storage& peer)
+{
+    int admitted = 0;
+    for (int i = 0; i < count; ++i) {
+        if (admission.admit(firstFd + i, peer) == Verdict::Admitted) {
+            ++admitted;
+        }
+    }
+    return admitted;
+}
+} // namespace
+
+int main()
+{
+    ProtocolHandler protocol;
+
+    {
+        ServerConfig config;
+        config.maxConnections = 3;
+        AdmissionControl admission(config, protocol);
+        check(admitMany(admission, 10, 3, ipv4("10.0.0.1")) == 3, "admits up to the global cap");
+        check(admission.admit(13, ipv4("10.0.0.2")) == Verdict::ServerFull, "refuses past the global cap");
+        check(admission.admit(13, local()) == Verdict::ServerFull, "local peers count against the global cap");
+        admission.release(11);
+        admission.release(11);
+        check(admission.stats().connections == 2, "release forgets a connection once");
+        check(admission.admit(14, ipv4("10.0.0.2")) == Verdict::Admitted, "a released slot is reusable");
+        check(admission.stats().admitted == 4, "stats count admissions");
+    }
+
+    {
+        ServerConfig config;
+        config.maxConnections = 100;
+        config.maxConnectionsPerSource = 2;
+        AdmissionControl admission(config, protocol);
+        check(admitMany(admission, 10, 2, ipv4("192.0.2.7")) == 2, "admits up to the per-source cap");
+        check(admission.admit(12, ipv4("192.0.2.7")) == Verdict::SourceFull, "refuses a third from the same address");
+        check(admission.admit(12, ipv6("::ffff:192.0.2.7")) == Verdict::SourceFull, "v4-mapped IPv6 is the same source");
+        check(admission.admit(12, ipv4("192.0.2.8")) == Verdict::Admitted, "other addresses are unaffected");
+        check(admitMany(admission, 20, 3, local()) == 3, "local peers have no per-source limit");
+        admission.release(10);
+        check(admission.admit(13, ipv4("192.0.2.7")) == Verdict::Admitted, "releasing frees the source's slot");
+    }
+
+    {
+        // 5/s with a 2 s burst: 10 back to back, then one per 200 ms.
+        ServerConfig config;
+        config.maxConnections = 1000;
+        config.acceptRate = 5;
+        AdmissionControl admission(config, protocol);
+        check(admitMany(admission, 10, 10, ipv4("10.1.0.1")) == 10, "the global bucket starts with a full burst");
+        check(admission.admit(20, ipv4("10.1.0.2")) == Verdict::RateLimited, "an empty bucket refuses");
+        ::usleep(250 * 1000);
+        check(admission.admit(21, ipv4("10.1.0.3")) == Verdict::Admitted, "the bucket refills at the configured rate");
+        check(admission.admit(22, ipv4("10.1.0.4")) == Verdict::RateLimited, "and only by what has elapsed");
+        ::usleep(2500 * 1000);
+        check(admitMany(admission, 30, 20, ipv4("10.1.0.5")) == 10, "refill is capped at the burst");
+    }
+
+    {
+        ServerConfig config;
+        config.maxConnections = 1000;
+        config.acceptRatePerSource = 2;
+        AdmissionControl admission(config, protocol);
+        check(admitMany(admission, 10, 5, ipv4("198.51.100.1")) == 4, "a source's bucket holds two seconds of its rate");
+        check(admitMany(admission, 20, 4, ipv4("198.51.100.2")) == 4, "every source has its own bucket");
+        for (int fd = 10; fd < 14; ++fd) {
+            admission.release(fd);
+        }
+        check(admission.admit(30, ipv4("198.51.100.1")) == Verdict::RateLimited,
+              "closing connections does not refill the bucket");
+    }
+
+    {
+        ServerConfig config;
+        config.maxConnections = 1;
+        AdmissionControl admission(config, protocol);
+        int pair[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+        admission.admit(100, local());
+        const Verdict verdict = admission.admit(pair[0], local());
+        admission.reject(pair[0], verdict);
+
+        char buffer[512];
+        const ssize_t received = ::recv(pair[1], buffer, sizeof(buffer), 0);
+        uint32_t netSize = 0;
+        std::memcpy(&netSize, buffer, sizeof(netSize));
+        const std::string payload(buffer + sizeof(netSize), received > 4 ? static_cast<std::size_t>(received) - 4 : 0);
+        check(received > 4 && ntohl(netSize) == payload.size(), "reject sends one length-prefixed frame");
+        check(payload.find("\"busy\"") != std::string::npos && payload.find("false") != std::string::npos,
+              "the frame is a busy notification with success false");
+        check(::recv(pair[1], buffer, sizeof(buffer), 0) == 0, "and closes the socket");
+        check(admission.stats().shedServerFull == 1, "stats count the shed connection");
+        ::close(pair[1]);
+    }
+
+    return checkResult();
+}
@@ -0,0 +1,116 @@
+// tests/test_groups.cpp
+#include "DatabaseEngine.h"
+#include "check.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+std::vector<int> queuedIds(const Database& db, int userId)
+{
+    std::vector<int> ids;
+    for (const auto& message : db.getQueuedGroupMessages(userId)) {
+        ids.push_back(message.id);
+    }
+    return ids;
+}
+
+int userId(Database& db, const std::string& name)
+{
+    db.insertUser(name, "hash");
+    int id = 0;
+    db.findUserId(name, id);
+    return id;
+}
+} // namespace
+
+int main()
+{
+    char path[] = "/tmp/huxley_groups_XXXXXX";
+    const int fd = ::mkstemp(path);
+    if (fd == -1) {
+        std::perror("mkstemp");
+        return 1;
+    }
+    ::close(fd);
+
+    {
+        Database db(path);
+        check(db.isOpen(), "opens a fresh database");
+
+        const int alice = userId(db, "alice");
+        const int bob = userId(db, "bob");
+        const int carol = userId(db, "carol");
+
+        int group = 0;
+        int duplicate = 0;
+        check(db.createGroup("team", alice, group), "creates a group");
+        check(!db.createGroup("team", bob, duplicate), "group names are unique");
+        int found = 0;
+        check(db.findGroupId("team", found) && found == group, "finds the group by name");
+        check(db.isGroupMember(group, alice), "the creator is a member");
+
+        check(db.joinGroup(group, bob) && db.joinGroup(group, bob), "joining twice is a no-op");
+
+        int m1 = 0;
+        int m2 = 0;
+        int m3 = 0;
+        int m4 = 0;
+        db.insertGroupMessage(group, alice, "c1", "n1", m1);
+        check(db.joinGroup(group, carol), "a third member joins");
+        check(queuedIds(db, carol).empty(), "a new member does not see earlier messages");
+
+        db.insertGroupMessage(group, bob, "c2", "n2", m2);
+        db.insertGroupMessage(group, alice, "c3", "n3", m3);
+        db.insertGroupMessage(group, carol, "c4", "n4", m4);
+        check(db.groupMemberIds(group).size() == 3, "lists every member");
+
+        check(queuedIds(db, alice) == std::vector<int>{m2, m4}, "a member's own messages are not queued for them");
+        check(queuedIds(db, bob) == std::vector<int>{m1, m3, m4}, "queued messages come oldest first");
+        check(queuedIds(db, carol) == std::vector<int>{m2, m3}, "only messages after the join are queued");
+
+        // bob missed m1 in real time but got m3: the cursor must not jump the gap
+        db.advanceGroupCursor(group, bob, m3);
+        check(queuedIds(db, bob) == std::vector<int>{m1, m3, m4}, "a gap keeps the cursor in place");
+        db.advanceGroupCursor(group, bob, m1);
+        check(queuedIds(db, bob) == std::vector<int>{m3, m4}, "delivering the oldest moves the cursor");
+        db.advanceGroupCursor(group, bob, m3);
+        check(queuedIds(db, bob) == std::vector<int>{m4}, "the cursor then follows contiguous deliveries");
+
+        // carol's own m4 does not count as a gap
+        db.advanceGroupCursor(group, carol, m2);
+        db.advanceGroupCursor(group, carol, m3);
+        check(queuedIds(db, carol).empty(), "the member's own messages are not a gap");
+
+        // alice gets m4 in real time while m2 is still missing; catch-up then
+        // queues everything and sets the cursor past the gap
+        db.advanceGroupCursor(group, alice, m4);
+        check(queuedIds(db, alice) == std::vector<int>{m2, m4}, "realtime delivery past a gap leaves it queued");
+        db.setGroupCursor(group, alice, m4);
+        check(queuedIds(db, alice).empty(), "setGroupCursor moves the cursor past the gap");
+        db.setGroupCursor(group, alice, m1);
+        check(queuedIds(db, alice).empty(), "setGroupCursor never moves the cursor back");
+
+        const auto stored = db.getQueuedGroupMessages(bob);
+        check(stored.size() == 1 && stored[0].group == "team" && stored[0].groupId == group
+                  && stored[0].senderId == carol && stored[0].ciphertext == "c4" && stored[0].nonce == "n4",
+              "queued rows carry the group, sender and ciphertext");
+
+        check(db.leaveGroup(group, carol), "a member leaves");
+        check(!db.leaveGroup(group, carol), "leaving twice fails");
+        check(!db.isGroupMember(group, carol), "a member who left is no longer one");
+        int m5 = 0;
+        db.insertGroupMessage(group, alice, "c5", "n5", m5);
+        check(queuedIds(db, carol).empty(), "a member who left gets nothing new");
+    }
+
+    std::remove(path);
+    std::remove((std::string(path) + "-wal").c_str());
+    std::remove((std::string(path) + "-shm").c_str());
+
+    return checkResult();
+}
@@ -0,0 +1,118 @@
+// tests/test_mpscqueue.cpp
+#include "MpscQueue.h"
+#include "check.h"
+
+#include <pthread.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr int kProducers = 4;
+constexpr int kPerProducer = 50000;
+
+struct Item {
+    int producer;
+    int sequence;
+};
+
+struct Shared {
+    MpscQueue<Item> queue;
+    std::atomic<int> wakeups {0}; // pushes that found the queue empty
+    std::atomic<bool> go {false};
+};
+
+struct ProducerArgs {
+    Shared* shared;
+    int id;
+};
+
+void* produce(void* arg)
+{
+    auto* args = static_cast<ProducerArgs*>(arg);
+    while (!args->shared->go.load(std::memory_order_acquire)) {
+    }
+    for (int i = 0; i < kPerProducer; ++i) {
+        if (args->shared->queue.push(Item{args->id, i})) {
+            args->shared->wakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+int main()
+{
+    {
+        MpscQueue<std::string> queue;
+        check(queue.empty(), "starts empty");
+        check(queue.push("a"), "first push reports the empty transition");
+        check(!queue.push("b"), "second push does not");
+        check(!queue.push("c"), "nor does a third");
+        check(!queue.empty(), "not empty after pushes");
+
+        std::vector<std::string> out;
+        const std::size_t drained = queue.drain([&out](std::string& value) { out.push_back(value); });
+        check(drained == 3 && out == std::vector<std::string>{"a", "b", "c"}, "drain returns items in push order");
+        check(queue.empty(), "empty after drain");
+        check(queue.drain([](std::string&) {}) == 0, "draining an empty queue does nothing");
+        check(queue.push("d"), "push after a drain reports the empty transition again");
+    }
+
+    {
+        // Items still queued are freed by the destructor.
+        auto tracked = std::make_shared<int>(0);
+        {
+            MpscQueue<std::shared_ptr<int>> queue;
+            queue.push(tracked);
+            queue.push(tracked);
+            check(tracked.use_count() == 3, "queued items hold their values");
+        }
+        check(tracked.use_count() == 1, "destructor releases queued items");
+    }
+
+    {
+        // Several producers against one consumer that drains concurrently:
+        // nothing is lost or duplicated, each producer's items come out in
+        // its own order, and exactly one push per non-empty drain saw the
+        // queue empty (the one that would have kicked the consumer).
+        Shared shared;
+        pthread_t threads[kProducers];
+        ProducerArgs args[kProducers];
+        for (int p = 0; p < kProducers; ++p) {
+            args[p] = ProducerArgs{&shared, p};
+            pthread_create(&threads[p], nullptr, produce, &args[p]);
+        }
+
+        std::vector<int> next(kProducers, 0);
+        bool ordered = true;
+        long total = 0;
+        long nonEmptyDrains = 0;
+        shared.go.store(true, std::memory_order_release);
+        while (total < static_cast<long>(kProducers) * kPerProducer) {
+            const std::size_t count = shared.queue.drain([&](Item& item) {
+                if (item.sequence != next[item.producer]) {
+                    ordered = false;
+                }
+                next[item.producer] = item.sequence + 1;
+            });
+            total += static_cast<long>(count);
+            if (count > 0) {
+                ++nonEmptyDrains;
+            }
+        }
+        for (int p = 0; p < kProducers; ++p) {
+            pthread_join(threads[p], nullptr);
+        }
+
+        check(total == static_cast<long>(kProducers) * kPerProducer, "every pushed item is drained exactly once");
+        check(ordered, "each producer's items come out in its push order");
+        check(shared.queue.empty(), "queue is empty at the end");
+        check(shared.wakeups.load() == nonEmptyDrains,
+              "one wakeup per empty-to-non-empty transition");
+    }
+
+    return checkResult();
+}
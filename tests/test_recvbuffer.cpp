@@ -0,0 +1,80 @@
+// tests/test_recvbuffer.cpp
+#include "RecvBuffer.h"
+#include "check.h"
+
+#include <cstring>
+#include <string>
+
+namespace {
+void appendString(RecvBuffer& buffer, const std::string& data)
+{
+    buffer.append(data.data(), data.size());
+}
+} // namespace
+
+int main()
+{
+    {
+        RecvBuffer buffer;
+        check(buffer.empty() && buffer.writable() == 0, "starts empty with no storage");
+        char* tail = buffer.prepare(10);
+        check(buffer.writable() == RecvBuffer::kDefaultCapacity, "first prepare allocates the default capacity");
+        std::memcpy(tail, "0123456789", 10);
+        buffer.commit(10);
+        check(buffer.readable() == "0123456789", "committed bytes are readable");
+        buffer.consume(4);
+        check(buffer.readable() == "456789", "consume advances the head");
+        buffer.consume(100);
+        check(buffer.empty(), "over-consuming drains the buffer");
+        check(buffer.writable() == RecvBuffer::kDefaultCapacity, "draining rewinds to the front");
+    }
+
+    {
+        // Fill most of the buffer, consume a prefix, then ask for more than
+        // the tail holds but less than the free space: the unread bytes move
+        // to the front instead of the buffer growing.
+        RecvBuffer buffer;
+        const std::size_t capacity = RecvBuffer::kDefaultCapacity;
+        appendString(buffer, std::string(capacity - 100, 'a') + std::string(100, 'b'));
+        buffer.consume(capacity - 100);
+        check(buffer.writable() == 0, "tail is full");
+        const char* before = buffer.readable().data();
+        buffer.prepare(1000);
+        check(buffer.readable() == std::string(100, 'b'), "compaction keeps the unread bytes");
+        check(buffer.readable().data() != before, "compaction moved them to the front");
+        check(buffer.writable() == capacity - 100, "compaction reclaims the consumed prefix without growing");
+    }
+
+    {
+        // Unread data plus the request no longer fits: the buffer doubles
+        // until it does and keeps the unread bytes contiguous.
+        RecvBuffer buffer;
+        appendString(buffer, "xyz");
+        buffer.consume(1);
+        buffer.prepare(3 * RecvBuffer::kDefaultCapacity);
+        check(buffer.readable() == "yz", "growth keeps the unread bytes");
+        check(buffer.writable() >= 3 * RecvBuffer::kDefaultCapacity, "growth makes room for the request");
+        check(buffer.size() + buffer.writable() == 4 * RecvBuffer::kDefaultCapacity, "growth doubles the capacity");
+    }
+
+    {
+        // Large appends in pieces stay contiguous, so a frame split across
+        // reads can be parsed in place.
+        RecvBuffer buffer;
+        std::string expected;
+        for (int i = 0; i < 100; ++i) {
+            const std::string piece(257, static_cast<char>('a' + i % 26));
+            appendString(buffer, piece);
+            expected += piece;
+            if (i % 10 == 9) {
+                buffer.consume(500);
+                expected.erase(0, 500);
+            }
+        }
+        check(buffer.readable() == expected, "interleaved appends and consumes stay contiguous and in order");
+        buffer.clear();
+        check(buffer.empty(), "clear drops everything");
+    }
+
+    return checkResult();
+}
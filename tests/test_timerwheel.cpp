@@ -0,0 +1,108 @@
+// tests/test_timerwheel.cpp
+#include "TimerWheel.h"
+#include "check.h"
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+// Level 0 spans 256 ticks, level 1 256 * 64, level 2 256 * 64 * 64.
+constexpr uint64_t kLevel1Span = 256;
+constexpr uint64_t kLevel2Span = 256 * 64;
+constexpr uint64_t kHorizon = 256 * 64 * 64 - 1;
+
+// Advances one tick at a time and records when each fd fired.
+std::map<int, uint64_t> runUntil(TimerWheel& wheel, uint64_t tick)
+{
+    std::map<int, uint64_t> fired;
+    while (wheel.now() < tick) {
+        wheel.advance(wheel.now() + 1, [&](int fd, uint32_t) { fired[fd] = wheel.now(); });
+    }
+    return fired;
+}
+} // namespace
+
+int main()
+{
+    {
+        // Deadlines on every level, started just short of a level-1 and a
+        // level-2 boundary so the cascades happen early in the run.
+        for (const uint64_t start : {uint64_t{0}, kLevel1Span - 3, kLevel2Span - 5, uint64_t{1000003}}) {
+            TimerWheel wheel(start);
+            std::mt19937_64 rng(start + 1);
+            std::map<int, uint64_t> due;
+            for (int fd = 0; fd < 2000; ++fd) {
+                uint64_t delta = 0;
+                switch (fd % 4) {
+                case 0: delta = 1 + rng() % (kLevel1Span - 1); break;                  // level 0
+                case 1: delta = kLevel1Span + rng() % (kLevel2Span - kLevel1Span); break; // level 1
+                case 2: delta = kLevel2Span + rng() % (kHorizon - kLevel2Span); break;    // level 2
+                default: delta = fd % 7 == 0 ? kLevel1Span : kLevel2Span; break;         // exact boundaries
+                }
+                due[fd] = start + delta;
+                wheel.schedule(fd, 0, start + delta);
+            }
+            const auto fired = runUntil(wheel, start + kHorizon);
+            bool exact = fired.size() == due.size();
+            for (const auto& [fd, tick] : due) {
+                const auto it = fired.find(fd);
+                exact = exact && it != fired.end() && it->second == tick;
+            }
+            check(exact, "every timer fires on its tick after cascading down the levels");
+        }
+    }
+
+    {
+        TimerWheel wheel(100);
+        wheel.schedule(3, 7, 50);
+        uint32_t generation = 0;
+        uint64_t firedAt = 0;
+        wheel.advance(101, [&](int, uint32_t gen) {
+            generation = gen;
+            firedAt = wheel.now();
+        });
+        check(firedAt == 101 && generation == 7, "a deadline in the past fires on the next tick with its generation");
+
+        wheel.schedule(4, 0, wheel.now() + 10 * kHorizon);
+        check(wheel.armed(4), "a far deadline is armed");
+        const auto fired = runUntil(wheel, wheel.now() + kHorizon);
+        check(fired.count(4) == 1, "deadlines past the horizon are clamped to it");
+    }
+
+    {
+        TimerWheel wheel;
+        wheel.schedule(1, 0, 300);
+        wheel.schedule(2, 0, 300);
+        wheel.schedule(3, 0, 300);
+        wheel.cancel(2);
+        check(!wheel.armed(2) && wheel.armed(1) && wheel.armed(3), "cancel unlinks only that timer");
+        wheel.cancel(2);
+        wheel.cancel(99);
+        check(wheel.armed(1), "cancelling an unarmed or unknown fd is a no-op");
+
+        wheel.schedule(3, 0, 20000); // re-arm moves it from level 1 to level 2
+        const auto early = runUntil(wheel, 301);
+        check(early.count(1) == 1 && early.count(2) == 0 && early.count(3) == 0, "re-armed timer no longer fires at the old deadline");
+        const auto late = runUntil(wheel, 20000);
+        check(late.size() == 1 && late.at(3) == 20000, "re-armed timer fires at the new deadline");
+        check(!wheel.armed(3), "a fired timer is disarmed");
+    }
+
+    {
+        // A callback may re-arm the timer it is handling (heartbeats do).
+        TimerWheel wheel;
+        wheel.schedule(5, 0, 10);
+        std::vector<uint64_t> ticks;
+        while (wheel.now() < 1000) {
+            wheel.advance(wheel.now() + 1, [&](int fd, uint32_t generation) {
+                ticks.push_back(wheel.now());
+                wheel.schedule(fd, generation, wheel.now() + 300);
+            });
+        }
+        check(ticks == std::vector<uint64_t>{10, 310, 610, 910}, "re-arming from the callback keeps a periodic timer");
+    }
+
+    return checkResult();
+}